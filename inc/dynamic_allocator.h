@@ -11,6 +11,20 @@
 #define DYN_ALLOC_MIN_BLOCK_SIZE (1<<3) 	//8 BYTE
 #define META_DATA_SIZE (1<<3) 	            //8 BYTE
 
+/*Layout of the Allocated Blocks*/
+//1: allocated blocks have a header & a footer (the layout checked by the DA tests)
+//0: only free blocks have a footer; instead, each header (and the END block) has a
+//   "previous block is free" bit, so allocated blocks carry 4 bytes of meta data only
+//DA_ALLOCATED_FOOTER is the default layout; set_da_allocated_footer() selects it at runtime
+//(it takes effect from the next initialize_dynamic_allocator)
+#define DA_ALLOCATED_FOOTER 1
+extern bool daAllocatedFooter;
+
+#define DA_ALLOCATED_FLAG 0x1
+#define DA_PREV_FREE_FLAG 0x2				//used only if daAllocatedFooter is 0
+#define ALLOC_META_DATA_SIZE (daAllocatedFooter ? META_DATA_SIZE : META_DATA_SIZE / 2)
+#define DA_BLOCK_FLAGS (daAllocatedFooter ? DA_ALLOCATED_FLAG : (DA_ALLOCATED_FLAG | DA_PREV_FREE_FLAG))
+
 /*Implementation Type of List*/
 #define IMPLICIT_LIST 1
 #define EXPLICIT_LIST_ALL 2
@@ -23,7 +37,8 @@ enum
 	DA_FF = 1,
 	DA_NF,
 	DA_BF,
-	DA_WF
+	DA_WF,
+	DA_SF		//segregated fit: power-of-two size bins
 };
 
 //=============================================================================
@@ -35,6 +50,53 @@ struct BlockElement
 
 LIST_HEAD(MemBlock_LIST, BlockElement);
 struct MemBlock_LIST freeBlocksList ;
+
+//Segregated fit (DA_SF): free blocks are kept in power-of-two bins instead of freeBlocksList.
+//Bin i holds the free blocks whose size (incl. meta data) is in [2^i, 2^(i+1)),
+//and bit i of freeBinsBitmap is set iff bin i is not empty.
+#define DA_NUM_BINS 32
+struct MemBlock_LIST freeBlocksBins[DA_NUM_BINS] ;
+uint32 freeBinsBitmap ;
+
+//Always-on statistics (printed by the kernel "kheapstat" command)
+uint32 daAllocatedBytes ;		//total size (incl. meta data) of the allocated blocks
+uint32 daPeakAllocatedBytes ;	//max daAllocatedBytes since the allocator was initialized
+
+//Workload trace: while daTraceEnabled is set, the user heap logs each malloc/free/realloc into the
+//ring buffer daTrace (daTraceCount records so far, the last DA_TRACE_SIZE of them are kept).
+//A user program exports its trace over the console & to the kernel (export_heap_trace), where the
+//"replaytrace" command replays it against each placement strategy of the block allocator.
+#define DA_TRACE_SIZE 512
+enum
+{
+	DA_TRACE_ALLOC = 1,
+	DA_TRACE_FREE,
+	DA_TRACE_REALLOC
+};
+struct DATraceRecord
+{
+	uint8 op;
+	uint32 size;		//requested size (ALLOC, REALLOC)
+	uint32 addr;		//given address (FREE, REALLOC)
+	uint32 result;		//returned address (ALLOC, REALLOC)
+	uint32 timestamp;	//low 32 bits of the TSC
+};
+struct DATraceRecord daTrace[DA_TRACE_SIZE] ;
+uint32 daTraceCount ;
+bool daTraceEnabled ;
+
+//Result of replaying a trace against one strategy
+struct DAReplayStats
+{
+	uint32 ops;				//replayed operations
+	uint32 skipped;			//not served by the block allocator (e.g. > DYN_ALLOC_MAX_BLOCK_SIZE)
+	uint32 failed;			//allocations that ran out of the replay arena
+	uint64 cycles;			//TSC cycles spent inside the allocator
+	uint32 peak_footprint;	//max size of the heap (break - start)
+	uint32 peak_allocated;	//max total size of the allocated blocks
+	uint32 free_bytes;		//free space left at the end of the trace
+	uint32 largest_free;	//largest free block at the end of the trace
+};
 //=============================================================================
 
 /*Functions*/
@@ -52,23 +114,35 @@ __inline__ int8 is_free_block(void* va);
 void print_blocks_list(struct MemBlock_LIST list);
 
 void* extend_mapped_region(uint32 size);
+uint32 trim_mapped_region();
 void* add_free_block(void* va, uint32 size);
+void insert_free_block(struct BlockElement* blk);
+void remove_free_block(struct BlockElement* blk);
 bool alloc(struct BlockElement *current_free_block, uint32 required_size);
+uint32 get_free_blocks_count();
 //=============================================================================
 
 //Required Functions
 //In KernelHeap: should be implemented inside kern/mem/kheap.c
 //In UserHeap: should be implemented inside lib/uheap.c
-void* sbrk(int numOfPages);
+void* sbrk(int numOfPages);				//numOfPages < 0: gives back the pages at the end of the heap
 
 void initialize_dynamic_allocator(uint32 daStart, uint32 initSizeOfAllocatedSpace);
+void set_da_allocated_footer(bool enabled);
 void set_block_data(void* va, uint32 totalSize, bool isAllocated);
 void *alloc_block(uint32 size, int ALLOC_STRATEGY);
 void *alloc_block_FF(uint32 size);
 void *alloc_block_BF(uint32 size);
 void *alloc_block_WF(uint32 size);
 void *alloc_block_NF(uint32 size);
+void *alloc_block_SF(uint32 size);
 void free_block(void* va);
 void *realloc_block_FF(void* va, uint32 new_size);
 
+void da_trace_record(uint8 op, uint32 size, void* addr, void* result);
+void da_trace_print(struct DATraceRecord* trace, uint32 count);
+uint32 da_trace_replay_size(struct DATraceRecord* trace, uint32 count);
+void da_trace_replay(struct DATraceRecord* trace, uint32 count, int strategy, void* arena, uint32 arena_size,
+		void** blocks, struct DAReplayStats* stats);
+
 #endif
@@ -67,6 +67,7 @@ struct WorkingSetElement {
 	unsigned int sweeps_counter;
 	//2020
 	LIST_ENTRY(WorkingSetElement) prev_next_info;	// list link pointers
+	struct WorkingSetElement* hash_next;			// next element in the same bucket of the WS VA hash
 };
 
 //2020
@@ -127,6 +128,8 @@ struct Env {
 	uint32 uheap_hard_limit;
 	uint32 uheap_pages_count;
 	uint32* shared_id_directory;
+	struct vm_area* uheap_vmas;		// Reserved areas of the user heap (AVL tree, see kern/mem/vma.h)
+	uint32 mem_pressure;			// Incremented each time free frames become scarce (polled by the user heap to trim itself)
 
 	//=======================================================================
 	//for page file management
@@ -147,6 +150,10 @@ struct Env {
 #if USE_KHEAP
 	struct WS_List page_WS_list ;					//List of WS elements
 	struct WorkingSetElement* page_last_WS_element;	//ptr to last inserted WS element
+	struct WorkingSetElement* page_WS_slots;		//The WS elements [page_WS_max_size of them, allocated with the env]
+	struct WS_List page_WS_free_slots;				//Slots that are not in the WS list
+	struct WorkingSetElement** page_WS_hash;		//WS elements by VA [page_WS_hash_mask+1 buckets]
+	uint32 page_WS_hash_mask;
 #else
 	struct WorkingSetElement ptr_pageWorkingSet[__PWS_MAX_SIZE];
 	//uint32 page_last_WS_index;
@@ -170,6 +177,16 @@ struct Env {
 	//Percentage of WS pages to be removed [either for scarce RAM or Full WS]
 	unsigned int percentage_of_WS_pages_to_be_removed;
 
+	//Readahead: a fault at readaheadNextVA continues a sequential stream & doubles readaheadWindow
+	uint32 readaheadNextVA;
+	uint32 readaheadWindow;
+	void* readaheadBuffer;		//READAHEAD_MAX_PAGES pages to read a run into (allocated at the first readahead)
+
+	//PFF sizing: nClocks & pageFaultsCounter of the env at the last sample of its fault rate
+	uint32 pffLastSampleClock;
+	uint32 pffLastFaults;
+	uint32 pffPendingWSSize;	//WS max size to apply at the next page fault (0: none)
+
 	//==================
 	/*CPU BSD Sched...*/
 	//==================
@@ -187,6 +204,8 @@ struct Env {
 	//2020
 	uint32 nPageIn, nPageOut, nNewPageAdded;
 	uint32 nClocks ;
+	uint32 nPrefetchedPages;	//pages read ahead of a fault (included in nPageIn)
+	uint32 nPageOutRequests;	//disk requests writing back pages (fewer than nPageOut when they're clustered)
 
 };
 
@@ -20,6 +20,7 @@
 #include <inc/syscall.h>
 #include <inc/uheap.h>
 #include <inc/dynamic_allocator.h>
+#include <inc/medium_allocator.h>
 
 #define USED(x)		(void)(x)
 #define RAND(s,e)	((sys_get_virtual_time().low % (e-s) + s))
@@ -53,6 +54,8 @@ void 	sys_exit_env();
 int 	sys_create_env(char* programName, unsigned int page_WS_size,unsigned int LRU_second_list_size,unsigned int percent_WS_pages_to_remove);
 int		sys_destroy_env(int32 envId);
 void	sys_run_env(int32 envId);
+//Copy-on-write child of the caller (created as NEW, run it by sys_run_env). Returns 0 in the child
+int32	sys_fork(void);
 
 //Memory
 int 	__sys_allocate_page(void *va, int perm);
@@ -79,6 +82,7 @@ uint32 	sys_isUHeapPlacementStrategyBESTFIT();
 uint32 	sys_isUHeapPlacementStrategyNEXTFIT();
 uint32 	sys_isUHeapPlacementStrategyWORSTFIT();
 void 	sys_set_uheap_strategy(uint32 heapStrategy);
+void	sys_save_heap_trace(struct DATraceRecord* trace, uint32 count);
 
 
 //Page File
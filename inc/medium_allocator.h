@@ -0,0 +1,61 @@
+#ifndef FOS_INC_MEDIUM_ALLOCATOR_H
+#define FOS_INC_MEDIUM_ALLOCATOR_H
+#include <inc/queue.h>
+#include <inc/types.h>
+
+//==================================================================================//
+//============================= MEDIUM OBJECTS ALLOCATOR ===========================//
+//==================================================================================//
+/* Objects bigger than DYN_ALLOC_MAX_BLOCK_SIZE & up to MEDIUM_MAX_SIZE are packed into
+ * spans (runs of pages taken from the page allocator) instead of being rounded up to whole pages:
+ *	- size classes: each power-of-two band (2^k, 2^(k+1)] is split into 8 equal steps (<= 12.5% internal waste)
+ *	- a span holds a header followed by equal-size slots of one class
+ *	- each slot is an 8-byte header (owning span + magic) followed by the object
+ *	- a size is only served here if its slot is smaller than the pages it would take otherwise
+ * Shared by the kernel heap (kmalloc) & the user heap (malloc): each of them provides
+ * medium_span_alloc/medium_span_free on top of its own page allocator & serializes the calls.
+ * Off by default in both heaps: the kernel (khmedium command) & user programs opt in by set_medium_objects(1).
+ */
+
+#define MEDIUM_MIN_SIZE			(1<<11)		//exclusive (= DYN_ALLOC_MAX_BLOCK_SIZE)
+#define MEDIUM_MAX_SIZE			(1<<16)		//64 KB
+#define MEDIUM_STEPS_PER_BAND	8
+#define MEDIUM_NUM_CLASSES		(5 * MEDIUM_STEPS_PER_BAND)	//bands of 2, 4, 8, 16 & 32 KB
+#define MEDIUM_MAX_SPAN_PAGES	32
+
+#define MEDIUM_MAGIC_ALLOCATED	0x4D454441
+#define MEDIUM_MAGIC_FREE		0x4D454446
+
+struct MediumSpan
+{
+	uint32 class;			//size class of its objects
+	uint32 pages;			//number of pages of the span
+	uint32 inuse;			//number of allocated objects
+	void* free_objs;		//free objects, chained through their first word
+	LIST_ENTRY(MediumSpan) prev_next_info;
+};
+
+struct MediumSlotHeader
+{
+	struct MediumSpan* span;
+	uint32 magic;
+};
+
+LIST_HEAD(MediumSpan_LIST, MediumSpan);
+//spans that have at least one free object, per class
+struct MediumSpan_LIST mediumSpans[MEDIUM_NUM_CLASSES];
+
+/*Functions*/
+int medium_class(uint32 size);
+uint32 medium_class_size(int cls);
+void* medium_alloc(uint32 size);
+void medium_free(void* va);
+uint32 medium_object_size(void* va);
+void set_medium_objects(bool enabled);
+bool medium_objects_enabled();
+
+//should be implemented by the heap that uses the allocator (kern/mem/kheap.c & lib/uheap.c)
+void* medium_span_alloc(uint32 pages);
+void medium_span_free(void* va);
+
+#endif
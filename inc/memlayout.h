@@ -212,11 +212,16 @@ struct FrameInfo {
 	// frames allocated at boot time using memory_manager.c's
 	// boot_allocate_space do not have valid reference count fields.
 	uint16 references;
+	// (page number inside the kernel heap + 1) of the kernel heap page this frame is mapped at, 0 if none
+	// (reverse map for kheap_virtual_address(), fits in the padding after references)
+	uint16 kheapPage;
 	struct Env *proc;
 	uint32 bufferedVA;
 	unsigned char isBuffered;
 
 	struct WorkingSetElement* ws_ptr;
+	// reverse map of a frame of a shared object (its share & all its mappings), NULL for other frames
+	struct frame_rmap* rmap;
 };
 
 #endif /* !__ASSEMBLER__ */
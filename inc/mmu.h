@@ -68,6 +68,8 @@
 #define PTE_MBZ		0x180	// Bits must be zero
 #define PERM_BUFFERED 0x200 //Page it buffered
 #define MARKING_BIT 0x400 //the marking of the page to be used in the check
+#define PERM_COW 0x800 //Page is copy-on-write: mapped read-only till its 1st write gives it its own frame
+#define PERM_SHARE_OUT 0x400 //(non-present user page only, MARKING_BIT is for kernel pages) page of a shared object whose frame is evicted to the page file
 
 
 // The PERM_AVAILABLE bits aren't used by the kernel or interpreted by the
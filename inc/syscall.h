@@ -61,6 +61,8 @@ enum
 	SYS_env_set_priority, // MS3
 	SYS_get_value,
 	SYS_set_value,
+	SYS_save_heap_trace,
+	SYS_fork,
 	NSYSCALLS
 };
 
@@ -10,11 +10,19 @@
 //2020
 #define UHP_USE_BUDDY 0
 
+//Recently freed page runs are kept reserved & mapped, and reused by the next malloc of the same number of pages
+#define PAGE_RUN_CACHE_SIZE			8		//max number of cached runs
+#define PAGE_RUN_CACHE_MAX_PAGES	256		//only runs of up to 1 MB are cached
+#define PAGE_RUN_CACHE_DECAY		64		//a run that is not reused within this number of page allocations/frees is released
+
 void *malloc(uint32 size);
 void* smalloc(char *sharedVarName, uint32 size, uint8 isWritable);
 void* sget(int32 ownerEnvID, char *sharedVarName);
 void free(void* virtual_address);
 void sfree(void* virtual_address);
 void *realloc(void *virtual_address, uint32 new_size);
+void set_page_run_cache(bool enabled);
+void set_heap_trace(bool enabled);
+void export_heap_trace();
 
 #endif
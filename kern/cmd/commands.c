@@ -8,11 +8,14 @@
 
 #include "commands.h"
 
+#include <inc/dynamic_allocator.h>
+#include <inc/medium_allocator.h>
 #include <kern/trap/trap.h>
 #include <kern/trap/fault_handler.h>
 #include <kern/proc/user_environment.h>
 #include <kern/proc/priority_manager.h>
 #include "../cpu/sched.h"
+#include "../cpu/cpu.h"
 #include "../disk/pagefile_manager.h"
 #include "../mem/kheap.h"
 #include "../mem/memory_manager.h"
@@ -29,6 +32,8 @@ struct Command commands[] =
 		{ "help", "Display this list of commands", command_help, 0 },
 		{ "kernel_info", "Display information about the kernel", command_kernel_info, 0 },
 		{ "meminfo", "display info about RAM", command_meminfo, 0},
+		{ "kheapstat", "display usage & fragmentation counters of the kernel heap", command_kheapstat, 0},
+		{ "replaytrace", "replay the last exported user heap trace against each block allocator strategy", command_replay_heap_trace, 0},
 		{"sched?", "print current scheduler algorithm", command_print_sch_method, 0},
 		{"runall", "run all loaded programs", command_run_all, 0},
 		{"printall", "print all loaded programs", command_print_all, 0},
@@ -48,11 +53,17 @@ struct Command commands[] =
 		{"khnextfit", "set KERNEL heap placement strategy to NEXT FIT", command_set_kheap_plac_NEXTFIT, 0},
 		{"khworstfit", "set KERNEL heap placement strategy to WORST FIT", command_set_kheap_plac_WORSTFIT, 0},
 		{"kheap?", "print current KERNEL heap placement strategy", command_print_kheap_plac, 0},
+		{"khmedium", "pack KERNEL heap objects of 2 KB to 64 KB into spans of size classes", command_enable_kheap_medium_objects, 0},
+		{"nokhmedium", "allocate KERNEL heap objects above 2 KB as whole pages", command_disable_kheap_medium_objects, 0},
 		{"nobuff", "disable buffering", command_disable_buffering, 0},
 		{"buff", "enable buffering", command_enable_buffering, 0},
 		{"nomodbuff", "disable modified buffer", command_disable_modified_buffer, 0},
 		{"modbuff", "enable modified buffer", command_enable_modified_buffer, 0},
 		{"modbufflength?", "get modified buffer length", command_get_modified_buffer_length, 0},
+		{"nopff", "disable the working set sizing by page fault frequency", command_disable_pff, 0},
+		{"pff?", "print the parameters of the working set sizing by page fault frequency", command_print_pff, 0},
+		{"batchevict", "evict a batch of pages from a full working set & write back its modified ones together", command_enable_batch_eviction, 0},
+		{"nobatchevict", "replace one page at a time in a full working set", command_disable_batch_eviction, 0},
 
 		//*****************************//
 		/* COMMANDS WITH ONE ARGUMENT */
@@ -73,6 +84,7 @@ struct Command commands[] =
 		{ "schedBSD", "switch the scheduler to BSD with given # queues & quantum", command_sch_BSD, 2},
 		{ "setPri", "set the priority of the given environment (by its ID)", command_set_priority, 2},
 		{"nclock", "set replacement algorithm to Nth chance CLOCK (type=1: NORMAL Ver. type=2: MODIFIED Ver.", command_set_page_rep_nthCLOCK, 2},
+		{"gclock", "set replacement algorithm to GLOBAL Nth chance CLOCK over all envs: gclock <N> <type> [<maxWS> <WSGrowthStep>] (type=1: NORMAL Ver. type=2: MODIFIED Ver.", command_set_page_rep_global_nthCLOCK, -1},
 
 		//********************************//
 		/* COMMANDS WITH THREE ARGUMENTS */
@@ -91,6 +103,7 @@ struct Command commands[] =
 		{ "schedMLFQ", "switch the scheduler to MLFQ with given # queues & quantums", command_sch_MLFQ, -1},
 		{"load", "load a single user program to mem with status = NEW", commnad_load_env, -1},
 		{"tst", "run the given test", command_tst, -1},
+		{"pff", "size the working sets by page fault frequency: pff <minWS> <maxWS> [<interval> <lowFaults> <highFaults>]", command_enable_pff, -1},
 };
 
 //Number of commands = size of the array / size of command structure
@@ -358,6 +371,92 @@ int command_meminfo(int number_of_arguments, char **arguments)
 	return 0;
 }
 
+int command_kheapstat(int number_of_arguments, char **arguments)
+{
+	uint32 allocs[KHEAP_STAT_CLASSES] = {0}, frees[KHEAP_STAT_CLASSES] = {0};
+	uint32 failed_allocs = 0, cached_blocks = 0;
+	for (int c = 0; c < NCPUS; c++)
+	{
+		for (int i = 0; i < KHEAP_STAT_CLASSES; i++)
+		{
+			allocs[i] += CPUS[c].kheap_stats.allocs[i];
+			frees[i] += CPUS[c].kheap_stats.frees[i];
+		}
+		failed_allocs += CPUS[c].kheap_stats.failed_allocs;
+		for (int i = 0; i < KMAG_NUM_CLASSES; i++)
+			cached_blocks += CPUS[c].kmags[i].rounds;
+	}
+
+	acquire_kernel_lock();
+	uint32 da_size = segment_break - Kernel_Heap_start;
+	uint32 da_in_use = daAllocatedBytes, da_peak = daPeakAllocatedBytes;
+	uint32 free_blocks = get_free_blocks_count();
+	uint32 pages_in_use = kheap_pages_in_use, peak_pages = kheap_peak_pages_in_use;
+	uint32 largest_free_run = get_free_value(1);	//the root of the page tree
+	release_kernel_lock();
+
+	cprintf("Block allocator: %d of %d bytes in use (peak %d), %d free blocks, %d blocks cached in per-CPU magazines\n",
+			da_in_use, da_size, da_peak, free_blocks, cached_blocks);
+	cprintf("Page allocator: %d pages in use (peak %d), largest free run = %d pages\n",
+			pages_in_use, peak_pages, largest_free_run);
+	cprintf("Failed allocations = %d\n", failed_allocs);
+	cprintf("%12s %10s %10s %10s\n", "size <=", "allocs", "frees", "live");
+	for (int i = 0; i < KHEAP_STAT_CLASSES; i++)
+	{
+		if (allocs[i] == 0 && frees[i] == 0)
+			continue;
+		if (i == KHEAP_STAT_CLASSES - 1)
+			cprintf("%12s %10d %10d %10d\n", "larger", allocs[i], frees[i], allocs[i] - frees[i]);
+		else
+			cprintf("%12d %10d %10d %10d\n", 16 << i, allocs[i], frees[i], allocs[i] - frees[i]);
+	}
+	return 0;
+}
+
+int command_replay_heap_trace(int number_of_arguments, char **arguments)
+{
+	static int strategies[] = { DA_FF, DA_BF, DA_NF, DA_WF, DA_SF };
+	static char* names[] = { "FF", "BF", "NF", "WF", "SF" };
+
+	uint32 records = MIN(daTraceCount, DA_TRACE_SIZE);
+	if (records == 0)
+	{
+		cprintf("No heap trace: call set_heap_trace(1) then export_heap_trace() in a user program\n");
+		return 0;
+	}
+
+	uint32 arena_size = da_trace_replay_size(daTrace, daTraceCount);
+	void* arena = kmalloc(arena_size);
+	void** blocks = kmalloc(records * sizeof(void*));
+	if (arena == NULL || blocks == NULL)
+	{
+		cprintf("Not enough kernel heap to replay the trace (%d bytes)\n", arena_size);
+		kfree(arena);
+		kfree(blocks);
+		return 0;
+	}
+
+	cprintf("Replaying %d records (those that are not block allocations are skipped)\n", records);
+	cprintf("%8s %8s %8s %8s %10s %10s %10s %8s\n", "strategy", "ops", "skipped", "failed", "cycles/op", "footprint", "peak live", "ext frag");
+	for (int i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++)
+	{
+		struct DAReplayStats stats;
+		//the replay puts the kernel block allocator aside
+		acquire_kernel_lock();
+		da_trace_replay(daTrace, daTraceCount, strategies[i], arena, arena_size, blocks, &stats);
+		release_kernel_lock();
+
+		uint32 cycles_per_op = stats.ops ? (uint32)(stats.cycles / stats.ops) : 0;
+		uint32 frag = stats.free_bytes ? 100 - (uint32)((uint64)stats.largest_free * 100 / stats.free_bytes) : 0;
+		cprintf("%8s %8d %8d %8d %10d %10d %10d %7d%%\n", names[i], stats.ops, stats.skipped, stats.failed, cycles_per_op,
+				stats.peak_footprint, stats.peak_allocated, frag);
+	}
+
+	kfree(blocks);
+	kfree(arena);
+	return 0;
+}
+
 //2020
 struct Env * CreateEnv(int number_of_arguments, char **arguments)
 {
@@ -582,6 +681,43 @@ int command_set_page_rep_nthCLOCK(int number_of_arguments, char **arguments)
 	cprintf("Page replacement algorithm is now N chance CLOCK\n");
 	return 0;
 }
+int command_set_page_rep_global_nthCLOCK(int number_of_arguments, char **arguments)
+{
+	if (number_of_arguments != 3 && number_of_arguments != 5)
+	{
+		cprintf("Usage: gclock <N> <type> [<maxWS> <WSGrowthStep>]\n");
+		return 0;
+	}
+	uint32 PageWSMaxSweeps = strtol(arguments[1], NULL, 10);
+	uint8 type = strtol(arguments[2], NULL, 10);
+	if (PageWSMaxSweeps <= 0)
+	{
+		cprintf("Invalid number of sweeps! it should be +ve.\n");
+		return 0;
+	}
+	if (type == 1)		PageWSMaxSweeps = PageWSMaxSweeps * 1;
+	else if (type == 2)	PageWSMaxSweeps = PageWSMaxSweeps * -1;
+	else
+	{
+		cprintf("Invalid type!\n	type=1: NORMAL Ver. type=2: MODIFIED Ver.\n");
+		return 0;
+	}
+	uint32 maxWSSize = DEFAULT_GLOBAL_WS_MAX_SIZE;
+	uint32 WSGrowthStep = DEFAULT_GLOBAL_WS_GROWTH_STEP;
+	if (number_of_arguments == 5)
+	{
+		maxWSSize = strtol(arguments[3], NULL, 10);
+		WSGrowthStep = strtol(arguments[4], NULL, 10);
+		if (maxWSSize == 0 || WSGrowthStep == 0)
+		{
+			cprintf("The max WS size & the WS growth step should be +ve\n");
+			return 0;
+		}
+	}
+	setPageReplacmentAlgorithmGlobalNchanceCLOCK(PageWSMaxSweeps, maxWSSize, WSGrowthStep);
+	cprintf("Page replacement algorithm is now GLOBAL N chance CLOCK\n");
+	return 0;
+}
 int command_set_page_rep_CLOCK(int number_of_arguments, char **arguments)
 {
 	setPageReplacmentAlgorithmCLOCK();
@@ -718,6 +854,13 @@ int command_print_page_rep(int number_of_arguments, char **arguments)
 		if (page_WS_max_sweeps > 0)			cprintf("[NORMAL ver]\n");
 		else if (page_WS_max_sweeps < 0)	cprintf("[MODIFIED ver]\n");
 	}
+	else if (isPageReplacmentAlgorithmGlobalNchanceCLOCK())
+	{
+		cprintf("Page replacement algorithm is GLOBAL Nth Chance CLOCK ");
+		if (page_WS_max_sweeps > 0)			cprintf("[NORMAL ver]\n");
+		else if (page_WS_max_sweeps < 0)	cprintf("[MODIFIED ver]\n");
+		cprintf("A full WS grows by %d pages, up to %d pages\n", global_WS_growth_step, global_WS_max_size);
+	}
 	else
 		cprintf("Page replacement algorithm is UNDEFINED\n");
 
@@ -824,6 +967,20 @@ int command_print_kheap_plac(int number_of_arguments, char **arguments)
 	return 0;
 }
 
+int command_enable_kheap_medium_objects(int number_of_arguments, char **arguments)
+{
+	set_medium_objects(1);
+	cprintf("Kernel Heap objects of 2 KB to 64 KB are now packed into size classes\n");
+	return 0;
+}
+
+int command_disable_kheap_medium_objects(int number_of_arguments, char **arguments)
+{
+	set_medium_objects(0);
+	cprintf("Kernel Heap objects above 2 KB are now allocated as whole pages\n");
+	return 0;
+}
+
 /*2017*///END======================================================
 
 int command_disable_modified_buffer(int number_of_arguments, char **arguments)
@@ -911,6 +1068,62 @@ int command_get_modified_buffer_length(int number_of_arguments, char **arguments
 	return 0;
 }
 
+int command_enable_pff(int number_of_arguments, char **arguments)
+{
+	if (number_of_arguments != 3 && number_of_arguments != 6)
+	{
+		cprintf("Usage: pff <minWS> <maxWS> [<interval> <lowFaults> <highFaults>]\n");
+		return 0;
+	}
+	uint32 min_WS_size = strtol(arguments[1], NULL, 10);
+	uint32 max_WS_size = strtol(arguments[2], NULL, 10);
+	if (min_WS_size == 0 || min_WS_size > max_WS_size)
+	{
+		cprintf("The min WS size should be > 0 and <= the max WS size\n");
+		return 0;
+	}
+	if (number_of_arguments == 6)
+		setPFFParameters(min_WS_size, max_WS_size, strtol(arguments[3], NULL, 10), strtol(arguments[4], NULL, 10), strtol(arguments[5], NULL, 10));
+	else
+		setPFFParameters(min_WS_size, max_WS_size, DEFAULT_PFF_INTERVAL, DEFAULT_PFF_LOW_FAULTS, DEFAULT_PFF_HIGH_FAULTS);
+	enablePFF(1);
+	cprintf("PFF working set sizing is now ENABLED\n");
+	return 0;
+}
+
+int command_disable_pff(int number_of_arguments, char **arguments)
+{
+	enablePFF(0);
+	cprintf("PFF working set sizing is now DISABLED\n");
+	return 0;
+}
+
+int command_print_pff(int number_of_arguments, char **arguments)
+{
+	if (!isPFFEnabled())
+	{
+		cprintf("PFF working set sizing is not enabled\n");
+		return 0;
+	}
+	cprintf("WS size in [%d, %d], every %d ticks: grow above %d faults, shrink below %d faults\n",
+			pff_min_WS_size, pff_max_WS_size, pff_interval, pff_high_faults, pff_low_faults);
+	return 0;
+}
+
+int command_enable_batch_eviction(int number_of_arguments, char **arguments)
+{
+	enableBatchEviction(1);
+	cprintf("Batch eviction is now ENABLED\n");
+	return 0;
+}
+
+int command_disable_batch_eviction(int number_of_arguments, char **arguments)
+{
+	enableBatchEviction(0);
+	cprintf("Batch eviction is now DISABLED\n");
+	return 0;
+}
+
 int command_tst(int number_of_arguments, char **arguments)
 {
 	return tst_handler(number_of_arguments, arguments);
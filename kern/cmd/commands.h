@@ -55,12 +55,15 @@ int command_readuserblock(int number_of_arguments, char **arguments);
 int command_remove_table(int number_of_arguments, char **arguments);
 int command_allocuserpage(int number_of_arguments, char **arguments);
 int command_meminfo(int number_of_arguments, char **arguments);
+int command_kheapstat(int number_of_arguments, char **arguments);
+int command_replay_heap_trace(int number_of_arguments, char **arguments);
 
 int command_set_page_rep_FIFO(int number_of_arguments, char **arguments);
 int command_set_page_rep_CLOCK(int number_of_arguments, char **arguments);
 int command_set_page_rep_LRU(int number_of_arguments, char **arguments);
 int command_set_page_rep_ModifiedCLOCK(int number_of_arguments, char **arguments);
 int command_set_page_rep_nthCLOCK(int number_of_arguments, char **arguments);
+int command_set_page_rep_global_nthCLOCK(int number_of_arguments, char **arguments);
 int command_print_page_rep(int number_of_arguments, char **arguments);
 
 int command_set_uheap_plac_FIRSTFIT(int number_of_arguments, char **arguments);
@@ -75,6 +78,8 @@ int command_set_kheap_plac_BESTFIT(int number_of_arguments, char **arguments);
 int command_set_kheap_plac_NEXTFIT(int number_of_arguments, char **arguments);
 int command_set_kheap_plac_WORSTFIT(int number_of_arguments, char **arguments);
 int command_print_kheap_plac(int number_of_arguments, char **arguments);
+int command_enable_kheap_medium_objects(int number_of_arguments, char **arguments);
+int command_disable_kheap_medium_objects(int number_of_arguments, char **arguments);
 
 int command_disable_modified_buffer(int number_of_arguments, char **arguments);
 int command_enable_modified_buffer(int number_of_arguments, char **arguments);
@@ -86,6 +91,13 @@ int command_enable_buffering(int number_of_arguments, char **arguments);
 int command_set_modified_buffer_length(int number_of_arguments, char **arguments);
 int command_get_modified_buffer_length(int number_of_arguments, char **arguments);
 
+int command_enable_pff(int number_of_arguments, char **arguments);
+int command_disable_pff(int number_of_arguments, char **arguments);
+int command_print_pff(int number_of_arguments, char **arguments);
+
+int command_enable_batch_eviction(int number_of_arguments, char **arguments);
+int command_disable_batch_eviction(int number_of_arguments, char **arguments);
+
 //2018
 int command_sch_RR(int number_of_arguments, char **arguments);
 int command_sch_MLFQ(int number_of_arguments, char **arguments);
@@ -9,6 +9,27 @@
 #define KERN_CPU_CPU_H_
 #include <inc/mmu.h>
 #include <inc/memlayout.h>
+//Per-CPU magazines of small kernel heap blocks (see kmalloc/kfree)
+//Class i holds blocks of (KMAG_MIN_SIZE << i) bytes
+#define KMAG_MIN_SIZE		16
+#define KMAG_NUM_CLASSES	5					//16, 32, 64, 128, 256 bytes
+#define KMAG_MAX_SIZE		(KMAG_MIN_SIZE << (KMAG_NUM_CLASSES - 1))
+#define KMAG_CAPACITY		16					//max blocks held by a magazine
+#define KMAG_BATCH			8					//blocks moved at once between a magazine & the block allocator
+struct kmem_magazine {
+  uint32 rounds;								//number of blocks currently in the magazine
+  void* blocks[KMAG_CAPACITY];
+};
+
+//Kernel heap counters of a CPU (summed by the kheapstat command), by allocation size:
+//class 0: <= 16 bytes, class i: (2^(i+3), 2^(i+4)] bytes, the last class holds all the larger ones
+#define KHEAP_STAT_CLASSES	18
+struct kheap_cpu_stats {
+  uint32 allocs[KHEAP_STAT_CLASSES];
+  uint32 frees[KHEAP_STAT_CLASSES];
+  uint32 failed_allocs;
+};
+
 // Per-CPU state
 struct cpu {
   unsigned char apicid;			// Local APIC ID
@@ -22,6 +43,9 @@ struct cpu {
   int intena;                  	// Were interrupts enabled before pushcli? (for locking)
   struct Env *proc;           	// The process running on this cpu or null
   int scheduler_status ;		// Status of the scheduler at this CPU
+  struct kmem_magazine kmags[KMAG_NUM_CLASSES];	// Small blocks cached for kmalloc on this CPU
+  uint32 kmag_flush_gen;						// Last flush request (kmag_request_flush) served by this CPU
+  struct kheap_cpu_stats kheap_stats;			// kmalloc/kfree counters of this CPU
 };
 
 struct cpu CPUS[NCPUS] ;
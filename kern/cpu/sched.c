@@ -420,6 +420,11 @@ void clock_interrupt_handler(struct Trapframe* tf)
 		{
 			update_WS_time_stamps();
 		}
+		//sample the fault rate only if the env was interrupted in user mode (the resize is done at its next fault)
+		if(isPFFEnabled() && (tf->tf_cs & 3) == 3)
+		{
+			env_page_ws_pff_update(p);
+		}
 		//cprintf("\n***************\nClock Handler\n***************\n") ;
 		//fos_scheduler();
 		yield();
@@ -440,32 +445,32 @@ void update_WS_time_stamps()
 		struct WorkingSetElement* wse ;
 		{
 			int i ;
-#if USE_KHEAP
-			LIST_FOREACH(wse, &(curr_env_ptr->page_WS_list))
+			//sweep the WS slots in order [they are contiguous], skipping the free ones
+			for (i = 0 ; i < (curr_env_ptr->page_WS_max_size); i++)
 			{
+#if USE_KHEAP
+				wse = &(curr_env_ptr->page_WS_slots[i]);
 #else
-				for (i = 0 ; i < (curr_env_ptr->page_WS_max_size); i++)
-				{
-					wse = &(curr_env_ptr->ptr_pageWorkingSet[i]);
-					if( wse->empty == 1)
-						continue;
+				wse = &(curr_env_ptr->ptr_pageWorkingSet[i]);
 #endif
-					//update the time if the page was referenced
-					uint32 page_va = wse->virtual_address ;
-					uint32 perm = pt_get_page_permissions(curr_env_ptr->env_page_directory, page_va) ;
-					uint32 oldTimeStamp = wse->time_stamp;
-
-					if (perm & PERM_USED)
-					{
-						wse->time_stamp = (oldTimeStamp>>2) | 0x80000000;
-						pt_set_page_permissions(curr_env_ptr->env_page_directory, page_va, 0 , PERM_USED) ;
-					}
-					else
-					{
-						wse->time_stamp = (oldTimeStamp>>2);
-					}
+				if( wse->empty == 1)
+					continue;
+				//update the time if the page was referenced
+				uint32 page_va = wse->virtual_address ;
+				uint32 perm = pt_get_page_permissions(curr_env_ptr->env_page_directory, page_va) ;
+				uint32 oldTimeStamp = wse->time_stamp;
+
+				if (perm & PERM_USED)
+				{
+					wse->time_stamp = (oldTimeStamp>>2) | 0x80000000;
+					pt_set_page_permissions(curr_env_ptr->env_page_directory, page_va, 0 , PERM_USED) ;
+				}
+				else
+				{
+					wse->time_stamp = (oldTimeStamp>>2);
 				}
 			}
+		}
 
 			{
 				int t ;
@@ -34,6 +34,14 @@ int read_disk_page(uint32 dfn, void* va)
 }
 
 
+//read "count" consecutive disk frames starting at dfn in one disk request
+int read_disk_pages(uint32 dfn, void* va, uint32 count)
+{
+	uint32 df_start_sector = PAGE_FILE_START_SECTOR+dfn*SECTOR_PER_PAGE;
+
+	return ide_read(df_start_sector, (void*)va, count*SECTOR_PER_PAGE);
+}
+
 int write_disk_page(uint32 dfn, void* va)
 {
 	//write disk at wanted frame
@@ -48,6 +56,18 @@ int write_disk_page(uint32 dfn, void* va)
 	return success;
 }
 
+//write "count" consecutive disk frames starting at dfn in one disk request
+int write_disk_pages(uint32 dfn, void* va, uint32 count)
+{
+	uint32 df_start_sector = PAGE_FILE_START_SECTOR+dfn*SECTOR_PER_PAGE;
+
+	int success = ide_write(df_start_sector, (void*)va, count*SECTOR_PER_PAGE);
+
+	if(success != 0)
+		panic("Error writing on disk\n");
+	return success;
+}
+
 ///========================== PAGE FILE MANAGMENT ==============================
 
 uint32* ptr_disk_page_directory;
@@ -55,7 +75,9 @@ uint32* ptr_disk_page_directory;
 void initialize_disk_page_file();
 
 int read_disk_page(uint32 dfn, void* va);
+int read_disk_pages(uint32 dfn, void* va, uint32 count);
 int write_disk_page(uint32 dfn, void* va);
+int write_disk_pages(uint32 dfn, void* va, uint32 count);
 
 int get_disk_page_directory(struct Env* ptr_env, uint32** ptr_disk_page_directory);
 
@@ -134,18 +156,37 @@ int allocate_disk_frame(uint32 *dfn)
 
 //
 // Return a frame to the disk_free_frame_list.
+// (A disk frame shared by forked envs has references = number of its other envs, it's freed by the last one)
 //
 inline void free_disk_frame(uint32 dfn)
 {
 	// Fill this function in
-	if(dfn == 0) return;
+	if(!PF_HAS_DISK_FRAME(dfn)) return;
 	acquire_spinlock(&DiskFrameLists.dfllock);
 	{
-		LIST_INSERT_HEAD(&DiskFrameLists.disk_free_frame_list, &disk_frames_info[dfn]);
+		if (disk_frames_info[dfn].references > 0)
+			disk_frames_info[dfn].references--;
+		else
+			LIST_INSERT_HEAD(&DiskFrameLists.disk_free_frame_list, &disk_frames_info[dfn]);
 	}
 	release_spinlock(&DiskFrameLists.dfllock);
 }
 
+//
+// Before writing the disk frame of the given disk page table entry: if it's still shared with
+// other (forked) envs, replace it by a new disk frame for this env only
+//
+static int unshare_disk_frame(uint32 *ptr_disk_page_table_entry)
+{
+	uint32 dfn = *ptr_disk_page_table_entry;
+	if(!PF_HAS_DISK_FRAME(dfn) || disk_frames_info[dfn].references == 0) return 0;
+
+	if( allocate_disk_frame(&dfn) == E_NO_PAGE_FILE_SPACE) return E_NO_PAGE_FILE_SPACE;
+	free_disk_frame(*ptr_disk_page_table_entry);
+	*ptr_disk_page_table_entry = dfn;
+	return 0;
+}
+
 int get_disk_page_table(uint32 *ptr_disk_page_directory, const uint32 virtual_address, int create, uint32 **ptr_disk_page_table)
 {
 	// Fill this function in
@@ -215,7 +256,16 @@ int pf_add_empty_env_page( struct Env* ptr_env, uint32 virtual_address, uint8 in
 		if (virtual_address > USTACKBOTTOM && virtual_address < USTACKTOP - ptr_env->initNumStackPages * PAGE_SIZE)
 			ptr_env->nNewPageAdded++ ;
 		//======================
-		return pf_add_env_page(ptr_env, virtual_address, ptr_zero_page);
+
+		//demand-zero: no disk frame (nor write) till the page is modified & written back
+		uint32 *ptr_disk_page_table;
+		get_disk_page_directory(ptr_env, &(ptr_env->disk_env_pgdir)) ;
+		if (get_disk_page_table(ptr_env->disk_env_pgdir,  virtual_address, 1, &ptr_disk_page_table) != 0)
+			return E_NO_PAGE_FILE_SPACE;
+
+		free_disk_frame(ptr_disk_page_table[PTX(virtual_address)]);
+		ptr_disk_page_table[PTX(virtual_address)] = PF_ZERO_FILL_DFN;
+		return 0;
 	}
 
 	uint32 *ptr_disk_page_table;
@@ -226,7 +276,7 @@ int pf_add_empty_env_page( struct Env* ptr_env, uint32 virtual_address, uint8 in
 	get_disk_page_table(ptr_env->disk_env_pgdir,  virtual_address, 1, &ptr_disk_page_table) ;
 
 	uint32 dfn=ptr_disk_page_table[PTX(virtual_address)];
-	if( dfn == 0)
+	if(!PF_HAS_DISK_FRAME(dfn))
 	{
 		if( allocate_disk_frame(&dfn) == E_NO_PAGE_FILE_SPACE) return E_NO_PAGE_FILE_SPACE;
 		ptr_disk_page_table[PTX(virtual_address)] = dfn;
@@ -246,8 +296,10 @@ int pf_add_env_page( struct Env* ptr_env, uint32 virtual_address, void* dataSrc)
 
 	get_disk_page_table(ptr_env->disk_env_pgdir,  virtual_address, 1, &ptr_disk_page_table) ;
 
+	if (unshare_disk_frame(&ptr_disk_page_table[PTX(virtual_address)]) == E_NO_PAGE_FILE_SPACE)
+		return E_NO_PAGE_FILE_SPACE;
 	uint32 dfn=ptr_disk_page_table[PTX(virtual_address)];
-	if( dfn == 0)
+	if(!PF_HAS_DISK_FRAME(dfn))
 	{
 		if( allocate_disk_frame(&dfn) == E_NO_PAGE_FILE_SPACE) return E_NO_PAGE_FILE_SPACE;
 		ptr_disk_page_table[PTX(virtual_address)] = dfn;
@@ -267,7 +319,41 @@ int pf_add_env_page( struct Env* ptr_env, uint32 virtual_address, void* dataSrc)
 	return ret;
 }
 
-int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* modified_page_frame_info)
+//Backs the page at virtual_address by the given frame of a program image instead of a disk frame
+int pf_add_env_image_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* image_frame_info, uint8 copyOnWrite)
+{
+	uint32 *ptr_disk_page_table;
+	assert((uint32)virtual_address < KERNEL_BASE);
+
+	get_disk_page_directory(ptr_env, &(ptr_env->disk_env_pgdir)) ;
+	if (get_disk_page_table(ptr_env->disk_env_pgdir,  virtual_address, 1, &ptr_disk_page_table) != 0)
+		return E_NO_PAGE_FILE_SPACE;
+
+	free_disk_frame(ptr_disk_page_table[PTX(virtual_address)]);
+	ptr_disk_page_table[PTX(virtual_address)] = PF_IMAGE_DFN | to_frame_number(image_frame_info) | (copyOnWrite ? PF_IMAGE_COW : 0);
+	return 0;
+}
+
+//Returns the program image frame backing the page at virtual_address (& whether it's copy-on-write),
+//or NULL if the page is not backed by a program image
+struct FrameInfo* pf_get_env_image_page(struct Env* ptr_env, uint32 virtual_address, uint8* copyOnWrite)
+{
+	uint32 *ptr_disk_page_table;
+
+	if( ptr_env->disk_env_pgdir == 0) return NULL;
+	get_disk_page_table(ptr_env->disk_env_pgdir, virtual_address, 0, &ptr_disk_page_table);
+	if(ptr_disk_page_table == 0) return NULL;
+
+	uint32 dfn=ptr_disk_page_table[PTX(virtual_address)];
+	if (!PF_IS_IMAGE_DFN(dfn)) return NULL;
+
+	*copyOnWrite = (dfn & PF_IMAGE_COW) != 0;
+	return &frames_info[dfn & ~(PF_IMAGE_DFN | PF_IMAGE_COW)];
+}
+
+//Return the disk frame to write back the page at virtual_address of the env: a new, demand-zero or program
+//image page is given its disk frame now, and a disk frame still shared with forked envs is replaced
+static uint32 pf_get_env_page_update_dfn(struct Env* ptr_env, uint32 virtual_address)
 {
 	int ret;
 	uint32 *ptr_disk_page_table;
@@ -281,8 +367,18 @@ int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct Frame
 
 	get_disk_page_table(ptr_env->disk_env_pgdir, virtual_address, 0, &ptr_disk_page_table);
 
+	if(ptr_disk_page_table != NULL && ptr_disk_page_table[PTX(virtual_address)] != 0 &&
+			!PF_HAS_DISK_FRAME(ptr_disk_page_table[PTX(virtual_address)]))
+	{
+		//demand-zero/program image page written back for the first time: give it its disk frame now
+		ret = pf_add_empty_env_page(ptr_env, virtual_address, 0);
+		if (ret == E_NO_PAGE_FILE_SPACE)
+		{
+			panic("pf_update_env_page: attempt to add a new page, but page file out of space!") ;
+		}
+	}
 	//2022
-	if(ptr_disk_page_table == NULL || (ptr_disk_page_table != NULL && ptr_disk_page_table[PTX(virtual_address)]== 0))
+	else if(ptr_disk_page_table == NULL || (ptr_disk_page_table != NULL && ptr_disk_page_table[PTX(virtual_address)]== 0))
 	{
 
 		if ((virtual_address >= USER_HEAP_START && virtual_address < USER_HEAP_MAX) ||
@@ -338,7 +434,15 @@ int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct Frame
 
 
 	get_disk_page_table(ptr_env->disk_env_pgdir, virtual_address, 0, &ptr_disk_page_table);
-	uint32 dfn=ptr_disk_page_table[PTX(virtual_address)];
+	if (unshare_disk_frame(&ptr_disk_page_table[PTX(virtual_address)]) == E_NO_PAGE_FILE_SPACE)
+		panic("pf_update_env_page: attempt to copy a shared page, but page file out of space!") ;
+	return ptr_disk_page_table[PTX(virtual_address)];
+}
+
+int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* modified_page_frame_info)
+{
+	int ret;
+	uint32 dfn = pf_get_env_page_update_dfn(ptr_env, virtual_address);
 
 #if USE_KHEAP
 	{
@@ -371,9 +475,103 @@ int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct Frame
 	//2020
 	ptr_env->nPageOut++ ;
 	//======================
+	ptr_env->nPageOutRequests++ ;
 
 	return ret;
 }
+
+//A page written back by flush_modified_frames() while its frame is on no frame list: its disk frame is
+//found (given to it if needed) & held first, then the frame is written to it from any address space,
+//then it's released [it's freed then if the page was removed from the page file meanwhile]
+uint32 pf_hold_env_page_dfn(struct Env* ptr_env, uint32 virtual_address)
+{
+	uint32 dfn = pf_get_env_page_update_dfn(ptr_env, virtual_address);
+	acquire_spinlock(&DiskFrameLists.dfllock);
+	disk_frames_info[dfn].references++;
+	release_spinlock(&DiskFrameLists.dfllock);
+
+	ptr_env->nPageOut++ ;
+	ptr_env->nPageOutRequests++ ;
+	return dfn;
+}
+
+//Write the frame to the held disk frame through PGFLTEMP of the given (current) page directory
+int pf_write_held_dfn(uint32* ptr_page_directory, uint32 dfn, struct FrameInfo* ptr_frame_info)
+{
+	int ret;
+#if USE_KHEAP
+	map_frame(ptr_page_directory, ptr_frame_info, (uint32)PGFLTEMP, 0);
+	ret = write_disk_page(dfn, (void*)PGFLTEMP);
+	// TEMPORARILY increase the references to prevent unmap_frame from removing the frame
+	ptr_frame_info->references += 1;
+	unmap_frame(ptr_page_directory, (uint32)PGFLTEMP);
+	ptr_frame_info->references -= 1;
+#else
+	ret = write_disk_page(dfn, STATIC_KERNEL_VIRTUAL_ADDRESS(to_physical_address(ptr_frame_info)));
+#endif
+	return ret;
+}
+
+void pf_release_dfn(uint32 dfn)
+{
+	free_disk_frame(dfn);
+}
+
+//Buffer of PF_MAX_CLUSTER_PAGES pages to gather a run of pages written by pf_update_env_pages()
+//(allocated at the first clustered write, then kept). Its caller runs with interrupts disabled
+//(env_page_ws_evict_batch()), so two writes never use it at once
+static void* pf_cluster_buffer = NULL;
+
+//Write back the modified pages at vas[0 .. count-1] of the env (count <= PF_MAX_CLUSTER_PAGES) together:
+//they're written in ascending disk frame order, each run of consecutive disk frames in one disk request
+//(gathered in pf_cluster_buffer). The pages are read through their VAs, so the env must be the current one
+int pf_update_env_pages(struct Env* ptr_env, uint32* vas, uint32 count)
+{
+	uint32 dfns[PF_MAX_CLUSTER_PAGES];
+	assert(count <= PF_MAX_CLUSTER_PAGES);
+
+	//sort the pages by their disk frames (insertion sort, the batch is small)
+	for (int i = 0; i < count; i++)
+	{
+		uint32 va = vas[i];
+		uint32 dfn = pf_get_env_page_update_dfn(ptr_env, va);
+		int j = i;
+		for (; j > 0 && dfns[j-1] > dfn; j--)
+		{
+			dfns[j] = dfns[j-1];
+			vas[j] = vas[j-1];
+		}
+		dfns[j] = dfn;
+		vas[j] = va;
+	}
+
+	if (count > 1 && pf_cluster_buffer == NULL)
+		pf_cluster_buffer = kmalloc(PF_MAX_CLUSTER_PAGES * PAGE_SIZE);
+	void* buffer = pf_cluster_buffer;
+	int ret = 0;
+	for (int i = 0, run; i < count && ret == 0; i += run)
+	{
+		for (run = 1; i + run < count && dfns[i + run] == dfns[i] + run; run++) ;
+
+		if (run == 1 || buffer == NULL)
+		{
+			for (int k = i; k < i + run && ret == 0; k++)
+			{
+				ret = write_disk_page(dfns[k], (void*)vas[k]);
+				ptr_env->nPageOutRequests++ ;
+			}
+		}
+		else
+		{
+			for (int k = 0; k < run; k++)
+				memcpy(buffer + k * PAGE_SIZE, (void*)vas[i + k], PAGE_SIZE);
+			ret = write_disk_pages(dfns[i], buffer, run);
+			ptr_env->nPageOutRequests++ ;
+		}
+	}
+	ptr_env->nPageOut += count ;
+	return ret;
+}
 /*
 int pf_special_update_env_modified_page(struct Env* ptr_env, uint32 virtual_address, struct Frame_Info* page_modified_frame_info)
 {
@@ -408,16 +606,70 @@ int pf_read_env_page(struct Env* ptr_env, void* virtual_address)
 
 	if( dfn == 0) return E_PAGE_NOT_EXIST_IN_PF;
 
-	int disk_read_error = read_disk_page(dfn, virtual_address);
+	//a demand-zero page is just zeroed & a program image page copied, without any disk read
+	int disk_read_error = 0;
+	if (dfn == PF_ZERO_FILL_DFN)
+		memset(virtual_address, 0, PAGE_SIZE);
+	else if (PF_IS_IMAGE_DFN(dfn))
+		memcpy(virtual_address, STATIC_KERNEL_VIRTUAL_ADDRESS((dfn & ~(PF_IMAGE_DFN | PF_IMAGE_COW)) << PGSHIFT), PAGE_SIZE);
+	else
+	{
+		disk_read_error = read_disk_page(dfn, virtual_address);
+
+		//2020
+		ptr_env->nPageIn++ ;
+		//======================
+	}
 
 	//reset modified bit to 0: because FOS copies the placed or replaced page from
 	//HD to memory, the page modified bit is set to 1, but we want the modified bit to be
 	// affected only by "user code" modifications, not our (FOS kernel) modifications
 	pt_set_page_permissions(ptr_env->env_page_directory, (uint32)virtual_address, 0, PERM_MODIFIED);
 
-	//2020
-	ptr_env->nPageIn++ ;
-	//======================
+	return disk_read_error;
+}
+
+//Returns how many pages starting at virtual_address (at most max_count) are stored in consecutive
+//disk frames, so pf_read_env_pages() can read them in one disk request.
+//0 if the page at virtual_address is not in the page file
+uint32 pf_get_env_pages_run(struct Env* ptr_env, uint32 virtual_address, uint32 max_count)
+{
+	uint32 *ptr_disk_page_table;
+	uint32 first_dfn = 0;
+	uint32 count;
+
+	virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	if( ptr_env->disk_env_pgdir == 0) return 0;
+
+	for (count = 0; count < max_count; count++, virtual_address += PAGE_SIZE)
+	{
+		get_disk_page_table(ptr_env->disk_env_pgdir, virtual_address, 0, &ptr_disk_page_table);
+		if(ptr_disk_page_table == 0) break;
+
+		uint32 dfn = ptr_disk_page_table[PTX(virtual_address)];
+		if (count == 0)
+			first_dfn = dfn;
+		if (!PF_HAS_DISK_FRAME(dfn) || dfn != first_dfn + count) break;
+	}
+	return count;
+}
+
+//Reads the run of "count" pages starting at virtual_address (see pf_get_env_pages_run()) from the page
+//file into the kernel buffer "dst" (count pages long). It's up to the caller to place them in memory
+int pf_read_env_pages(struct Env* ptr_env, uint32 virtual_address, uint32 count, void* dst)
+{
+	uint32 *ptr_disk_page_table;
+
+	virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	assert(count * SECTOR_PER_PAGE <= 256);
+	assert(pf_get_env_pages_run(ptr_env, virtual_address, count) == count);
+
+	get_disk_page_table(ptr_env->disk_env_pgdir, virtual_address, 0, &ptr_disk_page_table);
+	uint32 dfn=ptr_disk_page_table[PTX(virtual_address)];
+
+	int disk_read_error = read_disk_pages(dfn, dst, count);
+
+	ptr_env->nPageIn += count ;
 
 	return disk_read_error;
 }
@@ -441,6 +693,103 @@ void pf_remove_env_page(struct Env* ptr_env, uint32 virtual_address)
 	//LOG_STRING("pf_remove_env_page: 3");
 }
 
+//Move the page of the given address in the page file (if any) to another address of the same env, without copying it
+//Return 0 on success, or E_NO_VM if the disk table of the new address can't be created
+int pf_move_env_page(struct Env* ptr_env, uint32 src_virtual_address, uint32 dst_virtual_address)
+{
+	uint32 *ptr_src_disk_page_table, *ptr_dst_disk_page_table;
+
+	if( ptr_env->disk_env_pgdir == 0) return 0;
+
+	get_disk_page_table(ptr_env->disk_env_pgdir, src_virtual_address, 0, &ptr_src_disk_page_table);
+	if(ptr_src_disk_page_table == 0 || ptr_src_disk_page_table[PTX(src_virtual_address)] == 0) return 0;
+
+	int ret = get_disk_page_table(ptr_env->disk_env_pgdir, dst_virtual_address, 1, &ptr_dst_disk_page_table);
+	if(ret != 0) return ret;
+
+	free_disk_frame(ptr_dst_disk_page_table[PTX(dst_virtual_address)]);
+	ptr_dst_disk_page_table[PTX(dst_virtual_address)] = ptr_src_disk_page_table[PTX(src_virtual_address)];
+	ptr_src_disk_page_table[PTX(src_virtual_address)] = 0;
+	return 0;
+}
+
+//==============================
+// SHARED OBJECT PAGES:
+//==============================
+//The evicted pages of a shared object are kept in disk frames owned by the share itself (not by any of
+//its envs). The frame is temporarily mapped at PGFLTEMP of ptr_env (the current env) to be read/written
+
+//Write the frame to the disk frame *dfn of the share page, allocating it on the 1st write
+//Return 0 on success, or E_NO_PAGE_FILE_SPACE
+int pf_write_share_page(struct Env* ptr_env, uint32* dfn, struct FrameInfo* ptr_frame_info)
+{
+	if (*dfn == 0 && allocate_disk_frame(dfn) == E_NO_PAGE_FILE_SPACE)
+		return E_NO_PAGE_FILE_SPACE;
+
+	int ret;
+#if USE_KHEAP
+	map_frame(ptr_env->env_page_directory, ptr_frame_info, (uint32)PGFLTEMP, 0);
+	ret = write_disk_page(*dfn, (void*)PGFLTEMP);
+	unmap_frame(ptr_env->env_page_directory, (uint32)PGFLTEMP);
+#else
+	ret = write_disk_page(*dfn, STATIC_KERNEL_VIRTUAL_ADDRESS(to_physical_address(ptr_frame_info)));
+#endif
+	ptr_env->nPageOut++ ;
+	ptr_env->nPageOutRequests++ ;
+	return ret;
+}
+
+//Read the share page from its disk frame into the (referenced) frame
+int pf_read_share_page(struct Env* ptr_env, uint32 dfn, struct FrameInfo* ptr_frame_info)
+{
+	int ret;
+#if USE_KHEAP
+	map_frame(ptr_env->env_page_directory, ptr_frame_info, (uint32)PGFLTEMP, PERM_WRITEABLE);
+	ret = read_disk_page(dfn, (void*)PGFLTEMP);
+	unmap_frame(ptr_env->env_page_directory, (uint32)PGFLTEMP);
+#else
+	ret = read_disk_page(dfn, STATIC_KERNEL_VIRTUAL_ADDRESS(to_physical_address(ptr_frame_info)));
+#endif
+	ptr_env->nPageIn++ ;
+	return ret;
+}
+
+void pf_remove_share_page(uint32 dfn)
+{
+	free_disk_frame(dfn);
+}
+
+//Give the (new) env "dst" the pages of "src" in the page file: its disk page tables are copied, and
+//their disk frames are shared (till one of the envs writes its own version, see unshare_disk_frame())
+int pf_clone_env(struct Env* dst, struct Env* src)
+{
+	uint32 pdeno;
+
+	get_disk_page_directory(dst, &(dst->disk_env_pgdir)) ;
+	if( src->disk_env_pgdir == 0) return 0;
+
+	for (pdeno = 0; pdeno < PDX(USER_TOP) ; pdeno++)
+	{
+		if (!(src->disk_env_pgdir[pdeno] & PERM_PRESENT))
+			continue;
+
+		uint32 *src_pt, *dst_pt;
+		uint32 virtual_address = pdeno << PDXSHIFT;
+		get_disk_page_table(src->disk_env_pgdir, virtual_address, 0, &src_pt);
+		if (get_disk_page_table(dst->disk_env_pgdir, virtual_address, 1, &dst_pt) != 0)
+			return E_NO_MEM;
+
+		memcpy(dst_pt, src_pt, PAGE_SIZE);
+
+		acquire_spinlock(&DiskFrameLists.dfllock);
+		for (uint32 pteno = 0; pteno < 1024; pteno++)
+			if (PF_HAS_DISK_FRAME(src_pt[pteno]))
+				disk_frames_info[src_pt[pteno]].references++;
+		release_spinlock(&DiskFrameLists.dfllock);
+	}
+	return 0;
+}
+
 void pf_free_env(struct Env* ptr_env)
 {
 	uint32 pdeno;
@@ -15,6 +15,21 @@
 #define PAGE_FILE_SIZE (520 << 20)   	//page file size in MB
 #define PAGES_PER_FILE (PAGE_FILE_SIZE/PAGE_SIZE)
 
+//max pages read/written in one disk request (ide_read()/ide_write() take at most 256 sectors)
+#define PF_MAX_CLUSTER_PAGES (256/SECTOR_PER_PAGE)
+
+//Disk page table entry of a demand-zero page: it has no disk frame till it's first written back,
+//and reading it just zeroes the page
+#define PF_ZERO_FILL_DFN 0xFFFFFFFF
+
+//Disk page table entry of a page of a user program image (embedded in the kernel): PF_IMAGE_DFN | the
+//number of the image frame holding it, which is mapped to the page instead of reading it (copy-on-write
+//if PF_IMAGE_COW). It has no disk frame till it's first written back
+#define PF_IMAGE_DFN 0x80000000
+#define PF_IMAGE_COW 0x40000000
+#define PF_IS_IMAGE_DFN(dfn) (((dfn) & PF_IMAGE_DFN) && (dfn) != PF_ZERO_FILL_DFN)
+#define PF_HAS_DISK_FRAME(dfn) ((dfn) != 0 && !((dfn) & PF_IMAGE_DFN))
+
 ///=============================================================================================
 struct FrameInfo* disk_frames_info;
 struct
@@ -26,13 +41,26 @@ struct
 ///=============================================================================================
 int pf_add_empty_env_page( struct Env* ptr_env, uint32 virtual_address, uint8 initializeByZero);
 int pf_add_env_page( struct Env* ptr_env, uint32 virtual_address, void* dataSrc);
+int pf_add_env_image_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* image_frame_info, uint8 copyOnWrite);
+struct FrameInfo* pf_get_env_image_page(struct Env* ptr_env, uint32 virtual_address, uint8* copyOnWrite);
 int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* modified_page_frame_info);
+int pf_update_env_pages(struct Env* ptr_env, uint32* vas, uint32 count);
+uint32 pf_hold_env_page_dfn(struct Env* ptr_env, uint32 virtual_address);
+int pf_write_held_dfn(uint32* ptr_page_directory, uint32 dfn, struct FrameInfo* ptr_frame_info);
+void pf_release_dfn(uint32 dfn);
 //int pf_special_update_env_modified_page(struct Env* ptr_env, uint32 virtual_address, struct Frame_Info* page_modified_frame_info);
 int pf_read_env_page(struct Env* ptr_env, void* virtual_address);
+uint32 pf_get_env_pages_run(struct Env* ptr_env, uint32 virtual_address, uint32 max_count);
+int pf_read_env_pages(struct Env* ptr_env, uint32 virtual_address, uint32 count, void* dst);
 void pf_remove_env_page(struct Env* ptr_env, uint32 virtual_address);
+int pf_move_env_page(struct Env* ptr_env, uint32 src_virtual_address, uint32 dst_virtual_address);
+int pf_write_share_page(struct Env* ptr_env, uint32* dfn, struct FrameInfo* ptr_frame_info);
+int pf_read_share_page(struct Env* ptr_env, uint32 dfn, struct FrameInfo* ptr_frame_info);
+void pf_remove_share_page(uint32 dfn);
 ///=============================================================================================
 
 int pf_calculate_allocated_pages(struct Env* ptr_env);
 int pf_calculate_free_frames();
 void pf_free_env(struct Env* ptr_env);
+int pf_clone_env(struct Env* dst, struct Env* src);
 #endif //FOS_KERN_FILE_MAN_H
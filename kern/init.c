@@ -21,6 +21,8 @@
 #include <kern/mem/kheap.h>
 #include <kern/mem/memory_manager.h>
 #include <kern/mem/shared_memory_manager.h>
+#include <kern/mem/vma.h>
+#include <kern/mem/rmap.h>
 #include <kern/tests/utilities.h>
 #include <kern/tests/test_kheap.h>
 #include <kern/tests/test_dynamic_allocator.h>
@@ -79,6 +81,8 @@ void FOS_initialize()
 
 #if USE_KHEAP
 		initialize_kheap_dynamic_allocator(KERNEL_HEAP_START, PAGE_SIZE, KERNEL_HEAP_START + DYN_ALLOC_MAX_SIZE);
+		vma_init();
+		rmap_init();
 #endif
 		//	page_check();
 		//setPageReplacmentAlgorithmNchanceCLOCK();
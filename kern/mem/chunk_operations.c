@@ -10,6 +10,7 @@
 #include <kern/proc/user_environment.h>
 #include "kheap.h"
 #include "memory_manager.h"
+#include "vma.h"
 #include <inc/queue.h>
 
 //extern void inctst();
@@ -126,6 +127,7 @@ void* sys_sbrk(int numOfPages)
 	 * 				by the given number of pages. You should allocate NOTHING,
 	 * 				and returns the address of the previous break (i.e. the beginning of newly mapped memory).
 	 * numOfPages = 0: just return the current position of the segment break
+	 * numOfPages < 0: move the segment break back by -numOfPages, and free the pages (frames & page file) of the released range
 	 *
 	 * NOTES:
 	 * 	1) As in real OS, allocate pages lazily. While sbrk moves the segment break, pages are not allocated
@@ -149,6 +151,15 @@ void* sys_sbrk(int numOfPages)
 	if(numOfPages == 0) {
 	   return (void*)env->uheap_segment_break;
 	}
+	if(numOfPages < 0) {
+		uint32 released_size = -numOfPages * PAGE_SIZE;
+		if(old_segment_break - released_size < env->uheap_start)
+			return (void*)-1;
+		if(free_user_mem(env, old_segment_break - released_size, released_size) != 0)
+			return (void*)-1;
+		env->uheap_segment_break = old_segment_break - released_size;
+		return (void*)old_segment_break;
+	}
 	if(old_segment_break + added_size > env->uheap_hard_limit) {
 		return (void*)-1;
 	}
@@ -182,23 +193,17 @@ void allocate_user_mem(struct Env* e, uint32 virtual_address, uint32 size)
 
 	size = ROUNDUP(size, PAGE_SIZE);
 
-	for (uint32 addr = virtual_address; addr < virtual_address + size; addr += PAGE_SIZE) {
-		uint32* ptr_page_table = NULL;
-
-		get_page_table(e->env_page_directory, addr, &ptr_page_table);
-
-		if(ptr_page_table == NULL)
-			ptr_page_table = create_page_table(e->env_page_directory, (uint32)addr);
-
-		ptr_page_table[PTX(addr)] = ptr_page_table[PTX(addr)] | MARKING_BIT;
-	}
-
+	//only reserve the range: its tables & pages are created on first touch (by the fault handler)
+	uint8 kind = (virtual_address < e->uheap_hard_limit) ? VMA_UHEAP_BLOCKS : VMA_UHEAP_PAGES;
+	if(vma_insert(e, virtual_address, virtual_address + size, PERM_WRITEABLE | PERM_USER, kind) == NULL)
+		panic("allocate_user_mem: could not allocate a VM area");
 }
 
 //=====================================
 // 2) FREE USER MEMORY:
 //=====================================
-void free_user_mem(struct Env* e, uint32 virtual_address, uint32 size)
+//Return 0 on success, or E_NO_MEM if the reserved area can't be split (nothing is freed then)
+int free_user_mem(struct Env* e, uint32 virtual_address, uint32 size)
 {
 	/*====================================*/
 	/*Remove this line before start coding*/
@@ -212,18 +217,19 @@ void free_user_mem(struct Env* e, uint32 virtual_address, uint32 size)
 
 	size = ROUNDUP(size, PAGE_SIZE);
 
+	if(vma_remove(e, virtual_address, virtual_address + size) != 0)
+		return E_NO_MEM;
+
 	for (uint32 addr = virtual_address; addr < virtual_address + size; addr += PAGE_SIZE) {
 
 		uint32* ptr_page_table;
-		get_page_table(e->env_page_directory, addr, &ptr_page_table);
-
+		unbuffer_page(e, addr);
 		struct FrameInfo *frame = get_frame_info(e->env_page_directory, addr, &ptr_page_table);
 
-		pt_set_page_permissions(e->env_page_directory, addr, 0, MARKING_BIT);
 		pf_remove_env_page(e, addr);
 
 		if(frame != 0){
-			struct WorkingSetElement* wse = frame->ws_ptr;
+			struct WorkingSetElement* wse = env_page_ws_find(e, addr);
 
 			unmap_frame(e->env_page_directory, wse->virtual_address);
 
@@ -232,29 +238,67 @@ void free_user_mem(struct Env* e, uint32 virtual_address, uint32 size)
 
 			LIST_REMOVE(&(e->page_WS_list), wse);
 
-			kfree(wse);
+			env_page_ws_free_element(e, wse);
 		}
 	}
-
+	return 0;
 }
 
 //=====================================
 // 2) FREE USER MEMORY (BUFFERING):
 //=====================================
-void __free_user_mem_with_buffering(struct Env* e, uint32 virtual_address, uint32 size)
+int __free_user_mem_with_buffering(struct Env* e, uint32 virtual_address, uint32 size)
 {
-	// your code is here, remove the panic and write your code
-	panic("__free_user_mem_with_buffering() is not implemented yet...!!");
+	//free_user_mem() also drops the buffered frames of the range
+	return free_user_mem(e, virtual_address, size);
 }
 
 //=====================================
 // 3) MOVE USER MEMORY:
 //=====================================
+//Move the reserved range [src_virtual_address, +size) of the user heap to dst_virtual_address (the two ranges
+//should not overlap): its mapped pages are remapped & its pages in the page file are relinked, nothing is copied
 void move_user_mem(struct Env* e, uint32 src_virtual_address, uint32 dst_virtual_address, uint32 size)
 {
 	//[PROJECT] [USER HEAP - KERNEL SIDE] move_user_mem
-	//your code is here, remove the panic and write your code
-	panic("move_user_mem() is not implemented yet...!!");
+	size = ROUNDUP(size, PAGE_SIZE);
+
+	struct vm_area* area = vma_find(e, src_virtual_address);
+	if(area == NULL)
+		panic("move_user_mem: %x is not reserved", src_virtual_address);
+	uint32 perms = area->perms;
+	uint8 kind = area->kind;
+
+	for (uint32 offset = 0; offset < size; offset += PAGE_SIZE) {
+		uint32 src = src_virtual_address + offset, dst = dst_virtual_address + offset;
+
+		if(pf_move_env_page(e, src, dst) != 0)
+			panic("move_user_mem: could not create a disk table");
+
+		uint32 *ptr_src_table, *ptr_dst_table;
+		get_page_table(e->env_page_directory, src, &ptr_src_table);
+		if(ptr_src_table == NULL || ptr_src_table[PTX(src)] == 0)
+			continue;
+
+		get_page_table(e->env_page_directory, dst, &ptr_dst_table);
+		if(ptr_dst_table == NULL)
+			ptr_dst_table = create_page_table(e->env_page_directory, dst);
+
+		ptr_dst_table[PTX(dst)] = ptr_src_table[PTX(src)];
+		ptr_src_table[PTX(src)] = 0;
+		tlb_invalidate(e->env_page_directory, (void*)src);
+
+		struct FrameInfo* frame = to_frame_info(EXTRACT_ADDRESS(ptr_dst_table[PTX(dst)]));
+		struct WorkingSetElement* wse = env_page_ws_find(e, src);
+		if(wse != NULL)
+			env_page_ws_set_va(e, wse, dst);
+		else if(frame->isBuffered)
+			frame->bufferedVA = dst;
+	}
+
+	if(vma_remove(e, src_virtual_address, src_virtual_address + size) != 0 ||
+			vma_insert(e, dst_virtual_address, dst_virtual_address + size, perms, kind) == NULL)
+		panic("move_user_mem: could not allocate a VM area");
 }
 
 //=================================================================================//
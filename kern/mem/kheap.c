@@ -2,27 +2,70 @@
 
 #include <inc/memlayout.h>
 #include <inc/dynamic_allocator.h>
+#include <inc/medium_allocator.h>
+#include <kern/cpu/cpu.h>
 #include "memory_manager.h"
 
 #define max(a, b) (a > b ? a : b)
 
 uint32 page_allocator_start;
 uint32 PAGES_COUNT;
-uint32 info_tree[KHEAP_PAGES_COUNT * 2 * sizeof(uint32)];
+uint32 info_tree[KHEAP_PAGES_COUNT * 2];
 struct sleeplock kernel_lock;
 uint32 acquire_count;
-uint32 virtual_address_directory[1<<20];
+
+#if NUM_OF_KHEAP_PAGES >= 0xFFFF
+#error "kernel heap pages don't fit in FrameInfo.kheapPage"
+#endif
+
+static inline void set_kheap_page(struct FrameInfo *frame, uint32 virtual_address){
+	frame->kheapPage = (virtual_address - KERNEL_HEAP_START) / PAGE_SIZE + 1;
+}
+
+//Free runs indexed by their size (for BEST FIT), kept in pages of the page allocator that are only
+//allocated while BEST FIT is selected (see kheap_fit_index_enable & KHEAP_FIT_INDEX_SIZE), NULL otherwise:
+//	size_tree: segment tree over run sizes (SIZES_COUNT leaves), each node = number of free runs with sizes in its range
+//	run_head[size]: first page of a free run of this size, run_next/run_prev[page]: links between runs of the same size
+uint32 SIZES_COUNT;
+uint32* size_tree;
+uint32* run_head;
+uint32* run_next;
+uint32* run_prev;
+#define NO_RUN ((uint32)-1)
+
+//page following the last allocation (for NEXT FIT & CONT ALLOC)
+uint32 next_fit_page;
+
+static inline void update_pages_in_use(int32 delta){
+	kheap_pages_in_use += delta;
+	if(kheap_pages_in_use > kheap_peak_pages_in_use)
+		kheap_peak_pages_in_use = kheap_pages_in_use;
+}
+
+//frames are taken from/returned to the frame allocator in batches of this size
+#define KHEAP_FRAMES_BATCH 128
 
 void free_and_unmap_pages(uint32 start_address,uint32 frames_count)
 {
-    uint32 current_page = start_address;
+	// the frames are only mapped here, so unmapping them frees them (& clears their kheapPage)
+	unmap_range(ptr_page_directory, start_address, frames_count);
+}
+
+// moves the frames mapped at [src_address, src_address + pages_count pages) to the same
+// number of unmapped pages at dst_address by rewriting the PTEs (no data is copied)
+void move_mapped_pages(uint32 src_address, uint32 dst_address, uint32 pages_count)
+{
     uint32 * ptr_page_table;
-    for(int i = 0; i < frames_count; i++) {
-    	struct FrameInfo *frame = get_frame_info(ptr_page_directory, current_page, &ptr_page_table);
-        free_frame(frame);
-        virtual_address_directory[to_frame_number(frame)] = -1;
-        unmap_frame(ptr_page_directory, current_page);
-        current_page += PAGE_SIZE;
+    for(int k = 0; k < pages_count; k++) {
+    	// the ranges may overlap: move in the direction that never overwrites a page that is not moved yet
+    	uint32 i = (dst_address < src_address) ? k : pages_count - 1 - k;
+    	uint32 src_page = src_address + i * PAGE_SIZE;
+    	uint32 dst_page = dst_address + i * PAGE_SIZE;
+
+    	struct FrameInfo *frame = get_frame_info(ptr_page_directory, src_page, &ptr_page_table);
+    	map_frame(ptr_page_directory, frame, dst_page, PERM_PRESENT | PERM_WRITEABLE);
+    	unmap_frame(ptr_page_directory, src_page);
+    	set_kheap_page(frame, dst_page);
     }
 }
 
@@ -30,21 +73,25 @@ int allocate_and_map_pages(uint32 start_address, uint32 end_address)
 {
     uint32 current_page = start_address;
     uint32 permissions = PERM_PRESENT | PERM_WRITEABLE;
-    int ind=0;
+    struct FrameInfo* frames[KHEAP_FRAMES_BATCH];
     while (current_page < end_address) {
-        struct FrameInfo* Frame;
-
-		allocate_frame(&Frame);
+    	uint32 count = (end_address - current_page) / PAGE_SIZE;
+    	if(count > KHEAP_FRAMES_BATCH)
+    		count = KHEAP_FRAMES_BATCH;
 
-		map_frame(ptr_page_directory, Frame, current_page, permissions);
+    	if (allocate_frames(count, frames) != 0) {
+    		//give back the batches mapped so far
+    		if (current_page > start_address)
+    			free_and_unmap_pages(start_address, (current_page - start_address) / PAGE_SIZE);
+    		return 0;
+    	}
 
-		uint32 frame_number = to_frame_number(Frame);
-		virtual_address_directory[frame_number] = current_page >> 12;
+    	map_range(ptr_page_directory, frames, current_page, count, permissions);
 
-        map_frame(ptr_page_directory, Frame, current_page, permissions);
+    	for(int i = 0; i < count; i++)
+    		set_kheap_page(frames[i], current_page + i * PAGE_SIZE);
 
-        current_page += PAGE_SIZE;
-        ind++;
+    	current_page += count * PAGE_SIZE;
     }
 
     return 1;
@@ -90,7 +137,42 @@ inline uint32 get_value(uint32 cur){
 	return info_tree[cur] & VAL_MASK;
 }
 
+static inline void size_tree_update(uint32 size, int delta){
+	uint32 cur = SIZES_COUNT + size;
+	while(cur){
+		size_tree[cur] += delta;
+		cur >>= 1;
+	}
+}
+
+static inline void add_free_run(uint32 page_idx, uint32 size){
+	if(size_tree == NULL) return;
+	run_prev[page_idx] = NO_RUN;
+	run_next[page_idx] = run_head[size];
+	if(run_head[size] != NO_RUN)
+		run_prev[run_head[size]] = page_idx;
+	run_head[size] = page_idx;
+	size_tree_update(size, 1);
+}
+
+static inline void remove_free_run(uint32 page_idx, uint32 size){
+	if(size_tree == NULL) return;
+	if(run_prev[page_idx] != NO_RUN)
+		run_next[run_prev[page_idx]] = run_next[page_idx];
+	else
+		run_head[size] = run_next[page_idx];
+	if(run_next[page_idx] != NO_RUN)
+		run_prev[run_next[page_idx]] = run_prev[page_idx];
+	size_tree_update(size, -1);
+}
+
 inline void update_node(uint32 cur, uint32 val, bool isAllocated){
+	// keep the runs-by-size index in sync with the leaves that start a free run
+	if(get_free_value(cur) > 0)
+		remove_free_run(cur - PAGES_COUNT, get_free_value(cur));
+	if(!isAllocated && val > 0)
+		add_free_run(cur - PAGES_COUNT, val);
+
 	set_info(cur, val, isAllocated);
 	cur >>= 1;
 	while(cur){
@@ -113,18 +195,77 @@ uint32 TREE_first_fit(uint32 count){
 	return cur;
 }
 
-void* TREE_alloc_FF(uint32 count){
+// first leaf at or after page_idx that starts a free run of at least count pages (0 if none)
+uint32 TREE_first_fit_from(uint32 page_idx, uint32 count){
+	uint32 cur = TREE_get_node(page_idx);
+	if(get_free_value(cur) >= count) return cur;
 
-	if(get_free_value(1) < count) return NULL;
+	// go up until a right sibling has a big enough run, then go down to its leftmost one
+	while(cur > 1 && ((cur & 1) || get_free_value(cur | 1) < count))
+		cur >>= 1;
+	if(cur == 1) return 0;
 
-	uint32 cur = TREE_first_fit(count);
-	uint32 page_idx = cur - PAGES_COUNT;
-	uint32 free_pages = get_free_value(cur);
+	cur |= 1;
+	while(cur < PAGES_COUNT){
+		cur <<= 1;
+		if(get_free_value(cur) < count) cur |= 1;
+	}
+	return cur;
+}
 
-	void* va = (void*)(page_allocator_start + page_idx * PAGE_SIZE);
-	int ecode = allocate_and_map_pages((uint32)va, (uint32)va + count * PAGE_SIZE);
+// leaf that starts the free run containing the given (free) leaf,
+// i.e. the last leaf at or before it that has a free value
+uint32 TREE_run_start(uint32 cur){
+	if(get_free_value(cur) > 0) return cur;
 
-	if(ecode == 0) return NULL;
+	// go up until a left sibling has a free run, then go down to its rightmost one
+	while(cur > 1 && (!(cur & 1) || get_free_value(cur ^ 1) == 0))
+		cur >>= 1;
+	if(cur == 1) return 0;
+
+	cur ^= 1;
+	while(cur < PAGES_COUNT){
+		cur = cur << 1 | 1;
+		if(get_free_value(cur) == 0) cur ^= 1;
+	}
+	return cur;
+}
+
+// leaf that starts the smallest free run of at least count pages (0 if none)
+uint32 TREE_best_fit(uint32 count){
+	if(size_tree == NULL) return TREE_first_fit(count); // no index (no memory for it)
+
+	uint32 cur = SIZES_COUNT + count;
+	if(size_tree[cur] == 0){
+		while(cur > 1 && ((cur & 1) || size_tree[cur | 1] == 0))
+			cur >>= 1;
+		if(cur == 1) return 0;
+
+		cur |= 1;
+		while(cur < SIZES_COUNT){
+			cur <<= 1;
+			if(size_tree[cur] == 0) cur |= 1;
+		}
+	}
+	return TREE_get_node(run_head[cur - SIZES_COUNT]);
+}
+
+// leaf that starts the largest free run (the root keeps its size) (0 if it's smaller than count)
+uint32 TREE_worst_fit(uint32 count){
+	uint32 largest = get_free_value(1);
+	if(largest == 0 || largest < count) return 0;
+	return TREE_first_fit(largest);
+}
+
+uint32 TREE_next_fit(uint32 count){
+	uint32 cur = TREE_first_fit_from(next_fit_page, count);
+	if(cur == 0) cur = TREE_first_fit(count);
+	return cur;
+}
+
+// marks count pages at the free run that starts at the given leaf as allocated (tree only)
+void TREE_set_allocated(uint32 cur, uint32 count){
+	uint32 free_pages = get_free_value(cur);
 
 	update_node(cur, count, 1);
 	for(int i = 1; i < count; i++)
@@ -133,9 +274,61 @@ void* TREE_alloc_FF(uint32 count){
 	if(free_pages > count)
 		update_node(cur + count, free_pages - count, 0);
 
+	next_fit_page = cur - PAGES_COUNT + count;
+	update_pages_in_use(count);
+}
+
+// allocates count pages at the free run that starts at the given leaf
+void* TREE_alloc_at(uint32 cur, uint32 count){
+	uint32 page_idx = cur - PAGES_COUNT;
+
+	void* va = (void*)(page_allocator_start + page_idx * PAGE_SIZE);
+	int ecode = allocate_and_map_pages((uint32)va, (uint32)va + count * PAGE_SIZE);
+
+	if(ecode == 0) return NULL;
+
+	TREE_set_allocated(cur, count);
+
 	return va;
 }
 
+void* TREE_alloc_FF(uint32 count){
+
+	if(get_free_value(1) < count) return NULL;
+
+	return TREE_alloc_at(TREE_first_fit(count), count);
+}
+
+// leaf that starts a free run of at least count pages chosen by the current kernel heap placement strategy (0 if none)
+uint32 TREE_find(uint32 count){
+
+	if(count == 0 || get_free_value(1) < count) return 0;
+
+	uint32 cur = 0;
+	if(isKHeapPlacementStrategyFIRSTFIT())
+		cur = TREE_first_fit(count);
+	else if(isKHeapPlacementStrategyBESTFIT())
+		cur = TREE_best_fit(count);
+	else if(isKHeapPlacementStrategyWORSTFIT())
+		cur = TREE_worst_fit(count);
+	else if(isKHeapPlacementStrategyNEXTFIT())
+		cur = TREE_next_fit(count);
+	else if(isKHeapPlacementStrategyCONTALLOC())
+		cur = TREE_first_fit_from(next_fit_page, count); // never goes back to reuse freed space
+
+	return cur;
+}
+
+// allocates count pages using the current kernel heap placement strategy
+void* TREE_alloc(uint32 count){
+
+	uint32 cur = TREE_find(count);
+
+	if(cur == 0) return NULL;
+
+	return TREE_alloc_at(cur, count);
+}
+
 bool TREE_free(uint32 page_idx){
 
 	uint32 cur = TREE_get_node(page_idx);
@@ -146,10 +339,19 @@ bool TREE_free(uint32 page_idx){
 
 	if(count == 0) return 0; // is not a start of an allocation
 
-	uint32 va = page_allocator_start + page_idx * PAGE_SIZE, *ptr_page_table;
+	uint32 va = page_allocator_start + page_idx * PAGE_SIZE;
 
 	free_and_unmap_pages(va, count);
 
+	TREE_set_free(cur, count);
+
+	return 1;
+}
+
+// marks the count pages allocated at the given leaf as free & merges them with the adjacent free runs (tree only)
+void TREE_set_free(uint32 cur, uint32 count){
+	uint32 page_idx = cur - PAGES_COUNT;
+	update_pages_in_use(-(int32)count);
 
 	for(int i = 0; i < count; i++)
 		set_info(cur + i, 0, 0);
@@ -164,22 +366,37 @@ bool TREE_free(uint32 page_idx){
 		update_node(cur, count, 0);
 	}
 	else{
-		int levels = 0, cur_node = cur;
+		uint32 cur_node = TREE_run_start(cur - 1);
+		update_node(cur_node, count + get_free_value(cur_node), 0);
+	}
+}
 
-		while(get_value(cur_node) == 0)
-			cur_node >>= 1, levels++;
+// moves a page allocation to a new place of new_count pages: the existing frames are
+// remapped to the new range (no copy) and only the extra pages get new frames
+void* TREE_relocate(uint32 page_idx, uint32 new_count){
+	uint32 cur = TREE_get_node(page_idx);
+	uint32 old_count = get_value(cur);
+	uint32 copy_count = (old_count < new_count) ? old_count : new_count;
 
-		while(levels--){
-			if(get_value(cur_node << 1 | 1) > 0)
-				cur_node = cur_node << 1 | 1;
-			else
-				cur_node = cur_node << 1;
-		}
+	uint32 new_cur = TREE_find(new_count);
+	if(new_cur == 0) return NULL;
 
-		update_node(cur_node, count + get_free_value(cur_node), 0);
-	}
+	uint32 old_va = page_allocator_start + page_idx * PAGE_SIZE;
+	uint32 new_va = page_allocator_start + (new_cur - PAGES_COUNT) * PAGE_SIZE;
 
-	return 1;
+	if(copy_count < new_count &&
+			!allocate_and_map_pages(new_va + copy_count * PAGE_SIZE, new_va + new_count * PAGE_SIZE))
+		return NULL;
+
+	TREE_set_allocated(new_cur, new_count);
+
+	move_mapped_pages(old_va, new_va, copy_count);
+	if(copy_count < old_count)
+		free_and_unmap_pages(old_va + copy_count * PAGE_SIZE, old_count - copy_count);
+
+	TREE_set_free(cur, old_count);
+
+	return (void*)new_va;
 }
 
 void* TREE_realloc(uint32 page_idx, uint32 new_size){
@@ -194,8 +411,46 @@ void* TREE_realloc(uint32 page_idx, uint32 new_size){
 	uint32 nxt = cur + old_count;
 	uint32 next_count = get_free_value(nxt);
 
-	if(old_count + next_count < new_count) // relocate
-		return relocate((void*)(page_allocator_start + page_idx * PAGE_SIZE), old_count * PAGE_SIZE, new_size);
+	if(old_count + next_count < new_count){
+		uint32 prv = (page_idx == 0 || is_allocated(cur - 1)) ? 0 : TREE_run_start(cur - 1);
+		uint32 prev_count = (prv == 0) ? 0 : get_free_value(prv);
+
+		if(prev_count + old_count + next_count < new_count) // relocate
+			return TREE_relocate(page_idx, new_count);
+
+		// expand backward: take all of the next free run & the needed tail of the previous one
+		uint32 shift = new_count - old_count - next_count;
+		uint32 new_cur = cur - shift;
+		uint32 old_va = page_allocator_start + page_idx * PAGE_SIZE;
+		uint32 new_va = old_va - shift * PAGE_SIZE;
+
+		// slide the block down first, then map the pages left at its end
+		move_mapped_pages(old_va, new_va, old_count);
+
+		if(!allocate_and_map_pages(new_va + old_count * PAGE_SIZE, new_va + new_count * PAGE_SIZE)){
+			move_mapped_pages(new_va, old_va, old_count);
+			return NULL;
+		}
+
+		if(next_count > 0)
+			update_node(nxt, 0, 0);
+		update_node(prv, 0, 0);
+		if(prev_count > shift)
+			update_node(prv, prev_count - shift, 0);
+		update_node(new_cur, new_count, 1);
+		for(int i = 1; i < new_count; i++)
+			set_info(new_cur + i, 0, 1);
+
+		update_pages_in_use(new_count - old_count);
+		return (void*)new_va;
+	}
+
+	// map the new pages before taking them from the next free run, so it stays in the tree if there are no frames
+	if(new_count > old_count){
+		uint32 va = page_allocator_start + (page_idx + old_count) * PAGE_SIZE;
+		if(!allocate_and_map_pages(va, va + (new_count - old_count) * PAGE_SIZE))
+			return NULL;
+	}
 
 	if(!is_allocated(nxt))
 		update_node(nxt, 0, 0);
@@ -210,16 +465,12 @@ void* TREE_realloc(uint32 page_idx, uint32 new_size){
 
 	}
 	else{ // expand
-		uint32 va = page_allocator_start + (page_idx + old_count) * PAGE_SIZE, *ptr_page_table;
-
-		if(!allocate_and_map_pages(va, va + (page_idx + new_count) * PAGE_SIZE))
-			return NULL;
-
 		for(int i = old_count; i < new_count; i++)
 			set_info(cur + i, 0, 1);
 	}
 
 	set_info(cur, new_count, 1);
+	update_pages_in_use((int32)new_count - (int32)old_count);
 
 	if(old_count + next_count - new_count > 0)
 		update_node(cur + new_count, old_count + next_count - new_count, 0);
@@ -268,8 +519,6 @@ int initialize_kheap_dynamic_allocator(uint32 daStart, uint32 initSizeToAllocate
     segment_break = daStart + initSizeToAllocate;
     Hard_Limit = daLimit;
 
-    memset(virtual_address_directory, -1, sizeof virtual_address_directory);
-
     int result = allocate_and_map_pages(daStart, segment_break);
 
     if(result == 0)
@@ -280,19 +529,81 @@ int initialize_kheap_dynamic_allocator(uint32 daStart, uint32 initSizeToAllocate
     acquire_kernel_lock();
 
     page_allocator_start = Hard_Limit + PAGE_SIZE;
-    update_node(TREE_get_node(0), (KERNEL_HEAP_MAX - page_allocator_start) / PAGE_SIZE, 0);
+    uint32 pages = (KERNEL_HEAP_MAX - page_allocator_start) / PAGE_SIZE;
+
+    size_tree = NULL;
+    memset(info_tree, 0, sizeof info_tree);
+    update_node(TREE_get_node(0), pages, 0);
+    next_fit_page = 0;
 
     release_kernel_lock();
 
     return 0;
 }
 
+//Allocate the best fit index (from the page allocator itself) & fill it with the current free runs,
+//or give its pages back. Called when the placement strategy changes, so FIRST FIT doesn't pay for it
+void kheap_fit_index_enable(bool enabled)
+{
+	if(page_allocator_start == 0) return; // the kernel heap is not initialized
+	if(enabled == (size_tree != NULL)) return;
+
+	acquire_kernel_lock();
+
+	uint32 pages = (KERNEL_HEAP_MAX - page_allocator_start) / PAGE_SIZE;
+	if(enabled){
+		//take the last pages of the page allocator, away from where the allocations start
+		uint32 count = KHEAP_FIT_INDEX_SIZE(pages) / PAGE_SIZE;
+		uint32 cur = TREE_run_start(TREE_get_node(pages - 1));
+		uint32 run = (cur != 0 ? get_free_value(cur) : 0);
+		uint32 page_idx = (cur != 0 ? cur - PAGES_COUNT + run - count : 0);
+		uint32* index = (uint32*)(page_allocator_start + page_idx * PAGE_SIZE);
+
+		if(cur == 0 || cur - PAGES_COUNT + run != pages || run < count ||
+				!allocate_and_map_pages((uint32)index, (uint32)index + count * PAGE_SIZE)){
+			cprintf("kheap: no memory for the best fit index, first fit is used instead\n");
+			release_kernel_lock();
+			return;
+		}
+		if(run > count){
+			update_node(cur, run - count, 0);
+			update_node(TREE_get_node(page_idx), count, 0);
+		}
+		uint32 saved_next_fit_page = next_fit_page;
+		TREE_set_allocated(TREE_get_node(page_idx), count);
+		next_fit_page = saved_next_fit_page;
+
+		SIZES_COUNT = CEIL_POWER_OF_2(pages + 1);
+		run_head = index + 2 * SIZES_COUNT;
+		run_next = run_head + SIZES_COUNT;
+		run_prev = run_next + pages;
+		memset(index, 0, 2 * SIZES_COUNT * sizeof(uint32));
+		memset(run_head, -1, SIZES_COUNT * sizeof(uint32));
+		size_tree = index;
+
+		for(uint32 leaf = TREE_first_fit_from(0, 1); leaf != 0; ){
+			uint32 run_page = leaf - PAGES_COUNT, size = get_free_value(leaf);
+			add_free_run(run_page, size);
+			if(run_page + size >= pages) break;
+			leaf = TREE_first_fit_from(run_page + size, 1);
+		}
+	}
+	else{
+		uint32* index = size_tree;
+		size_tree = NULL;
+		TREE_free(address_to_page(index));
+	}
+
+	release_kernel_lock();
+}
+
 void* sbrk(int numOfPages)
 {
 	/* numOfPages > 0: move the segment break of the kernel to increase the size of its heap by the given numOfPages,
 	 * 				you should allocate pages and map them into the kernel virtual address space,
 	 * 				and returns the address of the previous break (i.e. the beginning of newly mapped memory).
 	 * numOfPages = 0: just return the current position of the segment break
+	 * numOfPages < 0: move the segment break back by -numOfPages & unmap their pages (trim_mapped_region)
 	 *
 	 * NOTES:
 	 * 	1) Allocating additional pages for a kernel dynamic allocator will fail if the free frames are exhausted
@@ -304,6 +615,15 @@ void* sbrk(int numOfPages)
 	if(numOfPages== 0)
 		return (void*)segment_break;
 
+	if(numOfPages < 0){
+		uint32 released_size = -numOfPages * PAGE_SIZE;
+		if(segment_break - released_size < Kernel_Heap_start)
+			return (void*)-1;
+		segment_break -= released_size;
+		free_and_unmap_pages(segment_break, -numOfPages);
+		return (void*)old_segment_break;
+	}
+
 	if(segment_break + added_size > Hard_Limit)
 		return (void*)-1;
 
@@ -321,30 +641,244 @@ void* sbrk(int numOfPages)
 	return (void*)old_segment_break;
 }
 
-void* kmalloc(unsigned int size)
+//=================================================================================//
+//============================ PER-CPU MAGAZINES ==================================//
+//=================================================================================//
+//Small blocks (<= KMAG_MAX_SIZE) are cached per CPU, so that most kmalloc/kfree of
+//small sizes complete with interrupts disabled on the current CPU only, without taking
+//the kernel lock. Empty/full magazines are refilled/flushed by KMAG_BATCH blocks.
+//Blocks inside magazines remain ALLOCATED from the block allocator's point of view.
+
+static inline int kmag_alloc_class(uint32 size)
 {
-	acquire_kernel_lock();
+	if(size <= KMAG_MIN_SIZE) return 0;
+	return MST(size - 1) + 1 - MST(KMAG_MIN_SIZE);
+}
+
+//only blocks of exactly a class size are cached (any other block would waste its extra bytes
+//for as long as it stays in the magazine)
+static inline int kmag_free_class(uint32 block_payload)
+{
+	if(block_payload < KMAG_MIN_SIZE || block_payload > KMAG_MAX_SIZE) return -1;
+	int cls = MST(block_payload) - MST(KMAG_MIN_SIZE);
+	return (block_payload == (KMAG_MIN_SIZE << cls)) ? cls : -1;
+}
+
+//bumped on memory pressure: each CPU gives back all its cached blocks on its next kmalloc/kfree
+//(the request may come with the frames lock held, so the flush itself is not done there)
+static volatile uint32 kmag_flush_gen = 0;
 
-	if(size <= DYN_ALLOC_MAX_BLOCK_SIZE){
-		void* va = alloc_block_FF(size);
+void kmag_request_flush(void)
+{
+	kmag_flush_gen++;
+}
+
+static void kmag_flush_if_requested(void)
+{
+	void* batch[KMAG_NUM_CLASSES * KMAG_CAPACITY];
+	int count = 0;
+
+	pushcli();
+	struct cpu* c = mycpu();
+	if(c->kmag_flush_gen != kmag_flush_gen){
+		c->kmag_flush_gen = kmag_flush_gen;
+		for(int cls = 0; cls < KMAG_NUM_CLASSES; cls++)
+			while(c->kmags[cls].rounds > 0)
+				batch[count++] = c->kmags[cls].blocks[--c->kmags[cls].rounds];
+	}
+	popcli();
+
+	if(count > 0){
+		acquire_kernel_lock();
+		while(count > 0)
+			free_block(batch[--count]);
 		release_kernel_lock();
+	}
+}
+
+void* kmag_alloc(uint32 size)
+{
+	kmag_flush_if_requested();
+
+	int cls = kmag_alloc_class(size);
+	uint32 class_size = KMAG_MIN_SIZE << cls;
+
+	pushcli();
+	struct kmem_magazine* mag = &(mycpu()->kmags[cls]);
+	if(mag->rounds > 0){
+		void* va = mag->blocks[--mag->rounds];
+		popcli();
 		return va;
 	}
+	popcli();
 
-	uint32 pages_count = ROUNDUP(size, PAGE_SIZE) / PAGE_SIZE;
+	//refill: take a batch from the block allocator under a single lock acquisition
+	void* batch[KMAG_BATCH];
+	int count = 0;
+	acquire_kernel_lock();
+	while(count < KMAG_BATCH && (batch[count] = alloc_block_FF(class_size)) != NULL)
+		count++;
+	release_kernel_lock();
 
-	if(isKHeapPlacementStrategyFIRSTFIT()){
-		void* va = TREE_alloc_FF(pages_count);
+	if(count == 0) return NULL;
+
+	pushcli();
+	mag = &(mycpu()->kmags[cls]);
+	while(count > 1 && mag->rounds < KMAG_CAPACITY)
+		mag->blocks[mag->rounds++] = batch[--count];
+	popcli();
+
+	//the magazine was refilled meanwhile: give back what does not fit
+	if(count > 1){
+		acquire_kernel_lock();
+		while(count > 1)
+			free_block(batch[--count]);
+		release_kernel_lock();
+	}
+	return batch[0];
+}
+
+//Returns 1 if the block is cached in a magazine, 0 if it should be freed by the caller
+bool kmag_free(void* va)
+{
+	kmag_flush_if_requested();
+
+	int cls = kmag_free_class(get_block_size(va) - ALLOC_META_DATA_SIZE);
+	if(cls < 0) return 0;
+
+	void* batch[KMAG_BATCH];
+	int count = 0;
+
+	pushcli();
+	struct kmem_magazine* mag = &(mycpu()->kmags[cls]);
+	if(mag->rounds == KMAG_CAPACITY){
+		//flush: move a batch out of the magazine to make room
+		while(count < KMAG_BATCH)
+			batch[count++] = mag->blocks[--mag->rounds];
+	}
+	mag->blocks[mag->rounds++] = va;
+	popcli();
+
+	if(count > 0){
+		acquire_kernel_lock();
+		while(count > 0)
+			free_block(batch[--count]);
 		release_kernel_lock();
-		return va;
 	}
+	return 1;
+}
+
+//=================================
+// MEDIUM OBJECTS:
+//=================================
+//spans of the medium objects allocator are page allocations (called with the kernel lock held)
+void* medium_span_alloc(uint32 pages)
+{
+	return TREE_alloc_FF(pages);
+}
+
+void medium_span_free(void* va)
+{
+	TREE_free(address_to_page(va));
+}
+
+//medium objects live inside the spans: any address in an allocated page that is not the start of a page allocation
+bool is_medium_object(void* virtual_address)
+{
+	uint32 va = (uint32)virtual_address;
+	if(va < page_allocator_start || va >= KERNEL_HEAP_MAX) return 0;
+
+	uint32 cur = TREE_get_node(address_to_page(virtual_address));
+	return is_allocated(cur) && (va % PAGE_SIZE != 0 || get_value(cur) == 0);
+}
+
+//=================================
+// KERNEL HEAP STATISTICS:
+//=================================
+static inline uint32 kheap_stat_class(uint32 size)
+{
+	if(size <= 16) return 0;
+	uint32 cls = MST(size - 1) - 3;
+	return (cls < KHEAP_STAT_CLASSES) ? cls : KHEAP_STAT_CLASSES - 1;
+}
+
+//usable size of a live allocation (block payload, medium object or pages)
+uint32 kheap_allocation_size(void* virtual_address)
+{
+	if((uint32)virtual_address <= segment_break-(DYN_ALLOC_MIN_BLOCK_SIZE+META_DATA_SIZE/2))
+		return get_block_size(virtual_address) - ALLOC_META_DATA_SIZE;
+	if(is_medium_object(virtual_address))
+		return medium_object_size(virtual_address);
+	return get_value(TREE_get_node(address_to_page(virtual_address))) * PAGE_SIZE;
+}
+
+//the counters are per-CPU so that the magazine paths need no lock to update them
+static inline void kheap_count_alloc(void* virtual_address)
+{
+	pushcli();
+	struct kheap_cpu_stats* stats = &(mycpu()->kheap_stats);
+	if(virtual_address == NULL)
+		stats->failed_allocs++;
+	else
+		stats->allocs[kheap_stat_class(kheap_allocation_size(virtual_address))]++;
+	popcli();
+}
+
+static inline void kheap_count_free(uint32 size)
+{
+	pushcli();
+	mycpu()->kheap_stats.frees[kheap_stat_class(size)]++;
+	popcli();
+}
+
+void* kmalloc(unsigned int size)
+{
+	void* va;
+
+	if(size == 0) return NULL;
 
+	if(size <= KMAG_MAX_SIZE)
+		va = kmag_alloc(size);
+	else{
+		acquire_kernel_lock();
+
+		if(size <= DYN_ALLOC_MAX_BLOCK_SIZE)
+			va = alloc_block_FF(size);
+		else if(medium_objects_enabled() && medium_class(size) >= 0)
+			va = medium_alloc(size);
+		else
+			va = TREE_alloc(ROUNDUP(size, PAGE_SIZE) / PAGE_SIZE);
+
+		release_kernel_lock();
+	}
+
+	kheap_count_alloc(va);
+	return va;
+}
+
+//Allocate whole pages from the page allocator, never shared with other objects
+//(e.g. to change their permissions), freed by kfree
+void* kmalloc_pages(unsigned int size)
+{
+	if(size == 0) return NULL;
+
+	acquire_kernel_lock();
+	void* va = TREE_alloc(ROUNDUP(size, PAGE_SIZE) / PAGE_SIZE);
 	release_kernel_lock();
-	return NULL;
+
+	kheap_count_alloc(va);
+	return va;
 }
 
 void kfree(void* virtual_address)
 {
+	if((uint32)virtual_address <= segment_break-(DYN_ALLOC_MIN_BLOCK_SIZE+META_DATA_SIZE/2) &&
+			virtual_address != NULL && !is_free_block(virtual_address)){
+		kheap_count_free(get_block_size(virtual_address) - ALLOC_META_DATA_SIZE);
+		if(kmag_free(virtual_address))
+			return;
+	}
+
 	acquire_kernel_lock();
 
 	if((uint32)virtual_address <= segment_break-(DYN_ALLOC_MIN_BLOCK_SIZE+META_DATA_SIZE/2)){
@@ -353,18 +887,31 @@ void kfree(void* virtual_address)
 		return;
 	}
 
+	if(is_medium_object(virtual_address)){
+		kheap_count_free(medium_object_size(virtual_address));
+		medium_free(virtual_address);
+		release_kernel_lock();
+		return;
+	}
+
 	if(!is_valid_kheap_address((uint32)virtual_address)){
 		release_kernel_lock();
 		panic("Invalid address given\n");
 		return;
 	}
 
+	uint32 size = kheap_allocation_size(virtual_address);
+	bool was_allocated = is_allocated(TREE_get_node(address_to_page(virtual_address)));
+
 	if(!TREE_free(address_to_page(virtual_address))){
 		release_kernel_lock();
 		panic("Address given is not the start of the allocated space\n");
 		return;
 	}
 
+	if(was_allocated)
+		kheap_count_free(size);
+
 	release_kernel_lock();
 }
 
@@ -397,8 +944,8 @@ unsigned int kheap_virtual_address(unsigned int physical_address)
 	uint32 frame = (physical_address >> 12);
 	uint32 address = 0;
 
-	if(virtual_address_directory[frame] != -1)
-		address = (virtual_address_directory[frame] << 12)|(physical_address & 0x00000FFF);
+	if(frame < number_of_frames && frames_info[frame].kheapPage != 0)
+		address = (KERNEL_HEAP_START + (frames_info[frame].kheapPage - 1) * PAGE_SIZE)|(physical_address & 0x00000FFF);
 
 	release_kernel_lock();
 	return address;
@@ -427,7 +974,10 @@ void *krealloc(void *virtual_address, uint32 new_size)
 	}
 
 	if((uint32)virtual_address <= segment_break-(DYN_ALLOC_MIN_BLOCK_SIZE + META_DATA_SIZE / 2) && new_size <= DYN_ALLOC_MAX_BLOCK_SIZE){ // handled in block allocator
+		kheap_count_free(kheap_allocation_size(virtual_address));
 		void* va = realloc_block_FF(virtual_address, new_size);
+		if(new_size > 0)
+			kheap_count_alloc(va);
 		release_kernel_lock();
 		return va;
 	}
@@ -439,7 +989,19 @@ void *krealloc(void *virtual_address, uint32 new_size)
 	}
 
 	if((uint32)virtual_address <= Hard_Limit){ // relocate from block allocator -> page allocator
-		void* va = relocate(virtual_address, get_block_size(virtual_address) - META_DATA_SIZE, new_size);
+		void* va = relocate(virtual_address, get_block_size(virtual_address) - ALLOC_META_DATA_SIZE, new_size);
+		release_kernel_lock();
+		return va;
+	}
+
+	if(is_medium_object(virtual_address)){ // keep it if the new size has the same class, else move it
+		uint32 old_size = medium_object_size(virtual_address);
+		int cls = medium_class(new_size);
+		if(cls >= 0 && medium_class_size(cls) == old_size){
+			release_kernel_lock();
+			return virtual_address;
+		}
+		void* va = relocate(virtual_address, (old_size < new_size) ? old_size : new_size, new_size);
 		release_kernel_lock();
 		return va;
 	}
@@ -449,13 +1011,19 @@ void *krealloc(void *virtual_address, uint32 new_size)
 		return NULL;
 	}
 
-	if(new_size <= DYN_ALLOC_MAX_BLOCK_SIZE){ // relocate from page allocator -> block allocator
-		void* va = relocate(virtual_address, new_size, new_size);
+	if(new_size <= DYN_ALLOC_MAX_BLOCK_SIZE ||
+			(medium_objects_enabled() && medium_class(new_size) >= 0)){ // relocate from page allocator -> block/medium allocator
+		uint32 old_size = kheap_allocation_size(virtual_address);
+		void* va = relocate(virtual_address, (old_size < new_size) ? old_size : new_size, new_size);
 		release_kernel_lock();
 		return va;
 	}
 
+	uint32 old_size = kheap_allocation_size(virtual_address);
 	void* va = TREE_realloc(address_to_page(virtual_address), new_size);
+	if(va != NULL)
+		kheap_count_free(old_size);
+	kheap_count_alloc(va);
 	release_kernel_lock();
 	return va;
 }
@@ -21,11 +21,14 @@ uint32 _KHeapPlacementStrategy;
 #define KHP_PLACE_NEXTFIT 	0x3
 #define KHP_PLACE_WORSTFIT 	0x4
 
-static inline void setKHeapPlacementStrategyCONTALLOC(){_KHeapPlacementStrategy = KHP_PLACE_CONTALLOC;}
-static inline void setKHeapPlacementStrategyFIRSTFIT(){_KHeapPlacementStrategy = KHP_PLACE_FIRSTFIT;}
-static inline void setKHeapPlacementStrategyBESTFIT(){_KHeapPlacementStrategy = KHP_PLACE_BESTFIT;}
-static inline void setKHeapPlacementStrategyNEXTFIT(){_KHeapPlacementStrategy = KHP_PLACE_NEXTFIT;}
-static inline void setKHeapPlacementStrategyWORSTFIT(){_KHeapPlacementStrategy = KHP_PLACE_WORSTFIT;}
+//the runs-by-size index is only kept (& its pages allocated) while BEST FIT is selected
+void kheap_fit_index_enable(bool enabled);
+
+static inline void setKHeapPlacementStrategyCONTALLOC(){_KHeapPlacementStrategy = KHP_PLACE_CONTALLOC; kheap_fit_index_enable(0);}
+static inline void setKHeapPlacementStrategyFIRSTFIT(){_KHeapPlacementStrategy = KHP_PLACE_FIRSTFIT; kheap_fit_index_enable(0);}
+static inline void setKHeapPlacementStrategyBESTFIT(){_KHeapPlacementStrategy = KHP_PLACE_BESTFIT; kheap_fit_index_enable(1);}
+static inline void setKHeapPlacementStrategyNEXTFIT(){_KHeapPlacementStrategy = KHP_PLACE_NEXTFIT; kheap_fit_index_enable(0);}
+static inline void setKHeapPlacementStrategyWORSTFIT(){_KHeapPlacementStrategy = KHP_PLACE_WORSTFIT; kheap_fit_index_enable(0);}
 
 static inline uint8 isKHeapPlacementStrategyCONTALLOC(){if(_KHeapPlacementStrategy == KHP_PLACE_CONTALLOC) return 1; return 0;}
 static inline uint8 isKHeapPlacementStrategyFIRSTFIT(){if(_KHeapPlacementStrategy == KHP_PLACE_FIRSTFIT) return 1; return 0;}
@@ -36,6 +39,7 @@ static inline uint8 isKHeapPlacementStrategyWORSTFIT(){if(_KHeapPlacementStrateg
 //***********************************
 
 void* kmalloc(unsigned int size);
+void* kmalloc_pages(unsigned int size);
 void kfree(void* virtual_address);
 void *krealloc(void *virtual_address, unsigned int new_size);
 
@@ -50,15 +54,28 @@ uint32 Kernel_Heap_start;
 uint32 segment_break;
 uint32 Hard_Limit;
 
+//Pages of the page allocator in use (the block allocator keeps its own counters,
+//the per-CPU kmalloc/kfree counters are in struct cpu), printed by the kheapstat command
+uint32 kheap_pages_in_use;
+uint32 kheap_peak_pages_in_use;
+
 
 #define MST(X) (31 - __builtin_clz(X))
 #define CEIL_POWER_OF_2(X) ((1 << MST((X))) * (1 + (((X) & ((X)-1)) > 0)))
 
 #define KHEAP_PAGES_COUNT (CEIL_POWER_OF_2(NUM_OF_KHEAP_PAGES + 2))
+//Bytes taken from a page allocator of the given number of pages by its best fit index:
+//a segment tree over the run sizes, the first run of each size & the links between the runs of a size
+#define KHEAP_FIT_INDEX_SIZE(pages) \
+	(((3 * CEIL_POWER_OF_2((pages) + 1) + 2 * (pages)) * sizeof(uint32) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE)
 #define ALLOC_FLAG ((uint32)1 << 31)
 #define VAL_MASK (((uint32)1 << 31)-1)
 
+uint32 kheap_allocation_size(void* virtual_address);
+void kmag_request_flush(void);
+bool is_medium_object(void* virtual_address);
 void free_and_unmap_pages(uint32 start_address, uint32 frame_count);
+void move_mapped_pages(uint32 src_address, uint32 dst_address, uint32 pages_count);
 int allocate_and_map_pages(uint32 start_address, uint32 end_address);
 inline bool is_valid_kheap_address(uint32 virtual_address);
 inline uint32 address_to_page(void* virtual_address);
@@ -70,8 +87,19 @@ inline uint32 get_value(uint32 cur);
 inline void update_node(uint32 cur, uint32 val, bool isAllocated);
 uint32 TREE_get_node(uint32 page_idx);
 uint32 TREE_first_fit(uint32 count);
+uint32 TREE_first_fit_from(uint32 page_idx, uint32 count);
+uint32 TREE_run_start(uint32 cur);
+uint32 TREE_best_fit(uint32 count);
+uint32 TREE_worst_fit(uint32 count);
+uint32 TREE_next_fit(uint32 count);
+uint32 TREE_find(uint32 count);
+void TREE_set_allocated(uint32 cur, uint32 count);
+void TREE_set_free(uint32 cur, uint32 count);
+void* TREE_alloc_at(uint32 cur, uint32 count);
 void* TREE_alloc_FF(uint32 count);
+void* TREE_alloc(uint32 count);
 bool TREE_free(uint32 page_idx);
+void* TREE_relocate(uint32 page_idx, uint32 new_count);
 void* TREE_realloc(uint32 page_idx, uint32 new_count);
 inline void acquire_kernel_lock();
 inline void release_kernel_lock();
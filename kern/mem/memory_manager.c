@@ -10,6 +10,7 @@ FUNCTIONS:	to_physical_address, get_frame_info, tlb_invalidate
  */
 
 #include "memory_manager.h"
+#include "rmap.h"
 
 #include <inc/x86.h>
 #include <inc/mmu.h>
@@ -24,6 +25,7 @@ FUNCTIONS:	to_physical_address, get_frame_info, tlb_invalidate
 #include <kern/cpu/cpu.h>
 #include <kern/cpu/sched.h>
 #include <kern/disk/pagefile_manager.h>
+#include <kern/trap/fault_handler.h>
 #include "kheap.h"
 
 
@@ -167,6 +169,10 @@ int allocate_frame(struct FrameInfo **ptr_frame_info)
 
 	LIST_REMOVE(&MemFrameLists.free_frame_list,*ptr_frame_info);
 
+	//free frames just became scarce: ask the user heaps to give back what they can
+	if (LIST_SIZE(&MemFrameLists.free_frame_list) == (memory_scarce_threshold_percentage * number_of_frames) / 100)
+		signal_memory_pressure();
+
 	/******************* PAGE BUFFERING CODE *******************
 	 ***********************************************************/
 	if((*ptr_frame_info)->isBuffered)
@@ -213,6 +219,275 @@ void free_frame(struct FrameInfo *ptr_frame_info)
 	}
 }
 
+//
+// Allocates "count" frames into frames[] taking the free frame list lock only once.
+//
+// RETURNS
+//   0 -- on success
+//   E_NO_MEM -- if the free frames run out before "count" are allocated
+//		(the frames allocated so far are given back, so frames[] holds none)
+//
+int allocate_frames(uint32 count, struct FrameInfo **frames)
+{
+	bool lock_already_held = holding_spinlock(&MemFrameLists.mfllock);
+
+	if (!lock_already_held)
+	{
+		acquire_spinlock(&MemFrameLists.mfllock);
+	}
+
+	int ret = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (LIST_SIZE(&MemFrameLists.free_frame_list) == 0)
+		{
+			while (i > 0)
+				free_frame(frames[--i]);
+			ret = E_NO_MEM;
+			break;
+		}
+		allocate_frame(&frames[i]);
+	}
+
+	if (!lock_already_held)
+	{
+		release_spinlock(&MemFrameLists.mfllock);
+	}
+
+	return ret;
+}
+
+//
+// Returns "count" frames to the free_frame_list taking its lock only once.
+//
+void free_frames(struct FrameInfo **frames, uint32 count)
+{
+	bool lock_already_held = holding_spinlock(&MemFrameLists.mfllock);
+
+	if (!lock_already_held)
+	{
+		acquire_spinlock(&MemFrameLists.mfllock);
+	}
+
+	for (int i = 0; i < count; i++)
+		free_frame(frames[i]);
+
+	if (!lock_already_held)
+	{
+		release_spinlock(&MemFrameLists.mfllock);
+	}
+}
+
+//==================================================================================
+// PAGE BUFFERING:
+//==================================================================================
+// An evicted user page keeps its frame (& its contents) while the frame waits on:
+//	- the tail of the free frame list (so it's reused last) if the page is clean
+//	- the modified frame list if it's dirty, until the list is written to the page file
+//	  in a batch of getModifiedBufferLength() frames and moved to the free frame list
+// Its PTE keeps the frame address with PERM_BUFFERED instead of PERM_PRESENT (and PERM_MODIFIED
+// while it's on the modified list), so a fault on it takes the frame back without any disk I/O.
+// allocate_frame() clears that PTE when it reuses the frame for something else.
+//
+// The modified frames are written with the free frame list lock released: a batch is taken off the
+// modified list (isBuffered = BUFFER_WRITING, their disk frames held), written, then moved to the
+// free frame list under the lock again. Meanwhile, reclaim_buffered_page() can still take such a frame
+// back, while unbuffer_page()/drop_writing_frames() only mark it BUFFER_DROPPED for the flush to free it.
+
+#define FLUSH_BATCH_SIZE 32
+
+//the batch being written by flush_modified_frames() (one flush at a time) & the disk frames held for it
+static struct FrameInfo* writing_frames[FLUSH_BATCH_SIZE];
+static uint32 writing_dfns[FLUSH_BATCH_SIZE];
+static uint32 writing_count = 0;
+
+// write all the frames of the modified list to the page file & move them to the free frame list
+void flush_modified_frames()
+{
+	bool lock_already_held = holding_spinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+		acquire_spinlock(&MemFrameLists.mfllock);
+
+	//if another flush is writing its batch, it takes the rest of the list when it's done
+	while (writing_count == 0 && LIST_SIZE(&MemFrameLists.modified_frame_list) > 0)
+	{
+		//[1] take a batch off the modified list
+		struct FrameInfo* ptr_frame_info;
+		while (writing_count < FLUSH_BATCH_SIZE &&
+				(ptr_frame_info = LIST_FIRST(&MemFrameLists.modified_frame_list)) != NULL)
+		{
+			LIST_REMOVE(&MemFrameLists.modified_frame_list, ptr_frame_info);
+			ptr_frame_info->isBuffered = BUFFER_WRITING;
+			writing_dfns[writing_count] = pf_hold_env_page_dfn(ptr_frame_info->proc, ptr_frame_info->bufferedVA);
+			writing_frames[writing_count++] = ptr_frame_info;
+		}
+
+		//[2] write it (through PGFLTEMP of the current address space)
+		if (!lock_already_held)
+			release_spinlock(&MemFrameLists.mfllock);
+
+		struct Env* cur_env = get_cpu_proc();
+		uint32* ptr_cur_directory = (cur_env != NULL) ? cur_env->env_page_directory : ptr_page_directory;
+		for (int i = 0; i < writing_count; i++)
+			pf_write_held_dfn(ptr_cur_directory, writing_dfns[i], writing_frames[i]);
+
+		if (!lock_already_held)
+			acquire_spinlock(&MemFrameLists.mfllock);
+
+		//[3] the frames that are still buffered are clean now
+		for (int i = 0; i < writing_count; i++)
+		{
+			ptr_frame_info = writing_frames[i];
+			if (ptr_frame_info->isBuffered == BUFFER_WRITING)
+			{
+				pt_set_page_permissions(ptr_frame_info->proc->env_page_directory, ptr_frame_info->bufferedVA, 0, PERM_MODIFIED);
+				ptr_frame_info->isBuffered = 1;
+				LIST_INSERT_TAIL(&MemFrameLists.free_frame_list, ptr_frame_info);
+			}
+			else if (ptr_frame_info->isBuffered == BUFFER_DROPPED)
+				free_frame(ptr_frame_info);
+			else if (ptr_frame_info->isBuffered == 0 && ptr_frame_info->references == 0)
+				free_frame(ptr_frame_info);		//taken back & unmapped while its write held it
+			pf_release_dfn(writing_dfns[i]);
+		}
+		writing_count = 0;
+	}
+
+	if (!lock_already_held)
+		release_spinlock(&MemFrameLists.mfllock);
+}
+
+// forget the frames of env "e" that are being written (called with the free frame list lock held
+// when "e" leaves), they are freed by the flush when their write is done
+void drop_writing_frames(struct Env* e)
+{
+	for (int i = 0; i < writing_count; i++)
+	{
+		struct FrameInfo* ptr_frame_info = writing_frames[i];
+		if (ptr_frame_info->isBuffered == BUFFER_WRITING && ptr_frame_info->proc == e)
+		{
+			pt_clear_page_table_entry(e->env_page_directory, ptr_frame_info->bufferedVA);
+			ptr_frame_info->isBuffered = BUFFER_DROPPED;
+		}
+	}
+}
+
+// evict the page at virtual_address of env "e" (should be mapped) but keep its frame buffered
+// RETURNS: 0 if the page can't be buffered (its frame is shared), so it should be evicted normally
+bool buffer_page(struct Env* e, uint32 virtual_address)
+{
+	uint32* ptr_page_table;
+	struct FrameInfo* ptr_frame_info = get_frame_info(e->env_page_directory, virtual_address, &ptr_page_table);
+	if (ptr_frame_info == NULL || ptr_frame_info->references != 1)
+		return 0;
+
+	bool lock_already_held = holding_spinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+		acquire_spinlock(&MemFrameLists.mfllock);
+
+	uint32 page_table_entry = ptr_page_table[PTX(virtual_address)];
+	ptr_page_table[PTX(virtual_address)] = (page_table_entry & ~PERM_PRESENT) | PERM_BUFFERED;
+	tlb_invalidate(e->env_page_directory, (void *)virtual_address);
+
+	ptr_frame_info->references = 0;
+	ptr_frame_info->ws_ptr = NULL;
+	ptr_frame_info->proc = e;
+	ptr_frame_info->bufferedVA = virtual_address;
+	ptr_frame_info->isBuffered = 1;
+
+	//without the modified buffer, a dirty page is written right away
+	bool flush = 0;
+	if (page_table_entry & PERM_MODIFIED)
+	{
+		LIST_INSERT_TAIL(&MemFrameLists.modified_frame_list, ptr_frame_info);
+		flush = !isModifiedBufferEnabled() ||
+				LIST_SIZE(&MemFrameLists.modified_frame_list) >= getModifiedBufferLength();
+	}
+	else
+		LIST_INSERT_TAIL(&MemFrameLists.free_frame_list, ptr_frame_info);
+
+	if (!lock_already_held)
+		release_spinlock(&MemFrameLists.mfllock);
+
+	//(after the lock is released, so that the flush can release it while writing)
+	if (flush)
+		flush_modified_frames();
+	return 1;
+}
+
+// take back the frame of the page at virtual_address of env "e" if it's buffered, and map it again
+// RETURNS: the frame, or NULL if the page is not buffered
+struct FrameInfo* reclaim_buffered_page(struct Env* e, uint32 virtual_address)
+{
+	uint32* ptr_page_table;
+	get_page_table(e->env_page_directory, virtual_address, &ptr_page_table);
+	if (ptr_page_table == NULL || !(ptr_page_table[PTX(virtual_address)] & PERM_BUFFERED))
+		return NULL;
+
+	bool lock_already_held = holding_spinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+		acquire_spinlock(&MemFrameLists.mfllock);
+
+	uint32 page_table_entry = ptr_page_table[PTX(virtual_address)];
+	struct FrameInfo* ptr_frame_info = to_frame_info(EXTRACT_ADDRESS(page_table_entry));
+	//(a frame being written by a flush is on no list, & is temporarily referenced by its write)
+	if (ptr_frame_info->isBuffered != BUFFER_WRITING)
+	{
+		if (page_table_entry & PERM_MODIFIED)
+			LIST_REMOVE(&MemFrameLists.modified_frame_list, ptr_frame_info);
+		else
+			LIST_REMOVE(&MemFrameLists.free_frame_list, ptr_frame_info);
+	}
+
+	ptr_frame_info->isBuffered = 0;
+	ptr_frame_info->proc = NULL;
+	ptr_frame_info->bufferedVA = 0;
+	ptr_frame_info->references++;
+	ptr_page_table[PTX(virtual_address)] = (page_table_entry & ~PERM_BUFFERED) | PERM_PRESENT;
+
+	if (!lock_already_held)
+		release_spinlock(&MemFrameLists.mfllock);
+	return ptr_frame_info;
+}
+
+// drop the buffered page at virtual_address of env "e" (if any): its frame becomes a normal free frame
+void unbuffer_page(struct Env* e, uint32 virtual_address)
+{
+	uint32* ptr_page_table;
+	get_page_table(e->env_page_directory, virtual_address, &ptr_page_table);
+	if (ptr_page_table == NULL || !(ptr_page_table[PTX(virtual_address)] & PERM_BUFFERED))
+		return;
+
+	bool lock_already_held = holding_spinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+		acquire_spinlock(&MemFrameLists.mfllock);
+
+	uint32 page_table_entry = ptr_page_table[PTX(virtual_address)];
+	struct FrameInfo* ptr_frame_info = to_frame_info(EXTRACT_ADDRESS(page_table_entry));
+	if (ptr_frame_info->isBuffered == BUFFER_WRITING)
+	{
+		//freed by the flush that is writing it
+		ptr_frame_info->isBuffered = BUFFER_DROPPED;
+	}
+	else if (page_table_entry & PERM_MODIFIED)
+	{
+		LIST_REMOVE(&MemFrameLists.modified_frame_list, ptr_frame_info);
+		free_frame(ptr_frame_info);
+	}
+	else
+	{
+		//already on the free frame list
+		ptr_frame_info->isBuffered = 0;
+		ptr_frame_info->proc = NULL;
+		ptr_frame_info->bufferedVA = 0;
+	}
+	ptr_page_table[PTX(virtual_address)] = page_table_entry & PERM_AVAILABLE & ~PERM_BUFFERED;
+	tlb_invalidate(e->env_page_directory, (void *)virtual_address);
+
+	if (!lock_already_held)
+		release_spinlock(&MemFrameLists.mfllock);
+}
+
 //
 // Decrement the reference count on a frame
 // freeing it if there are no more references.
@@ -391,6 +666,8 @@ int map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_info, uint
 			unmap_frame(ptr_page_directory , virtual_address);
 	}
 	ptr_frame_info->references++;
+	if (ptr_frame_info->rmap != NULL)
+		rmap_add(ptr_frame_info, ptr_page_directory, virtual_address);
 
 	/*********************************************************************************/
 	/*NEW'23 el7:)
@@ -459,6 +736,8 @@ void unmap_frame(uint32 *ptr_page_directory, uint32 virtual_address)
 	{
 		if (ptr_frame_info->isBuffered && !CHECK_IF_KERNEL_ADDRESS((uint32)virtual_address))
 			cprintf("WARNING: Freeing BUFFERED frame at va %x!!!\n", virtual_address) ;
+		if (ptr_frame_info->rmap != NULL)
+			rmap_remove(ptr_frame_info, ptr_page_directory, virtual_address);
 		decrement_references(ptr_frame_info);
 
 		/*********************************************************************************/
@@ -472,6 +751,91 @@ void unmap_frame(uint32 *ptr_page_directory, uint32 virtual_address)
 	}
 }
 
+//
+// Maps frames[0 .. count-1] at the consecutive pages starting at 'virtual_address'
+// with the same semantics as calling map_frame() on each page, except that the page
+// table is looked up (or created) once per table instead of once per page.
+//
+// RETURNS:
+//   0 on success
+//
+int map_range(uint32 *ptr_page_directory, struct FrameInfo **frames, uint32 virtual_address, uint32 count, int perm)
+{
+	uint32 *ptr_page_table = NULL;
+	for (int i = 0; i < count; i++, virtual_address += PAGE_SIZE)
+	{
+		if (ptr_page_table == NULL || PTX(virtual_address) == 0)
+		{
+			if (get_page_table(ptr_page_directory, virtual_address, &ptr_page_table) == TABLE_NOT_EXIST)
+			{
+#if USE_KHEAP
+				ptr_page_table = create_page_table(ptr_page_directory, virtual_address);
+#else
+				__static_cpt(ptr_page_directory, virtual_address, &ptr_page_table);
+#endif
+			}
+		}
+
+		uint32 physical_address = to_physical_address(frames[i]);
+		uint32 page_table_entry = ptr_page_table[PTX(virtual_address)];
+		if ((page_table_entry & PERM_PRESENT) == PERM_PRESENT)
+		{
+			if (EXTRACT_ADDRESS(page_table_entry) == physical_address)
+				continue;
+			unmap_frame(ptr_page_directory, virtual_address);
+		}
+		frames[i]->references++;
+
+		uint32 pte_available_bits = ptr_page_table[PTX(virtual_address)] & PERM_AVAILABLE;
+		ptr_page_table[PTX(virtual_address)] = CONSTRUCT_ENTRY(physical_address, pte_available_bits | perm | PERM_PRESENT);
+	}
+	return 0;
+}
+
+//
+// Unmaps the "count" consecutive pages starting at 'virtual_address' with the same
+// semantics as calling unmap_frame() on each page, but the page table is looked up
+// once per table and the free frame list lock is taken once per table.
+//
+void unmap_range(uint32 *ptr_page_directory, uint32 virtual_address, uint32 count)
+{
+	while (count > 0)
+	{
+		uint32 in_table = NPTENTRIES - PTX(virtual_address);
+		if (in_table > count)
+			in_table = count;
+
+		uint32 *ptr_page_table;
+		get_page_table(ptr_page_directory, virtual_address, &ptr_page_table);
+		if (ptr_page_table != NULL)
+		{
+			bool lock_already_held = holding_spinlock(&MemFrameLists.mfllock);
+			if (!lock_already_held)
+				acquire_spinlock(&MemFrameLists.mfllock);
+
+			for (uint32 va = virtual_address; va < virtual_address + in_table * PAGE_SIZE; va += PAGE_SIZE)
+			{
+				uint32 page_table_entry = ptr_page_table[PTX(va)];
+				if ((page_table_entry & ~0xFFF) == 0)
+					continue;
+
+				struct FrameInfo* ptr_frame_info = to_frame_info(EXTRACT_ADDRESS(page_table_entry));
+				if (ptr_frame_info->isBuffered && !CHECK_IF_KERNEL_ADDRESS(va))
+					cprintf("WARNING: Freeing BUFFERED frame at va %x!!!\n", va) ;
+				decrement_references(ptr_frame_info);
+
+				ptr_page_table[PTX(va)] = page_table_entry & PERM_AVAILABLE;
+				tlb_invalidate(ptr_page_directory, (void *)va);
+			}
+
+			if (!lock_already_held)
+				release_spinlock(&MemFrameLists.mfllock);
+		}
+
+		virtual_address += in_table * PAGE_SIZE;
+		count -= in_table;
+	}
+}
 
 /*/this function should be called only in the env_create() for creating the page table if not exist
  * (without causing page fault as the normal map_frame())*/
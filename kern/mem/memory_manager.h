@@ -61,14 +61,30 @@ struct freeFramesCounters
 //RUN TIME [USER SPACE]
 int allocate_frame(struct FrameInfo **ptr_frame_info);
 void free_frame(struct FrameInfo *ptr_frame_info);
+int allocate_frames(uint32 count, struct FrameInfo **frames);
+void free_frames(struct FrameInfo **frames, uint32 count);
 int	map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_info, uint32 virtual_address, int perm);
 void unmap_frame(uint32 *pgdir, uint32 virtual_address);
+int map_range(uint32 *ptr_page_directory, struct FrameInfo **frames, uint32 virtual_address, uint32 count, int perm);
+void unmap_range(uint32 *ptr_page_directory, uint32 virtual_address, uint32 count);
 int get_page_table(uint32 *ptr_page_directory, const uint32 virtual_address, uint32 **ptr_page_table);
 /*2016*/ void * create_page_table(uint32 *ptr_page_directory, const uint32 virtual_address);
 struct FrameInfo *get_frame_info(uint32 *ptr_page_directory, uint32 virtual_address, uint32 **ptr_page_table);
 void decrement_references(struct FrameInfo* ptr_frame_info);
 void initialize_frame_info(struct FrameInfo *ptr_frame_info);
 
+//PAGE BUFFERING
+//isBuffered of a dirty buffered frame while flush_modified_frames() writes it (it's on no frame list),
+//& after its page is dropped meanwhile (the flush frees it)
+#define BUFFER_WRITING	2
+#define BUFFER_DROPPED	3
+struct Env;
+bool buffer_page(struct Env* e, uint32 virtual_address);
+struct FrameInfo* reclaim_buffered_page(struct Env* e, uint32 virtual_address);
+void unbuffer_page(struct Env* e, uint32 virtual_address);
+void flush_modified_frames();
+void drop_writing_frames(struct Env* e);
+
 static inline uint32 to_frame_number(struct FrameInfo *ptr_frame_info)
 {
 	return ptr_frame_info - frames_info;
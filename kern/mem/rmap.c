@@ -0,0 +1,118 @@
+/*
+ * rmap.c
+ *
+ *  Reverse maps of the frames of shared objects: all the (page directory, VA) mapping each frame
+ */
+
+#include "rmap.h"
+
+#include <inc/error.h>
+#include <inc/assert.h>
+#include <inc/mmu.h>
+#include "slab.h"
+#include "memory_manager.h"
+
+struct kmem_cache* rmap_cache;
+struct kmem_cache* rmap_entry_cache;
+
+//===========================
+// [0] INITIALIZE REVERSE MAPS:
+//===========================
+void rmap_init()
+{
+	rmap_cache = kmem_cache_create("reverse maps", sizeof(struct frame_rmap), NULL);
+	rmap_entry_cache = kmem_cache_create("reverse map entries", sizeof(struct rmap_entry), NULL);
+}
+
+//===========================
+// [1] ATTACH/DETACH:
+//===========================
+//Give the frame holding the given page of a share a reverse map (before it's mapped by any env)
+void rmap_attach(struct FrameInfo* ptr_frame_info, struct Share* share, uint32 page)
+{
+	struct frame_rmap* rmap = kmem_cache_alloc(rmap_cache);
+	if (rmap == NULL)
+		panic("rmap_attach: no memory for the reverse map of a shared frame");
+	rmap->share = share;
+	rmap->page = page;
+	rmap->sweeps_counter = 0;
+	rmap->mappings = NULL;
+	ptr_frame_info->rmap = rmap;
+}
+
+//Remove the reverse map of the frame (after it's unmapped from all the envs)
+void rmap_detach(struct FrameInfo* ptr_frame_info)
+{
+	struct frame_rmap* rmap = ptr_frame_info->rmap;
+	if (rmap == NULL)
+		return;
+	assert(rmap->mappings == NULL);
+	kmem_cache_free(rmap_cache, rmap);
+	ptr_frame_info->rmap = NULL;
+}
+
+//===========================
+// [2] ADD/REMOVE MAPPINGS:
+//===========================
+void rmap_add(struct FrameInfo* ptr_frame_info, uint32* pgdir, uint32 virtual_address)
+{
+	struct rmap_entry* entry = kmem_cache_alloc(rmap_entry_cache);
+	if (entry == NULL)
+		panic("rmap_add: no memory for the reverse map entry of a shared frame");
+	entry->pgdir = pgdir;
+	entry->virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	entry->next = ptr_frame_info->rmap->mappings;
+	ptr_frame_info->rmap->mappings = entry;
+}
+
+void rmap_remove(struct FrameInfo* ptr_frame_info, uint32* pgdir, uint32 virtual_address)
+{
+	virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	struct rmap_entry** ptr_entry = &(ptr_frame_info->rmap->mappings);
+	for (; *ptr_entry != NULL; ptr_entry = &((*ptr_entry)->next))
+	{
+		struct rmap_entry* entry = *ptr_entry;
+		if (entry->pgdir == pgdir && entry->virtual_address == virtual_address)
+		{
+			*ptr_entry = entry->next;
+			kmem_cache_free(rmap_entry_cache, entry);
+			return;
+		}
+	}
+}
+
+//===========================
+// [3] ALL THE MAPPINGS:
+//===========================
+//Return the permissions of all the mappings of the frame OR'ed together
+//(e.g. PERM_USED if any of its sharers has used it since it was last cleared)
+uint32 rmap_get_permissions(struct FrameInfo* ptr_frame_info)
+{
+	uint32 permissions = 0;
+	for (struct rmap_entry* entry = ptr_frame_info->rmap->mappings; entry != NULL; entry = entry->next)
+		permissions |= pt_get_page_permissions(entry->pgdir, entry->virtual_address);
+	return permissions;
+}
+
+void rmap_clear_permissions(struct FrameInfo* ptr_frame_info, uint32 permissions_to_clear)
+{
+	for (struct rmap_entry* entry = ptr_frame_info->rmap->mappings; entry != NULL; entry = entry->next)
+		pt_set_page_permissions(entry->pgdir, entry->virtual_address, 0, permissions_to_clear);
+}
+
+//Unmap the frame from all the envs mapping it, leaving the given (available) bits in their page table entries
+void rmap_unmap_all(struct FrameInfo* ptr_frame_info, uint32 permissions_to_leave)
+{
+	while (ptr_frame_info->rmap->mappings != NULL)
+	{
+		uint32* pgdir = ptr_frame_info->rmap->mappings->pgdir;
+		uint32 virtual_address = ptr_frame_info->rmap->mappings->virtual_address;
+
+		//removes the entry from the chain
+		unmap_frame(pgdir, virtual_address);
+
+		uint32* ptr_page_table;
+		get_page_table(pgdir, virtual_address, &ptr_page_table);
+		ptr_page_table[PTX(virtual_address)] |= permissions_to_leave;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef FOS_KERN_RMAP_H_
+#define FOS_KERN_RMAP_H_
+
+#ifndef FOS_KERNEL
+# error "This is a FOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+//==================================================================================//
+//=========================== REVERSE MAPS OF SHARED FRAMES =========================//
+//==================================================================================//
+/* A frame of a shared object is mapped by every env that gets the share, so it has no single
+ * owner (FrameInfo.proc/ws_ptr) to be found by the page replacement. Instead, it keeps a reverse
+ * map: the share & page it holds + a chain of all its (page directory, VA) mappings.
+ *	- the chain is maintained by map_frame()/unmap_frame() for the frames having a reverse map
+ *	- it lets the global replacement check & clear the used bits of all the sharers of a frame,
+ *	  and unmap it from all of them at once when it's evicted (see share_evict_page())
+ * Private & copy-on-write frames have no reverse map (FrameInfo.rmap == NULL).
+ */
+
+struct Share;
+
+struct rmap_entry
+{
+	uint32* pgdir;				//page directory of the env mapping the frame
+	uint32 virtual_address;		//page aligned
+	struct rmap_entry* next;
+};
+
+struct frame_rmap
+{
+	struct Share* share;		//shared object holding the frame
+	uint32 page;				//index of the frame in the framesStorage of the share
+	uint32 sweeps_counter;		//for the global Nth chance clock
+	struct rmap_entry* mappings;
+};
+
+void rmap_init();
+void rmap_attach(struct FrameInfo* ptr_frame_info, struct Share* share, uint32 page);
+void rmap_detach(struct FrameInfo* ptr_frame_info);
+void rmap_add(struct FrameInfo* ptr_frame_info, uint32* pgdir, uint32 virtual_address);
+void rmap_remove(struct FrameInfo* ptr_frame_info, uint32* pgdir, uint32 virtual_address);
+uint32 rmap_get_permissions(struct FrameInfo* ptr_frame_info);
+void rmap_clear_permissions(struct FrameInfo* ptr_frame_info, uint32 permissions_to_clear);
+void rmap_unmap_all(struct FrameInfo* ptr_frame_info, uint32 permissions_to_leave);
+
+//Caches of the reverse maps & their entries (created by rmap_init)
+extern struct kmem_cache* rmap_cache;
+extern struct kmem_cache* rmap_entry_cache;
+
+#endif // FOS_KERN_RMAP_H_
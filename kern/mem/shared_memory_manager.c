@@ -12,12 +12,17 @@
 #include <kern/trap/syscall.h>
 #include "kheap.h"
 #include "memory_manager.h"
+#include "slab.h"
+#include "rmap.h"
+#include <kern/disk/pagefile_manager.h>
 
 //==================================================================================//
 //============================== GIVEN FUNCTIONS ===================================//
 //==================================================================================//
 struct Share* get_share(int32 ownerID, char* name);
 
+struct kmem_cache* share_cache;
+
 //===========================
 // [1] INITIALIZE SHARES:
 //===========================
@@ -27,6 +32,7 @@ void sharing_init()
 #if USE_KHEAP
 	LIST_INIT(&AllShares.shares_list) ;
 	init_spinlock(&AllShares.shareslock, "shares lock");
+	share_cache = kmem_cache_create("shares", sizeof(struct Share), NULL);
 #else
 	panic("not handled when KERN HEAP is disabled");
 #endif
@@ -106,7 +112,7 @@ struct Share* create_share(int32 ownerID, char* shareName, uint32 size, uint8 is
 
 	int noFrames = ROUNDUP(size,PAGE_SIZE)/PAGE_SIZE;
 
-	struct Share* nShare = kmalloc(sizeof(struct Share)); //allocation of the shared object;
+	struct Share* nShare = kmem_cache_alloc(share_cache); //allocation of the shared object;
 
 	if (nShare == NULL) {
 		   cprintf("Memory allocation for share failed.\n");
@@ -128,9 +134,17 @@ struct Share* create_share(int32 ownerID, char* shareName, uint32 size, uint8 is
 	nShare->framesStorage = create_frames_storage(noFrames); //array of the frames allocated for
 															 // this shared object
 	if(nShare->framesStorage == NULL){
-		kfree((void*)nShare);
+		kmem_cache_free(share_cache, (void*)nShare);
+		return NULL;
+	}
+
+	nShare->diskFrames = kmalloc(noFrames * sizeof(uint32));
+	if(nShare->diskFrames == NULL){
+		kfree((void*)nShare->framesStorage);
+		kmem_cache_free(share_cache, (void*)nShare);
 		return NULL;
 	}
+	memset(nShare->diskFrames, 0, noFrames * sizeof(uint32));
 	return nShare;
 }
 
@@ -200,6 +214,11 @@ int createSharedObject(int32 ownerID, char* shareName, uint32 size, uint8 isWrit
 
 		allocate_frame(&Frame);
 
+		//the framesStorage holds a reference on the frame, so it stays with the share till it's evicted or
+		//the share is freed, and the reverse map records all the envs mapping it
+		Frame->references++;
+		rmap_attach(Frame, ret, i);
+
 		map_frame(myenv->env_page_directory, Frame, current_page, permissions);
 
 		ret->framesStorage[i] = Frame;
@@ -254,7 +273,7 @@ int getSharedObject(int32 ownerID, char* shareName, void* virtual_address)
     uint32 current_page = (uint32)virtual_address;
 
 	for(int i=0;i<noFrames;i++){
-		map_frame(myenv->env_page_directory , shared_object->framesStorage[i] , current_page , permissions);
+		share_map_page(shared_object, i, myenv->env_page_directory, current_page, permissions);
 
 		current_page += PAGE_SIZE;
 	}
@@ -288,8 +307,20 @@ void free_share(struct Share* ptrShare)
 	if (holding_spinlock(&AllShares.shareslock))
 		release_spinlock(&AllShares.shareslock);
 
+	//all the envs have unmapped it: its frames & disk frames are only held by the share
+	uint32 frames_count = ROUNDUP(ptrShare->size , PAGE_SIZE) / PAGE_SIZE;
+	for(int i = 0; i < frames_count; i++) {
+		struct FrameInfo* Frame = ptrShare->framesStorage[i];
+		if(Frame != NULL) {
+			rmap_detach(Frame);
+			decrement_references(Frame);
+		}
+		pf_remove_share_page(ptrShare->diskFrames[i]);
+	}
+
+	kfree((void*)ptrShare->diskFrames);
 	kfree((void*)ptrShare->framesStorage);
-	kfree((void*)ptrShare);
+	kmem_cache_free(share_cache, (void*)ptrShare);
 }
 //========================
 // [B2] Free Share Object:
@@ -326,11 +357,12 @@ int freeSharedObject(int32 sharedObjectID, void *startVA)
 	for(int i = 0; i < frames_count; i++) {
 		get_page_table(myenv->env_page_directory , current_page , &ptr_page_table);
 		unmap_frame(myenv->env_page_directory , current_page);
+		ptr_page_table[PTX(current_page)] &= ~PERM_SHARE_OUT;
 		bool flag = 1;
 		uint32* table = ptr_page_table;
 
 		for(int i = 0; i < PAGE_SIZE / 4; i++) {
-			if(table[i] & PERM_PRESENT) {
+			if(table[i] & (PERM_PRESENT | PERM_SHARE_OUT)) {
 				flag = 0;
 				break;
 			}
@@ -356,3 +388,106 @@ int freeSharedObject(int32 sharedObjectID, void *startVA)
 	return 0;
 
 }
+
+//==================================================================================//
+//=========================== SHARED PAGES REPLACEMENT =============================//
+//==================================================================================//
+
+static struct Share* get_share_by_id(int32 sharedObjectID)
+{
+	struct Share* share;
+	acquire_spinlock(&AllShares.shareslock);
+	LIST_FOREACH(share, &AllShares.shares_list)
+		if(share->ID == sharedObjectID)
+			break;
+	release_spinlock(&AllShares.shareslock);
+	return share;
+}
+
+//=========================
+// [1] Map a Share Page:
+//=========================
+//Map the given page of the share at virtual_address: its frame if it's in memory, else the page is left
+//PERM_SHARE_OUT to be faulted back on its 1st access (see share_page_fault())
+int share_map_page(struct Share* share, uint32 page, uint32* ptr_page_directory, uint32 virtual_address, uint32 perm)
+{
+	if(share->framesStorage[page] != NULL)
+		return map_frame(ptr_page_directory, share->framesStorage[page], virtual_address, perm);
+
+	unmap_frame(ptr_page_directory, virtual_address);
+	uint32* ptr_page_table;
+	if(get_page_table(ptr_page_directory, virtual_address, &ptr_page_table) == TABLE_NOT_EXIST)
+		ptr_page_table = create_page_table(ptr_page_directory, virtual_address);
+	if(ptr_page_table == NULL)
+		return E_NO_MEM;
+	ptr_page_table[PTX(virtual_address)] |= PERM_SHARE_OUT;
+	return 0;
+}
+
+//==========================
+// [2] Evict a Share Page:
+//==========================
+//Take the frame of a share page out of memory: it's written once to the disk frame of the share
+//(if it's modified by any of its sharers or never written before), unmapped from all the envs
+//sharing it (found by its reverse map) and freed
+//Return 0 on success, or E_NO_PAGE_FILE_SPACE
+int share_evict_page(struct FrameInfo* ptr_frame_info)
+{
+	struct Share* share = ptr_frame_info->rmap->share;
+	uint32 page = ptr_frame_info->rmap->page;
+
+	if(share->diskFrames[page] == 0 || (rmap_get_permissions(ptr_frame_info) & PERM_MODIFIED))
+	{
+		int ret = pf_write_share_page(get_cpu_proc(), &(share->diskFrames[page]), ptr_frame_info);
+		if(ret != 0)
+			return ret;
+	}
+
+	rmap_unmap_all(ptr_frame_info, PERM_SHARE_OUT);
+	share->framesStorage[page] = NULL;
+	rmap_detach(ptr_frame_info);
+	decrement_references(ptr_frame_info);
+	return 0;
+}
+
+//============================
+// [3] Fault a Share Page In:
+//============================
+//Map the (evicted) share page at virtual_address of env e, reading its frame back from the disk frame
+//of the share unless another sharer already did
+//Return 0 on success, or E_NO_SHARE if virtual_address isn't in any share of e
+int share_page_fault(struct Env* e, uint32 virtual_address)
+{
+	virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	uint32 shares_start = e->uheap_hard_limit + PAGE_SIZE;
+	if(virtual_address < shares_start || virtual_address >= USER_HEAP_MAX)
+		return E_NO_SHARE;
+
+	//the share is recorded in the shared_id_directory at the page of its start
+	int i = (virtual_address - shares_start) / PAGE_SIZE;
+	while(i >= 0 && e->shared_id_directory[i] == -1)
+		i--;
+	if(i < 0)
+		return E_NO_SHARE;
+	struct Share* share = get_share_by_id(e->shared_id_directory[i]);
+	uint32 start = shares_start + i * PAGE_SIZE;
+	if(share == NULL || virtual_address >= start + ROUNDUP(share->size, PAGE_SIZE))
+		return E_NO_SHARE;
+	uint32 page = (virtual_address - start) / PAGE_SIZE;
+
+	if(share->framesStorage[page] == NULL)
+	{
+		struct FrameInfo* Frame;
+		allocate_frame(&Frame);
+		Frame->references++;
+		pf_read_share_page(e, share->diskFrames[page], Frame);
+		rmap_attach(Frame, share, page);
+		share->framesStorage[page] = Frame;
+	}
+
+	uint32 permissions = PERM_USER;
+	if(share->isWritable)
+		permissions |= PERM_WRITEABLE;
+	pt_set_page_permissions(e->env_page_directory, virtual_address, 0, PERM_SHARE_OUT);
+	return map_frame(e->env_page_directory, share->framesStorage[page], virtual_address, permissions);
+}
@@ -28,8 +28,10 @@ struct Share
 	//sharing permissions (0: ReadOnly, 1:Writable)
 	uint8 isWritable;
 
-	//to store frames to be shared
+	//to store frames to be shared (NULL for an evicted page)
 	struct FrameInfo** framesStorage;
+	//disk frames of the pages in the page file (0 for a page never written back)
+	uint32* diskFrames;
 
 	// list link pointers
 	LIST_ENTRY(Share) prev_next_info;
@@ -59,6 +61,9 @@ int getSharedObject(int32 ownerID, char* shareName, void* virtual_address);
 void free_share(struct Share* ptrShare);
 int freeSharedObject(int32 sharedObjectID, void *startVA);
 struct Share* get_share(int32 ownerID, char* name);
+int share_map_page(struct Share* share, uint32 page, uint32* ptr_page_directory, uint32 virtual_address, uint32 perm);
+int share_evict_page(struct FrameInfo* ptr_frame_info);
+int share_page_fault(struct Env* e, uint32 virtual_address);
 int createSharedObject(int32 ownerID, char* shareName, uint32 size, uint8 isWritable, void* virtual_address);
 
 
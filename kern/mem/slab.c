@@ -0,0 +1,164 @@
+/*
+ * slab.c
+ *
+ *  Object caches for the fixed-size kernel objects
+ */
+
+#include "slab.h"
+
+#include <inc/memlayout.h>
+#include <inc/environment_definitions.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include "kheap.h"
+
+#define KMEM_SLAB_HEADER_SIZE	ROUNDUP(sizeof(struct kmem_slab), 8)
+#define KMEM_SLOT_LINK(cache, obj) (*(void**)((char*)(obj) + (cache)->slot_size - sizeof(void*)))
+
+struct kmem_cache kmem_caches[KMEM_MAX_CACHES];
+uint32 kmem_caches_count;
+
+//===========================
+// [1] CREATE CACHE:
+//===========================
+//obj_size should fit in a slab page next to its header
+//The cache descriptor is static, so caches can be created before the kernel heap is initialized
+struct kmem_cache* kmem_cache_create(char* name, uint32 obj_size, void (*ctor)(void*))
+{
+	if (kmem_caches_count >= KMEM_MAX_CACHES)
+		panic("kmem_cache_create: no more caches can be created");
+
+	struct kmem_cache* cache = &kmem_caches[kmem_caches_count++];
+	memset(cache, 0, sizeof(struct kmem_cache));
+	strlcpy(cache->name, name, KMEM_CACHE_NAMELEN);
+	cache->obj_size = obj_size;
+	cache->ctor = ctor;
+	cache->max_free_slabs = KMEM_MAX_FREE_SLABS;
+
+	cache->slot_size = ROUNDUP(obj_size, sizeof(void*)) + sizeof(void*);
+	if (obj_size == 0 || cache->slot_size > PAGE_SIZE - KMEM_SLAB_HEADER_SIZE)
+		panic("kmem_cache_create: invalid object size %d for cache %s", obj_size, name);
+	cache->objs_per_slab = (PAGE_SIZE - KMEM_SLAB_HEADER_SIZE) / cache->slot_size;
+
+	LIST_INIT(&cache->partial_slabs);
+	LIST_INIT(&cache->full_slabs);
+	init_spinlock(&cache->lock, cache->name);
+
+	return cache;
+}
+
+//===========================
+// [2] GROW CACHE:
+//===========================
+//Allocate a new slab page from the kernel heap & construct all of its objects
+//Should be called WITHOUT holding the cache lock (kmalloc may sleep on the kernel lock)
+static struct kmem_slab* kmem_slab_create(struct kmem_cache* cache)
+{
+	struct kmem_slab* slab = (struct kmem_slab*)kmalloc(PAGE_SIZE);
+	if (slab == NULL)
+		return NULL;
+
+	slab->cache = cache;
+	slab->inuse = 0;
+	slab->free_objs = NULL;
+
+	char* first_obj = (char*)slab + KMEM_SLAB_HEADER_SIZE;
+	for (int i = cache->objs_per_slab - 1; i >= 0; i--)
+	{
+		void* obj = first_obj + i * cache->slot_size;
+		if (cache->ctor != NULL)
+			cache->ctor(obj);
+		KMEM_SLOT_LINK(cache, obj) = slab->free_objs;
+		slab->free_objs = obj;
+	}
+	return slab;
+}
+
+//===========================
+// [3] ALLOCATE OBJECT:
+//===========================
+//Return a constructed object of the given cache, or NULL if the kernel heap is exhausted
+void* kmem_cache_alloc(struct kmem_cache* cache)
+{
+	acquire_spinlock(&cache->lock);
+
+	struct kmem_slab* slab = LIST_FIRST(&cache->partial_slabs);
+	if (slab == NULL)
+	{
+		release_spinlock(&cache->lock);
+		slab = kmem_slab_create(cache);
+		if (slab == NULL)
+			return NULL;
+		acquire_spinlock(&cache->lock);
+		LIST_INSERT_HEAD(&cache->partial_slabs, slab);
+		cache->total_objs += cache->objs_per_slab;
+	}
+	else if (slab->inuse == 0)
+		cache->num_free_slabs--;
+
+	void* obj = slab->free_objs;
+	slab->free_objs = KMEM_SLOT_LINK(cache, obj);
+	slab->inuse++;
+	cache->active_objs++;
+
+	if (slab->free_objs == NULL)
+	{
+		LIST_REMOVE(&cache->partial_slabs, slab);
+		LIST_INSERT_HEAD(&cache->full_slabs, slab);
+	}
+
+	release_spinlock(&cache->lock);
+	return obj;
+}
+
+//Return the object to its slab while holding the cache lock
+//If this leaves more than max_free_slabs free slabs, the free slab page is
+//unlinked from the cache and returned, so that the caller kfree()s it after unlocking
+static void* kmem_cache_free_locked(struct kmem_cache* cache, void* obj)
+{
+	cache->active_objs--;
+
+	struct kmem_slab* slab = (struct kmem_slab*)ROUNDDOWN((uint32)obj, PAGE_SIZE);
+	assert(slab->cache == cache);
+
+	if (slab->free_objs == NULL)
+	{
+		LIST_REMOVE(&cache->full_slabs, slab);
+		LIST_INSERT_HEAD(&cache->partial_slabs, slab);
+	}
+	KMEM_SLOT_LINK(cache, obj) = slab->free_objs;
+	slab->free_objs = obj;
+	slab->inuse--;
+
+	if (slab->inuse > 0)
+		return NULL;
+
+	if (cache->num_free_slabs >= cache->max_free_slabs)
+	{
+		LIST_REMOVE(&cache->partial_slabs, slab);
+		cache->total_objs -= cache->objs_per_slab;
+		return slab;
+	}
+	//keep the free slab at the tail so partially used slabs are filled first
+	LIST_REMOVE(&cache->partial_slabs, slab);
+	LIST_INSERT_TAIL(&cache->partial_slabs, slab);
+	cache->num_free_slabs++;
+	return NULL;
+}
+
+//===========================
+// [4] FREE OBJECT:
+//===========================
+//The object should be returned in its constructed state
+void kmem_cache_free(struct kmem_cache* cache, void* obj)
+{
+	if (obj == NULL)
+		return;
+
+	acquire_spinlock(&cache->lock);
+	void* page_to_release = kmem_cache_free_locked(cache, obj);
+	release_spinlock(&cache->lock);
+
+	if (page_to_release != NULL)
+		kfree(page_to_release);
+}
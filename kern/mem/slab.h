@@ -0,0 +1,62 @@
+#ifndef FOS_KERN_SLAB_H_
+#define FOS_KERN_SLAB_H_
+
+#ifndef FOS_KERNEL
+# error "This is a FOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/queue.h>
+#include <inc/stdio.h>
+#include <kern/conc/spinlock.h>
+
+//==================================================================================//
+//============================== OBJECT CACHES (SLABS) =============================//
+//==================================================================================//
+/* Fixed-size kernel objects (shares, VM areas, reverse maps, ...) are served from
+ * per-type caches instead of the block allocator:
+ *	- each slab is one kernel heap page holding a header followed by equal-size slots
+ *	- each slot is the object followed by one link word that chains the free slots => O(1) alloc/free
+ *	- the owning slab of an object is found by rounding its address down to the page
+ * Objects are returned to the cache in their constructed state, so the constructor
+ * (if any) runs once when the slab is created, not on every allocation.
+ */
+
+#define KMEM_MAX_CACHES			16
+#define KMEM_CACHE_NAMELEN		32
+//default max number of completely free slabs a cache keeps before giving them back to the kernel heap
+#define KMEM_MAX_FREE_SLABS		8
+
+struct kmem_slab
+{
+	struct kmem_cache* cache;
+	void* free_objs;			//free objects of this slab, chained through their link words
+	uint32 inuse;				//number of allocated objects in this slab
+	LIST_ENTRY(kmem_slab) prev_next_info;
+};
+
+LIST_HEAD(kmem_slab_List, kmem_slab);
+
+struct kmem_cache
+{
+	char name[KMEM_CACHE_NAMELEN];
+	uint32 obj_size;
+	uint32 slot_size;						//obj_size + link word (rounded to 4 bytes)
+	uint32 objs_per_slab;
+	void (*ctor)(void* obj);
+
+	struct kmem_slab_List partial_slabs;	//slabs with at least one free object
+	struct kmem_slab_List full_slabs;		//slabs with no free objects
+	uint32 num_free_slabs;					//completely free slabs kept by the cache
+	uint32 max_free_slabs;					//free slabs beyond this are kfree'd (KMEM_MAX_FREE_SLABS by default)
+
+	uint32 active_objs;
+	uint32 total_objs;
+	struct spinlock lock;
+};
+
+struct kmem_cache* kmem_cache_create(char* name, uint32 obj_size, void (*ctor)(void*));
+void* kmem_cache_alloc(struct kmem_cache* cache);
+void kmem_cache_free(struct kmem_cache* cache, void* obj);
+
+#endif // FOS_KERN_SLAB_H_
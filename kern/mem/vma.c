@@ -0,0 +1,290 @@
+/*
+ * vma.c
+ *
+ *  Reserved areas of the user heap, kept in a balanced (AVL) tree per env
+ */
+
+#include "vma.h"
+
+#include <inc/error.h>
+#include <inc/assert.h>
+#include "slab.h"
+
+struct kmem_cache* vma_cache;
+
+//===========================
+// [0] INITIALIZE AREAS:
+//===========================
+void vma_init()
+{
+	vma_cache = kmem_cache_create("VM areas", sizeof(struct vm_area), NULL);
+}
+
+//===========================
+// [1] AVL HELPERS:
+//===========================
+static inline int8 vma_height(struct vm_area* area)
+{
+	return area ? area->height : 0;
+}
+
+static inline void vma_update_height(struct vm_area* area)
+{
+	area->height = 1 + MAX(vma_height(area->left), vma_height(area->right));
+}
+
+static struct vm_area* vma_rotate_right(struct vm_area* area)
+{
+	struct vm_area* root = area->left;
+	area->left = root->right;
+	root->right = area;
+	vma_update_height(area);
+	vma_update_height(root);
+	return root;
+}
+
+static struct vm_area* vma_rotate_left(struct vm_area* area)
+{
+	struct vm_area* root = area->right;
+	area->right = root->left;
+	root->left = area;
+	vma_update_height(area);
+	vma_update_height(root);
+	return root;
+}
+
+//restore the AVL property of a subtree after one of its children changed its height by at most 1
+static struct vm_area* vma_rebalance(struct vm_area* area)
+{
+	vma_update_height(area);
+	int balance = vma_height(area->left) - vma_height(area->right);
+	if (balance > 1)
+	{
+		if (vma_height(area->left->left) < vma_height(area->left->right))
+			area->left = vma_rotate_left(area->left);
+		return vma_rotate_right(area);
+	}
+	if (balance < -1)
+	{
+		if (vma_height(area->right->right) < vma_height(area->right->left))
+			area->right = vma_rotate_right(area->right);
+		return vma_rotate_left(area);
+	}
+	return area;
+}
+
+static struct vm_area* vma_tree_insert(struct vm_area* root, struct vm_area* area)
+{
+	if (root == NULL)
+		return area;
+	if (area->start < root->start)
+		root->left = vma_tree_insert(root->left, area);
+	else
+		root->right = vma_tree_insert(root->right, area);
+	return vma_rebalance(root);
+}
+
+static struct vm_area* vma_tree_remove_min(struct vm_area* root, struct vm_area** min)
+{
+	if (root->left == NULL)
+	{
+		*min = root;
+		return root->right;
+	}
+	root->left = vma_tree_remove_min(root->left, min);
+	return vma_rebalance(root);
+}
+
+//unlink the area that starts at the given address & give it back to its cache
+static struct vm_area* vma_tree_remove(struct vm_area* root, uint32 start)
+{
+	if (root == NULL)
+		return NULL;
+	if (start < root->start)
+		root->left = vma_tree_remove(root->left, start);
+	else if (start > root->start)
+		root->right = vma_tree_remove(root->right, start);
+	else
+	{
+		struct vm_area* left = root->left;
+		struct vm_area* right = root->right;
+		kmem_cache_free(vma_cache, root);
+		if (right == NULL)
+			return left;
+
+		struct vm_area* successor;
+		right = vma_tree_remove_min(right, &successor);
+		successor->left = left;
+		successor->right = right;
+		return vma_rebalance(successor);
+	}
+	return vma_rebalance(root);
+}
+
+//the area with the greatest start <= va (or NULL)
+static struct vm_area* vma_floor(struct vm_area* root, uint32 va)
+{
+	struct vm_area* floor = NULL;
+	while (root != NULL)
+	{
+		if (root->start <= va)
+		{
+			floor = root;
+			root = root->right;
+		}
+		else
+			root = root->left;
+	}
+	return floor;
+}
+
+static void vma_tree_free(struct vm_area* root)
+{
+	if (root == NULL)
+		return;
+	vma_tree_free(root->left);
+	vma_tree_free(root->right);
+	kmem_cache_free(vma_cache, root);
+}
+
+//copy of the given subtree (same shape, so it's still balanced), or NULL with *ok = 0 if out of memory
+static struct vm_area* vma_tree_clone(struct vm_area* root, bool* ok)
+{
+	if (root == NULL)
+		return NULL;
+	struct vm_area* copy = kmem_cache_alloc(vma_cache);
+	if (copy == NULL)
+	{
+		*ok = 0;
+		return NULL;
+	}
+	*copy = *root;
+	copy->left = vma_tree_clone(root->left, ok);
+	copy->right = vma_tree_clone(root->right, ok);
+	return copy;
+}
+
+//===========================
+// [2] FIND AREA:
+//===========================
+//Return the area that contains the given address, or NULL if it's not reserved
+struct vm_area* vma_find(struct Env* e, uint32 va)
+{
+	struct vm_area* area = vma_floor(e->uheap_vmas, va);
+	if (area != NULL && va < area->end)
+		return area;
+	return NULL;
+}
+
+//Return 1 if no area of the env overlaps [start, end) (start < end)
+bool vma_is_free(struct Env* e, uint32 start, uint32 end)
+{
+	struct vm_area* area = vma_floor(e->uheap_vmas, end - 1);
+	return area == NULL || area->end <= start;
+}
+
+//===========================
+// [3] RESERVE RANGE:
+//===========================
+//Reserve [start, end) (should not overlap any area of the env). It's merged with the adjacent
+//areas of the same kind & permissions if any. Return its area, or NULL if the kernel heap is exhausted
+struct vm_area* vma_insert(struct Env* e, uint32 start, uint32 end, uint32 perms, uint8 kind)
+{
+	struct vm_area* prev = (start > 0) ? vma_floor(e->uheap_vmas, start - 1) : NULL;
+	struct vm_area* next = vma_floor(e->uheap_vmas, end);
+	if (prev != NULL && (prev->end != start || prev->kind != kind || prev->perms != perms))
+		prev = NULL;
+	if (next != NULL && (next->start != end || next->kind != kind || next->perms != perms))
+		next = NULL;
+
+	//changing the bounds in place keeps the order of the areas since they don't overlap
+	if (prev != NULL && next != NULL)
+	{
+		prev->end = next->end;
+		e->uheap_vmas = vma_tree_remove(e->uheap_vmas, next->start);
+		return prev;
+	}
+	if (prev != NULL)
+	{
+		prev->end = end;
+		return prev;
+	}
+	if (next != NULL)
+	{
+		next->start = start;
+		return next;
+	}
+
+	struct vm_area* area = kmem_cache_alloc(vma_cache);
+	if (area == NULL)
+		return NULL;
+	area->start = start;
+	area->end = end;
+	area->perms = perms;
+	area->kind = kind;
+	area->height = 1;
+	area->left = area->right = NULL;
+	e->uheap_vmas = vma_tree_insert(e->uheap_vmas, area);
+	return area;
+}
+
+//===========================
+// [4] RELEASE RANGE:
+//===========================
+//Release the reserved parts of [start, end), splitting the area that contains it if needed
+//Return 0 on success, or E_NO_MEM if the kernel heap is exhausted while splitting
+int vma_remove(struct Env* e, uint32 start, uint32 end)
+{
+	struct vm_area* area;
+	while (end > start && (area = vma_floor(e->uheap_vmas, end - 1)) != NULL && area->end > start)
+	{
+		if (area->start < start && area->end > end)
+		{
+			struct vm_area* tail = kmem_cache_alloc(vma_cache);
+			if (tail == NULL)
+				return E_NO_MEM;
+			*tail = *area;
+			tail->start = end;
+			tail->height = 1;
+			tail->left = tail->right = NULL;
+			area->end = start;
+			e->uheap_vmas = vma_tree_insert(e->uheap_vmas, tail);
+			break;
+		}
+		if (area->start < start)
+		{
+			area->end = start;
+			break;
+		}
+		if (area->end > end)
+			area->start = end;
+		else
+			e->uheap_vmas = vma_tree_remove(e->uheap_vmas, area->start);
+	}
+	return 0;
+}
+
+//===========================
+// [5] RELEASE ALL AREAS:
+//===========================
+void vma_free_all(struct Env* e)
+{
+	vma_tree_free(e->uheap_vmas);
+	e->uheap_vmas = NULL;
+}
+
+//===========================
+// [6] CLONE ALL AREAS:
+//===========================
+//Give "dst" (with no areas) a copy of the areas of "src". Return 0, or E_NO_MEM if the kernel heap is exhausted
+int vma_clone(struct Env* dst, struct Env* src)
+{
+	bool ok = 1;
+	dst->uheap_vmas = vma_tree_clone(src->uheap_vmas, &ok);
+	if (!ok)
+	{
+		vma_free_all(dst);
+		return E_NO_MEM;
+	}
+	return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef FOS_KERN_VMA_H_
+#define FOS_KERN_VMA_H_
+
+#ifndef FOS_KERNEL
+# error "This is a FOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/environment_definitions.h>
+
+//==================================================================================//
+//========================== VIRTUAL MEMORY AREAS (VMAs) ===========================//
+//==================================================================================//
+/* The reserved ranges of the user heap of each env are kept as areas [start, end) in an
+ * AVL tree ordered by their start address, instead of marking each PTE of the range:
+ *	- reserving/releasing a range is O(log n) & creates no page table (tables are created on first touch)
+ *	- the fault handler validates an access to the user heap by looking up its area
+ *	- adjacent areas of the same kind & permissions are merged, releasing a part of an area splits it
+ */
+
+enum
+{
+	VMA_UHEAP_BLOCKS = 1,	//[uheap_start, segment break): block allocator (sbrk)
+	VMA_UHEAP_PAGES			//above the hard limit: page allocator (malloc > DYN_ALLOC_MAX_BLOCK_SIZE)
+};
+
+struct vm_area
+{
+	uint32 start;			//page aligned
+	uint32 end;				//page aligned, exclusive
+	uint32 perms;			//permissions of its pages once they are mapped
+	uint8 kind;
+	int8 height;			//AVL height of the subtree rooted at this area
+	struct vm_area* left;
+	struct vm_area* right;
+};
+
+struct vm_area* vma_find(struct Env* e, uint32 va);
+bool vma_is_free(struct Env* e, uint32 start, uint32 end);
+void vma_init();
+struct vm_area* vma_insert(struct Env* e, uint32 start, uint32 end, uint32 perms, uint8 kind);
+int vma_remove(struct Env* e, uint32 start, uint32 end);
+void vma_free_all(struct Env* e);
+int vma_clone(struct Env* dst, struct Env* src);
+
+//Cache of the areas (created by vma_init)
+extern struct kmem_cache* vma_cache;
+
+#endif // FOS_KERN_VMA_H_
@@ -7,13 +7,98 @@
 
 #include <kern/trap/fault_handler.h>
 #include <kern/disk/pagefile_manager.h>
+#include <kern/cpu/cpu.h>
 #include "kheap.h"
 #include "memory_manager.h"
+#include "slab.h"
 
 ///============================================================================================
 /// Dealing with environment working set
 #if USE_KHEAP
 
+static inline uint32 ws_hash(struct Env* e, uint32 virtual_address)
+{
+	return (virtual_address >> PGSHIFT) & e->page_WS_hash_mask;
+}
+
+static void ws_hash_remove(struct Env* e, struct WorkingSetElement* wse)
+{
+	struct WorkingSetElement** ptr = &(e->page_WS_hash[ws_hash(e, wse->virtual_address)]);
+	while (*ptr != NULL && *ptr != wse)
+		ptr = &((*ptr)->hash_next);
+	if (*ptr != NULL)
+		*ptr = wse->hash_next;
+	wse->hash_next = NULL;
+}
+
+static void ws_hash_insert(struct Env* e, struct WorkingSetElement* wse)
+{
+	uint32 bucket = ws_hash(e, wse->virtual_address);
+	wse->hash_next = e->page_WS_hash[bucket];
+	e->page_WS_hash[bucket] = wse;
+}
+
+//The slots are readable from the user side (as the env): they have pages of their own, so that
+//no other kernel object becomes readable with them, & the permission is cleared before they're freed
+static void ws_slots_set_user(struct Env* e, struct WorkingSetElement* slots, uint32 count, bool user)
+{
+	uint32 end = (uint32)(slots + count);
+	for (uint32 va = (uint32)slots; va < end; va += PAGE_SIZE)
+	{
+		if (user)
+			pt_set_page_permissions(e->env_page_directory, va, PERM_USER| MARKING_BIT, 0);
+		else
+		{
+			pt_set_page_permissions(e->env_page_directory, va, 0, PERM_USER| MARKING_BIT);
+			tlb_invalidate(e->env_page_directory, (void*)va);
+		}
+	}
+}
+
+//Allocate the WS slots of the env [page_WS_max_size elements] & their VA hash, once at its creation:
+//no allocation is needed at a page fault then
+int env_page_ws_alloc_slots(struct Env* e)
+{
+	uint32 buckets = 1;
+	while (buckets < e->page_WS_max_size)
+		buckets <<= 1;
+	e->page_WS_hash_mask = buckets - 1;
+
+	e->page_WS_slots = kmalloc_pages(e->page_WS_max_size * sizeof(struct WorkingSetElement));
+	e->page_WS_hash = kmalloc(buckets * sizeof(struct WorkingSetElement*));
+	if (e->page_WS_slots == NULL || e->page_WS_hash == NULL)
+	{
+		env_page_ws_free_slots(e);
+		return E_NO_MEM;
+	}
+	memset(e->page_WS_hash, 0, buckets * sizeof(struct WorkingSetElement*));
+
+	LIST_INIT(&(e->page_WS_free_slots));
+	for (int i = e->page_WS_max_size - 1; i >= 0; i--)
+	{
+		e->page_WS_slots[i].empty = 1;
+		e->page_WS_slots[i].hash_next = NULL;
+		LIST_INSERT_HEAD(&(e->page_WS_free_slots), &(e->page_WS_slots[i]));
+	}
+
+	ws_slots_set_user(e, e->page_WS_slots, e->page_WS_max_size, 1);
+	return 0;
+}
+
+void env_page_ws_free_slots(struct Env* e)
+{
+	if (e->page_WS_slots != NULL)
+	{
+		ws_slots_set_user(e, e->page_WS_slots, e->page_WS_max_size, 0);
+		kfree(e->page_WS_slots);
+	}
+	if (e->page_WS_hash != NULL)
+		kfree(e->page_WS_hash);
+	e->page_WS_slots = NULL;
+	e->page_WS_hash = NULL;
+	LIST_INIT(&(e->page_WS_free_slots));
+}
+
 inline struct WorkingSetElement* env_page_ws_list_create_element(struct Env* e, uint32 virtual_address)
 {
     //TODO: [PROJECT'24.MS2 - #07] [2] FAULT HANDLER I - Create a new WS element
@@ -22,23 +107,83 @@ inline struct WorkingSetElement* env_page_ws_list_create_element(struct Env* e,
 	//panic("env_page_ws_list_create_element is not implemented yet");
     //Your Code is Here...
 
-    struct WorkingSetElement *WS_Element = (struct WorkingSetElement*)kmalloc(sizeof(struct WorkingSetElement));
+    struct WorkingSetElement *WS_Element = LIST_FIRST(&(e->page_WS_free_slots));
 
     if(WS_Element==NULL)
         panic("Could not allocate a working set element");
+    LIST_REMOVE(&(e->page_WS_free_slots), WS_Element);
 
     WS_Element->virtual_address = virtual_address;
     WS_Element->sweeps_counter = 0;
-
-    pt_set_page_permissions(e->env_page_directory, (uint32)WS_Element, PERM_USER| MARKING_BIT, 0);
+    WS_Element->time_stamp = 0;
+    WS_Element->empty = 0;
+    ws_hash_insert(e, WS_Element);
 
     uint32 * ptr_page_table;
     struct FrameInfo *frame = get_frame_info(e->env_page_directory, virtual_address, &ptr_page_table);
-    frame->ws_ptr = WS_Element;
+    if (frame != NULL)
+    {
+    	frame->ws_ptr = WS_Element;
+    	frame->proc = e;
+    }
 
     return WS_Element;
 }
 
+//Give the element back to the free slots of the env [it must be removed from its WS list first]
+void env_page_ws_free_element(struct Env* e, struct WorkingSetElement* wse)
+{
+	ws_hash_remove(e, wse);
+	wse->empty = 1;
+	LIST_INSERT_HEAD(&(e->page_WS_free_slots), wse);
+}
+
+//Let the element hold another page (e.g. on replacement or when its page is moved)
+void env_page_ws_set_va(struct Env* e, struct WorkingSetElement* wse, uint32 virtual_address)
+{
+	ws_hash_remove(e, wse);
+	wse->virtual_address = virtual_address;
+	ws_hash_insert(e, wse);
+}
+
+//Find the WS element of the given page. Needed when its frame is shared by more than one env
+//(e.g. after fork), since the frame's ws_ptr is then the element of one of them only
+struct WorkingSetElement* env_page_ws_find(struct Env* e, uint32 virtual_address)
+{
+	struct WorkingSetElement *wse;
+	virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	if (e->page_WS_hash == NULL)
+		return NULL;
+	for (wse = e->page_WS_hash[ws_hash(e, virtual_address)]; wse != NULL; wse = wse->hash_next)
+		if (ROUNDDOWN(wse->virtual_address, PAGE_SIZE) == virtual_address)
+			return wse;
+	return NULL;
+}
+
+//Give dst a copy of src's WS list (same pages, same order & same clock hand). The frames' ws_ptr
+//are left pointing at src's elements; dst's are found by env_page_ws_find() while still shared
+int env_page_ws_clone(struct Env* dst, struct Env* src)
+{
+	struct WorkingSetElement *wse;
+	LIST_FOREACH(wse, &(src->page_WS_list))
+	{
+		struct WorkingSetElement *copy = LIST_FIRST(&(dst->page_WS_free_slots));
+		if (copy == NULL)
+			return E_NO_MEM;
+		LIST_REMOVE(&(dst->page_WS_free_slots), copy);
+		copy->virtual_address = wse->virtual_address;
+		copy->sweeps_counter = wse->sweeps_counter;
+		copy->time_stamp = wse->time_stamp;
+		copy->empty = 0;
+		ws_hash_insert(dst, copy);
+
+		LIST_INSERT_TAIL(&(dst->page_WS_list), copy);
+		if (src->page_last_WS_element == wse)
+			dst->page_last_WS_element = copy;
+	}
+	return 0;
+}
+
 inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 {
 	if (isPageReplacmentAlgorithmLRU(PG_REP_LRU_LISTS_APPROX))
@@ -54,7 +199,7 @@ inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 
 				LIST_REMOVE(&(e->ActiveList), ptr_WS_element);
 
-				/*EDIT*/kfree(ptr_WS_element);
+				/*EDIT*/env_page_ws_free_element(e, ptr_WS_element);
 
 				if(ptr_tmp_WS_element != NULL)
 				{
@@ -77,7 +222,7 @@ inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 					unmap_frame(e->env_page_directory, ptr_WS_element->virtual_address);
 					LIST_REMOVE(&(e->SecondList), ptr_WS_element);
 
-					kfree(ptr_WS_element);
+					env_page_ws_free_element(e, ptr_WS_element);
 
 					/*EDIT*/break;
 				}
@@ -86,23 +231,18 @@ inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 	}
 	else
 	{
-		struct WorkingSetElement *wse;
-		LIST_FOREACH(wse, &(e->page_WS_list))
+		struct WorkingSetElement *wse = env_page_ws_find(e, virtual_address);
+		if (wse != NULL)
 		{
-			if(ROUNDDOWN(wse->virtual_address,PAGE_SIZE) == ROUNDDOWN(virtual_address,PAGE_SIZE))
-			{
-				unmap_frame(e->env_page_directory, wse->virtual_address);
-
-				if (e->page_last_WS_element == wse)
-				{
-					e->page_last_WS_element = LIST_NEXT(wse);
-				}
-				LIST_REMOVE(&(e->page_WS_list), wse);
+			unmap_frame(e->env_page_directory, wse->virtual_address);
 
-				kfree(wse);
-
-				break;
+			if (e->page_last_WS_element == wse)
+			{
+				e->page_last_WS_element = LIST_NEXT(wse);
 			}
+			LIST_REMOVE(&(e->page_WS_list), wse);
+
+			env_page_ws_free_element(e, wse);
 		}
 	}
 }
@@ -367,10 +507,243 @@ inline uint32 env_table_ws_is_entry_empty(struct Env* e, uint32 entry_index)
 
 void double_WS_Size(struct Env* e, int isOneTimeOnly)
 {
+#if USE_KHEAP
+	if (isPageReplacmentAlgorithmLRU(PG_REP_LRU_LISTS_APPROX))
+		panic("not handled yet");
+	env_page_ws_resize(e, 2 * e->page_WS_max_size);
+#else
 	panic("not handled yet");
+#endif
 }
 
+//The extra pages are always evicted immediately
 void half_WS_Size(struct Env* e, int isImmidiate)
 {
+#if USE_KHEAP
+	if (isPageReplacmentAlgorithmLRU(PG_REP_LRU_LISTS_APPROX))
+		panic("not handled yet");
+	env_page_ws_resize(e, e->page_WS_max_size / 2);
+#else
 	panic("not handled yet");
+#endif
+}
+
+#if USE_KHEAP
+//Take the page out of the memory of e: its frame is buffered, or written back (if modified) & unmapped.
+//Its WS element is left for the caller to reuse or free. e may be other than the current env (global
+//replacement), the write back is then done in its address space as in write_buffered_frame()
+void env_page_ws_evict_page(struct Env* e, uint32 virtual_address)
+{
+	if(!isBufferingEnabled() || !buffer_page(e, virtual_address))
+	{
+		uint32* ptr_page_table;
+		struct FrameInfo *frame_info = get_frame_info(e->env_page_directory, virtual_address, &ptr_page_table);
+		uint32 perms = pt_get_page_permissions(e->env_page_directory, virtual_address);
+
+		if((perms & PERM_MODIFIED) == PERM_MODIFIED)
+		{
+			pushcli();
+			{
+				uint32 cur_phys_pgdir = rcr3();
+				if (cur_phys_pgdir != e->env_cr3)
+					lcr3(e->env_cr3);
+				pf_update_env_page(e, virtual_address, frame_info);
+				if (cur_phys_pgdir != e->env_cr3)
+					lcr3(cur_phys_pgdir);
+			}
+			popcli();
+		}
+
+		unmap_frame(e->env_page_directory, virtual_address);
+	}
+}
+
+//Evict "count" pages of the WS of e at once (at most PF_MAX_CLUSTER_PAGES), picked from the clock hand on
+//(giving the used ones a 2nd chance). The clean ones are just unmapped, the modified ones are written back
+//together by pf_update_env_pages() (in disk frame order, in as few disk requests as possible)
+void env_page_ws_evict_batch(struct Env* e, uint32 count)
+{
+	uint32 modified_vas[PF_MAX_CLUSTER_PAGES];
+	uint32 modified_count = 0;
+	if (count > PF_MAX_CLUSTER_PAGES)
+		count = PF_MAX_CLUSTER_PAGES;
+	if (count > LIST_SIZE(&(e->page_WS_list)))
+		count = LIST_SIZE(&(e->page_WS_list));
+
+	//[1] pick the victims & take them out of the WS
+	for (uint32 evicted = 0; evicted < count; )
+	{
+		struct WorkingSetElement *wse = e->page_last_WS_element;
+		if (wse == NULL)
+			wse = LIST_FIRST(&(e->page_WS_list));
+		e->page_last_WS_element = LIST_NEXT(wse);
+
+		uint32 virtual_address = wse->virtual_address;
+		int perms = pt_get_page_permissions(e->env_page_directory, virtual_address);
+		if (perms != -1 && (perms & PERM_USED))
+		{
+			pt_set_page_permissions(e->env_page_directory, virtual_address, 0, PERM_USED);
+			continue;
+		}
+		if (perms != -1 && (perms & PERM_MODIFIED) && !isBufferingEnabled())
+			modified_vas[modified_count++] = virtual_address;
+		else
+			env_page_ws_evict_page(e, virtual_address);
+		LIST_REMOVE(&(e->page_WS_list), wse);
+		env_page_ws_free_element(e, wse);
+		evicted++;
+	}
+	if (modified_count == 0)
+		return;
+
+	//[2] write back the modified ones (through their VAs in the address space of e), then unmap them
+	pushcli();
+	{
+		uint32 cur_phys_pgdir = rcr3();
+		if (cur_phys_pgdir != e->env_cr3)
+			lcr3(e->env_cr3);
+		pf_update_env_pages(e, modified_vas, modified_count);
+		if (cur_phys_pgdir != e->env_cr3)
+			lcr3(cur_phys_pgdir);
+	}
+	popcli();
+	for (uint32 i = 0; i < modified_count; i++)
+		unmap_frame(e->env_page_directory, modified_vas[i]);
+}
+
+//Change the max size of the WS of e to new_size. When shrinking, the pages beyond it are evicted from
+//the clock hand on (giving the used ones a 2nd chance). The elements then move to new slots of the new size
+int env_page_ws_resize(struct Env* e, uint32 new_size)
+{
+	if (new_size == 0)
+		new_size = 1;
+	if (new_size == e->page_WS_max_size)
+		return 0;
+
+	//[1] evict the pages that don't fit
+	while (LIST_SIZE(&(e->page_WS_list)) > new_size)
+	{
+		struct WorkingSetElement *wse = e->page_last_WS_element;
+		if (wse == NULL)
+			wse = LIST_FIRST(&(e->page_WS_list));
+		e->page_last_WS_element = LIST_NEXT(wse);
+
+		int perms = pt_get_page_permissions(e->env_page_directory, wse->virtual_address);
+		if (perms != -1 && (perms & PERM_USED))
+		{
+			pt_set_page_permissions(e->env_page_directory, wse->virtual_address, 0, PERM_USED);
+			continue;
+		}
+		env_page_ws_evict_page(e, wse->virtual_address);
+		LIST_REMOVE(&(e->page_WS_list), wse);
+		env_page_ws_free_element(e, wse);
+	}
+
+	//[2] allocate the new slots
+	uint32 old_size = e->page_WS_max_size;
+	struct WorkingSetElement* old_slots = e->page_WS_slots;
+	struct WorkingSetElement** old_hash = e->page_WS_hash;
+	uint32 old_hash_mask = e->page_WS_hash_mask;
+	struct WS_List old_free_slots = e->page_WS_free_slots;
+	struct WorkingSetElement* old_last = e->page_last_WS_element;
+	struct WS_List old_list = e->page_WS_list;
+
+	e->page_WS_max_size = new_size;
+	if (env_page_ws_alloc_slots(e) != 0)
+	{
+		e->page_WS_max_size = old_size;
+		e->page_WS_slots = old_slots;
+		e->page_WS_hash = old_hash;
+		e->page_WS_hash_mask = old_hash_mask;
+		e->page_WS_free_slots = old_free_slots;
+		return E_NO_MEM;
+	}
+
+	//[3] move the elements, in the same order
+	LIST_INIT(&(e->page_WS_list));
+	e->page_last_WS_element = NULL;
+	for (struct WorkingSetElement *old = LIST_FIRST(&old_list); old != NULL; old = LIST_NEXT(old))
+	{
+		struct WorkingSetElement *wse = LIST_FIRST(&(e->page_WS_free_slots));
+		LIST_REMOVE(&(e->page_WS_free_slots), wse);
+		wse->virtual_address = old->virtual_address;
+		wse->sweeps_counter = old->sweeps_counter;
+		wse->time_stamp = old->time_stamp;
+		wse->empty = 0;
+		ws_hash_insert(e, wse);
+		LIST_INSERT_TAIL(&(e->page_WS_list), wse);
+		if (old == old_last)
+			e->page_last_WS_element = wse;
+
+		uint32* ptr_page_table;
+		struct FrameInfo *frame_info = get_frame_info(e->env_page_directory, wse->virtual_address, &ptr_page_table);
+		if (frame_info != NULL && frame_info->ws_ptr == old)
+			frame_info->ws_ptr = wse;
+	}
+	if (e->page_last_WS_element == NULL && LIST_SIZE(&(e->page_WS_list)) == new_size)
+		e->page_last_WS_element = LIST_FIRST(&(e->page_WS_list));
+
+	ws_slots_set_user(e, old_slots, old_size, 0);
+	kfree(old_slots);
+	kfree(old_hash);
+	return 0;
+}
+#endif
+
+void enableBatchEviction(uint32 enableIt){_EnableBatchEviction = enableIt;}
+uint8 isBatchEvictionEnabled(){  return _EnableBatchEviction ; }
+
+void enablePFF(uint32 enableIt){_EnablePFF = enableIt;}
+uint8 isPFFEnabled(){  return _EnablePFF ; }
+
+void setPFFParameters(uint32 min_WS_size, uint32 max_WS_size, uint32 interval, uint32 low_faults, uint32 high_faults)
+{
+	pff_min_WS_size = min_WS_size;
+	pff_max_WS_size = max_WS_size;
+	pff_interval = interval;
+	pff_low_faults = low_faults;
+	pff_high_faults = high_faults;
+}
+
+//Called on each clock tick of the running env "e": only picks its new WS max size, since resizing
+//may write pages to the page file & allocate, which is not done in the clock interrupt
+void env_page_ws_pff_update(struct Env* e)
+{
+#if USE_KHEAP
+	if (isPageReplacmentAlgorithmLRU(PG_REP_LRU_LISTS_APPROX) || e->nClocks - e->pffLastSampleClock < pff_interval)
+		return;
+	uint32 faults = e->pageFaultsCounter - e->pffLastFaults;
+	e->pffLastSampleClock = e->nClocks;
+	e->pffLastFaults = e->pageFaultsCounter;
+
+	uint32 free_frames = LIST_SIZE(&MemFrameLists.free_frame_list);
+	uint32 scarce_frames = (memory_scarce_threshold_percentage * number_of_frames) / 100;
+	uint32 size = e->page_WS_max_size;
+	if (faults > pff_high_faults && free_frames > scarce_frames)
+	{
+		//grow by at most the frames that are free above the scarce threshold
+		uint32 extra = free_frames - scarce_frames;
+		size = (size > extra) ? size + extra : 2 * size;
+	}
+	else if (faults < pff_low_faults || (faults <= pff_high_faults && free_frames <= scarce_frames))
+	{
+		size = size / 2;
+	}
+	if (size > pff_max_WS_size)
+		size = pff_max_WS_size;
+	if (size < pff_min_WS_size)
+		size = pff_min_WS_size;
+	e->pffPendingWSSize = (size != e->page_WS_max_size) ? size : 0;
+#endif
+}
+
+//Called at a page fault of "e": applies the WS max size picked by env_page_ws_pff_update()
+void env_page_ws_pff_apply(struct Env* e)
+{
+#if USE_KHEAP
+	uint32 size = e->pffPendingWSSize;
+	e->pffPendingWSSize = 0;
+	if (size != 0 && size != e->page_WS_max_size && !isPageReplacmentAlgorithmLRU(PG_REP_LRU_LISTS_APPROX))
+		env_page_ws_resize(e, size);
+#endif
 }
@@ -17,6 +17,12 @@ inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address);
 #if USE_KHEAP
 /*2024*/
 inline struct WorkingSetElement* env_page_ws_list_create_element(struct Env* e, uint32 virtual_address);
+struct WorkingSetElement* env_page_ws_find(struct Env* e, uint32 virtual_address);
+int env_page_ws_clone(struct Env* dst, struct Env* src);
+int env_page_ws_alloc_slots(struct Env* e);
+void env_page_ws_free_slots(struct Env* e);
+void env_page_ws_free_element(struct Env* e, struct WorkingSetElement* wse);
+void env_page_ws_set_va(struct Env* e, struct WorkingSetElement* wse, uint32 virtual_address);
 #else
 inline uint32 env_page_ws_get_size(struct Env *e);
 inline void env_page_ws_set_entry(struct Env* e, uint32 entry_index, uint32 virtual_address);
@@ -42,5 +48,36 @@ void env_table_ws_print(struct Env *curenv);
 void cut_paste_WS(struct WorkingSetElement* newWS, int newSize, struct Env* e);
 void double_WS_Size(struct Env* e, int isOneTimeOnly);
 void half_WS_Size(struct Env* e, int isImmidiate);
+#if USE_KHEAP
+void env_page_ws_evict_page(struct Env* e, uint32 virtual_address);
+int env_page_ws_resize(struct Env* e, uint32 new_size);
+void env_page_ws_evict_batch(struct Env* e, uint32 count);
+#endif
+
+// Batch Eviction ========================================================================
+//A page fault on a full WS evicts percentage_of_WS_pages_to_be_removed % of its pages at once instead of
+//replacing a single one, so that the modified ones among them are written back in clustered disk requests
+uint32 _EnableBatchEviction;
+
+void enableBatchEviction(uint32 enableIt);
+uint8 isBatchEvictionEnabled();
+
+// Change WS Sizes By Page Fault Frequency (PFF) ==========================================
+//Every pff_interval clock ticks of an env, its WS max size is doubled if it had more than pff_high_faults
+//faults [and the free frames are not scarce], or halved if it had less than pff_low_faults [or more frames
+//are needed for the others, i.e. they are scarce & it's not faulting too]. Always within [pff_min_WS_size, pff_max_WS_size]
+//The clock interrupt only picks the new size, it's applied at the next page fault of the env (env_page_ws_pff_apply)
+uint32 _EnablePFF;
+uint32 pff_min_WS_size, pff_max_WS_size;
+uint32 pff_interval, pff_low_faults, pff_high_faults;
+#define DEFAULT_PFF_INTERVAL 10
+#define DEFAULT_PFF_LOW_FAULTS 1
+#define DEFAULT_PFF_HIGH_FAULTS 8
+
+void enablePFF(uint32 enableIt);
+uint8 isPFFEnabled();
+void setPFFParameters(uint32 min_WS_size, uint32 max_WS_size, uint32 interval, uint32 low_faults, uint32 high_faults);
+void env_page_ws_pff_update(struct Env* e);
+void env_page_ws_pff_apply(struct Env* e);
 
 #endif /* KERN_MEM_WORKING_SET_MANAGER_H_ */
@@ -19,6 +19,7 @@
 #include "../mem/kheap.h"
 #include "../mem/memory_manager.h"
 #include "../mem/shared_memory_manager.h"
+#include "../mem/vma.h"
 
 
 /******************************/
@@ -29,6 +30,9 @@ struct Env* envs = NULL;		// All environments
 
 static struct Env_list env_free_list;	// Free Environment list
 
+//Number of WS frames returned to the frame allocator at once when freeing an environment
+#define WS_FREE_BATCH_SIZE 64
+
 //Contains information about each program segment (e.g. start address, size, virtual address...)
 //It will be used below in "env_create" to load each program segment into the user environment
 
@@ -37,6 +41,7 @@ struct ProgramSegment {
 	uint32 size_in_file;
 	uint32 size_in_memory;
 	uint8 *virtual_address;
+	uint32 flags;			//ELF_PROG_FLAG_xxx
 
 	// for use only with PROGRAM_SEGMENT_FOREACH
 	uint32 segment_id;
@@ -68,6 +73,7 @@ void* create_user_kern_stack(uint32* ptr_user_page_directory);
 void delete_user_kern_stack(struct Env* e);
 //======================
 static int program_segment_alloc_map_copy_workingset(struct Env *e, struct ProgramSegment* seg, uint32* allocated_pages, uint32 remaining_ws_pages, uint32* lastTableNumber);
+static struct FrameInfo* program_segment_image_frame(struct ProgramSegment* seg, uint32 virtual_address);
 void initialize_environment(struct Env* e, uint32* ptr_user_page_directory, unsigned int phys_user_page_directory);
 void complete_environment_initialization(struct Env* e);
 void set_environment_entry_point(struct Env* e, uint8* ptr_program_start);
@@ -221,58 +227,34 @@ struct Env* env_create(char* user_program_name, unsigned int page_WS_size, unsig
 			LOG_STATMENT(cprintf("SEGMENT: remaining WS pages after allocation = %d",remaining_ws_pages));
 
 
-			/// 7.2) temporary initialize 1st page in memory then writing it on page file
-			uint32 dataSrc_va = (uint32) seg->ptr_start;
+			/// 7.2) back each page of the segment content in the page file: the pages that can be
+			/// mapped straight to the program image are backed by its frames (without any disk write),
+			/// the others (partial pages) are initialized in a temp page then written on page file
 			uint32 seg_va = (uint32) seg->virtual_address ;
-
-			uint32 start_first_page = ROUNDDOWN(seg_va , PAGE_SIZE);
-			uint32 end_first_page = ROUNDUP(seg_va , PAGE_SIZE);
-			uint32 offset_first_page = seg_va  - start_first_page ;
-
-			uint8 *src_ptr =  (uint8*) dataSrc_va;
-			uint8 *dst_ptr =  (uint8*) (ptr_temp_page + offset_first_page);
+			uint32 end_seg_file = seg_va + seg->size_in_file;
+			uint8 copyOnWrite = (seg->flags & ELF_PROG_FLAG_WRITE) != 0;
 			int i;
-			if (offset_first_page)
+
+			for (i = ROUNDDOWN(seg_va, PAGE_SIZE) ; i < ROUNDUP(end_seg_file, PAGE_SIZE) ; i += PAGE_SIZE)
 			{
-				memset(ptr_temp_page , 0, PAGE_SIZE);
-				for (i = seg_va ; i < end_first_page ; i++, src_ptr++,dst_ptr++ )
+				struct FrameInfo* image_frame = program_segment_image_frame(seg, i);
+				int ret;
+				if (image_frame != NULL)
+					ret = pf_add_env_image_page(e, i, image_frame, copyOnWrite);
+				else if (i >= seg_va && i + PAGE_SIZE <= end_seg_file)
+					ret = pf_add_env_page(e, i, seg->ptr_start + (i - seg_va));
+				else
 				{
-					*dst_ptr = *src_ptr ;
+					uint32 start_copy = i > seg_va ? i : seg_va;
+					uint32 end_copy = i + PAGE_SIZE < end_seg_file ? i + PAGE_SIZE : end_seg_file;
+					memset(ptr_temp_page, 0, PAGE_SIZE);
+					memcpy(ptr_temp_page + (start_copy - i), seg->ptr_start + (start_copy - seg_va), end_copy - start_copy);
+					ret = pf_add_env_page(e, i, ptr_temp_page);
 				}
-
-				if (pf_add_env_page(e, start_first_page, ptr_temp_page) == E_NO_PAGE_FILE_SPACE)
-					panic("ERROR: Page File OUT OF SPACE. can't load the program in Page file!!");
-
-				//LOG_STRING(" -------------------- PAGE FILE: 1st page is written");
-			}
-
-			/// 7.3) Start writing the segment ,from 2nd page until before last page, to page file ...
-
-			uint32 start_last_page = ROUNDDOWN(seg_va  + seg->size_in_file, PAGE_SIZE) ;
-			uint32 end_last_page = seg_va  + seg->size_in_file;
-
-			for (i = end_first_page ; i < start_last_page ; i+= PAGE_SIZE, src_ptr+= PAGE_SIZE)
-			{
-				if (pf_add_env_page(e, i, src_ptr) == E_NO_PAGE_FILE_SPACE)
+				if (ret == E_NO_PAGE_FILE_SPACE)
 					panic("ERROR: Page File OUT OF SPACE. can't load the program in Page file!!");
-
 			}
-			//LOG_STRING(" -------------------- PAGE FILE: 2nd page --> before last page are written");
-
-			/// 7.4) temporary initialize last page in memory then writing it on page file
-
-			dst_ptr =  (uint8*) ptr_temp_page;
-			memset(dst_ptr, 0, PAGE_SIZE);
-
-			for (i = start_last_page ; i < end_last_page ; i++, src_ptr++,dst_ptr++ )
-			{
-				*dst_ptr = *src_ptr;
-			}
-			if (pf_add_env_page(e, start_last_page, ptr_temp_page) == E_NO_PAGE_FILE_SPACE)
-				panic("ERROR: Page File OUT OF SPACE. can't load the program in Page file!!");
-
-
-			//LOG_STRING(" -------------------- PAGE FILE: last page is written");
+			//LOG_STRING(" -------------------- PAGE FILE: segment content is written");
 
 			/// 7.5) writing the remaining seg->size_in_memory pages to disk
 
@@ -430,6 +412,122 @@ struct Env* env_create(char* user_program_name, unsigned int page_WS_size, unsig
 	return e;
 }
 
+//Map the shared object into the (forked) env "e" at startVA, as getSharedObject() does
+static int forkSharedObj(int32 sharedObjectID, void *startVA, struct Env* e)
+{
+	acquire_spinlock(&AllShares.shareslock);
+	struct Share* share = NULL;
+	LIST_FOREACH(share, &AllShares.shares_list)
+		if(share->ID == sharedObjectID)
+			break;
+	if(share == NULL)
+	{
+		release_spinlock(&AllShares.shareslock);
+		return E_NO_SHARE;
+	}
+	share->references++;
+	release_spinlock(&AllShares.shareslock);
+
+	uint32 permissions = PERM_USER;
+	if(share->isWritable)
+		permissions |= PERM_WRITEABLE;
+	uint32 frames_count = ROUNDUP(share->size , PAGE_SIZE) / PAGE_SIZE;
+	for(int i = 0; i < frames_count; i++)
+		if (share_map_page(share, i, e->env_page_directory, (uint32)startVA + i*PAGE_SIZE, permissions) != 0)
+			return E_NO_MEM;
+	return 0;
+}
+
+//===============================
+// 1.1) FORK AN ENV:
+//===============================
+// Creates a child of env "parent" with a copy of its address space: its pages are shared
+// copy-on-write (see cow_fault_handler()), its page file pages & shared objects are shared too.
+// The child returns 0 from the trap that "parent" is in. It's created as NEW (run it by sched_run_env)
+struct Env* env_fork(struct Env* parent)
+{
+	//LRU lists keep their own WS lists that are not cloned here
+	if(isPageReplacmentAlgorithmLRU(PG_REP_LRU_LISTS_APPROX))
+		return NULL;
+
+	struct Env* e = NULL;
+	if(allocate_environment(&e) < 0)
+		return NULL;
+	strcpy(e->prog_name, parent->prog_name);
+
+	uint32* ptr_user_page_directory = create_user_directory();
+	unsigned int phys_user_page_directory = kheap_physical_address((uint32)ptr_user_page_directory);
+
+	e->page_WS_max_size = parent->page_WS_max_size;
+	e->percentage_of_WS_pages_to_be_removed = parent->percentage_of_WS_pages_to_be_removed;
+	e->priority = parent->priority;
+	initialize_environment(e, ptr_user_page_directory, phys_user_page_directory);
+
+	//the child resumes from the same trap frame but sees 0 as the result of the fork
+	*(e->env_tf) = *(parent->env_tf);
+	e->env_tf->tf_regs.reg_eax = 0;
+	e->initNumStackPages = parent->initNumStackPages;
+
+	//user heap: the user side allocator is in the (copied) user memory, so copy the kernel side
+	e->uheap_start = parent->uheap_start;
+	e->uheap_segment_break = parent->uheap_segment_break;
+	e->uheap_hard_limit = parent->uheap_hard_limit;
+	e->uheap_pages_count = parent->uheap_pages_count;
+
+	//the page file must be up to date before it's shared: evicted pages are read back from it
+	flush_modified_frames();
+	if (vma_clone(e, parent) != 0 || pf_clone_env(e, parent) != 0)
+		goto fail;
+
+	//shared objects stay shared (writable if they are) [mapped first, so skipped by the loop below]
+	for(int i = 0; i < NUM_OF_UHEAP_PAGES; i++)
+	{
+		if(parent->shared_id_directory[i] == -1)
+			continue;
+		if (forkSharedObj(parent->shared_id_directory[i], (void*)(i*PAGE_SIZE+(e->uheap_hard_limit + PAGE_SIZE)), e) != 0)
+			goto fail;
+		e->shared_id_directory[i] = parent->shared_id_directory[i];
+	}
+
+	//the rest of the resident pages are shared read-only, writable ones are marked copy-on-write in both
+	//[non-resident ones (incl. buffered) are left unmapped: the child faults them in from the page file]
+	for (uint32 pdeno = 0; pdeno < PDX(USER_TOP); pdeno++)
+	{
+		if (pdeno == PDX(UVPT) || pdeno == PDX(VPT) || !(parent->env_page_directory[pdeno] & PERM_PRESENT))
+			continue;
+		uint32 *parent_pt = (uint32*)kheap_virtual_address(EXTRACT_ADDRESS(parent->env_page_directory[pdeno]));
+		uint32 *child_pt = NULL;
+		if (e->env_page_directory[pdeno] & PERM_PRESENT)
+			child_pt = (uint32*)kheap_virtual_address(EXTRACT_ADDRESS(e->env_page_directory[pdeno]));
+
+		for (uint32 pteno = 0; pteno < 1024; pteno++)
+		{
+			uint32 entry = parent_pt[pteno];
+			if (!(entry & PERM_PRESENT) || (child_pt != NULL && child_pt[pteno] != 0))
+				continue;
+			if (child_pt == NULL)
+				child_pt = create_page_table(e->env_page_directory, pdeno << PDXSHIFT);
+
+			if (entry & PERM_WRITEABLE)
+			{
+				entry = (entry & ~PERM_WRITEABLE) | PERM_COW;
+				parent_pt[pteno] = entry;
+			}
+			child_pt[pteno] = entry;
+			to_frame_info(EXTRACT_ADDRESS(entry))->references++;
+		}
+	}
+	tlbflush();
+
+	if (env_page_ws_clone(e, parent) != 0)
+		goto fail;
+	return e;
+
+fail:
+	env_free(e);
+	return NULL;
+}
+
 //===============================
 // 2) START EXECUTING THE PROCESS:
 //===============================
@@ -491,11 +589,12 @@ int freeSharedObj(int32 sharedObjectID, void *startVA, struct Env* myenv)
 	for(int i = 0; i < frames_count; i++) {
 		get_page_table(myenv->env_page_directory , current_page , &ptr_page_table);
 		unmap_frame(myenv->env_page_directory , current_page);
+		ptr_page_table[PTX(current_page)] &= ~PERM_SHARE_OUT;
 		bool flag = 1;
 		uint32* table = ptr_page_table;
 
 		for(int i = 0; i < PAGE_SIZE / 4; i++) {
-			if(table[i] & PERM_PRESENT) {
+			if(table[i] & (PERM_PRESENT | PERM_SHARE_OUT)) {
 				flag = 0;
 				break;
 			}
@@ -522,6 +621,19 @@ int freeSharedObj(int32 sharedObjectID, void *startVA, struct Env* myenv)
 
 }
 
+//Each env polls its mem_pressure (read-only in UENVS) from its user heap, and gives back
+//its cached pages & the free pages at the top of its heap when it changes.
+//The kernel heap drops the small blocks cached in its per-CPU magazines as well.
+void signal_memory_pressure(void)
+{
+	kmag_request_flush();
+	if (envs == NULL)
+		return;
+	for (int i = 0; i < NENV; i++)
+		if (envs[i].env_status != ENV_FREE)
+			envs[i].mem_pressure++;
+}
+
 void env_free(struct Env *e)
 {
 	for(int i = 0; i < NUM_OF_UHEAP_PAGES; i++){
@@ -530,18 +642,44 @@ void env_free(struct Env *e)
 		}
 	}
 
+	//the frames of the WS are given back to the frame allocator in batches
+	//(one free frame list lock per batch), the WS slots are freed at once
+	struct FrameInfo* frames_batch[WS_FREE_BATCH_SIZE];
+	uint32 frames_batch_count = 0;
+
 	struct WorkingSetElement* cur;
 	LIST_FOREACH(cur,&e->page_WS_list)
 	{
 		uint32* ptr_page_table;
-		get_page_table(e->env_page_directory, cur->virtual_address, &ptr_page_table);
-
 		struct FrameInfo *frame = get_frame_info(e->env_page_directory, cur->virtual_address, &ptr_page_table);
-		free_frame(frame);
-		unmap_frame(e->env_page_directory, cur->virtual_address);
+		if (frame != NULL)
+		{
+			ptr_page_table[PTX(cur->virtual_address)] &= PERM_AVAILABLE;
+			tlb_invalidate(e->env_page_directory, (void *)cur->virtual_address);
+			//a shared frame (e.g. a program image page) stays with its other users
+			if (frame->references > 1)
+			{
+				if (frame->proc == e)
+				{
+					frame->proc = NULL;
+					frame->ws_ptr = NULL;
+				}
+				decrement_references(frame);
+			}
+			else
+				frames_batch[frames_batch_count++] = frame;
+		}
 
-		kfree((void*)cur);
+		if (frames_batch_count == WS_FREE_BATCH_SIZE)
+		{
+			free_frames(frames_batch, frames_batch_count);
+			frames_batch_count = 0;
+		}
 	}
+	free_frames(frames_batch, frames_batch_count);
+	LIST_INIT(&e->page_WS_list);
+	env_page_ws_free_slots(e);
+	e->page_last_WS_element = NULL;
 
 	//for(uint32 table = 0; table < PAGE_SIZE / 4; table++){
 	//	  uint32 page_directory_entry = e->env_page_directory[table];
@@ -554,6 +692,9 @@ void env_free(struct Env *e)
 	//}
 
 	kfree((void*)e->shared_id_directory);
+	if (e->readaheadBuffer != NULL)
+		kfree(e->readaheadBuffer);
+	vma_free_all(e);
 	//kfree((void*)e->env_page_directory);
 	delete_user_kern_stack(e);
 
@@ -818,12 +959,20 @@ static int program_segment_alloc_map_copy_workingset(struct Env *e, struct Progr
 	/*==========================================================================================*/
 	for (; iVA < end_vaddr && i<remaining_ws_pages; i++, iVA += PAGE_SIZE)
 	{
-		// Allocate a page
-		allocate_frame(&p) ;
+		//Share the program image frame of this page if possible (copy-on-write if it's writable),
+		//else allocate a page & copy it below
+		p = program_segment_image_frame(seg, iVA);
+		if (p != NULL)
+			loadtime_map_frame(e->env_page_directory, p, iVA, PERM_USER | ((seg->flags & ELF_PROG_FLAG_WRITE) ? PERM_COW : 0));
+		else
+		{
+			// Allocate a page
+			allocate_frame(&p) ;
 
-		LOG_STRING("segment page allocated");
-		loadtime_map_frame(e->env_page_directory, p, iVA, PERM_USER | PERM_WRITEABLE);
-		LOG_STRING("segment page mapped");
+			LOG_STRING("segment page allocated");
+			loadtime_map_frame(e->env_page_directory, p, iVA, PERM_USER | PERM_WRITEABLE);
+			LOG_STRING("segment page mapped");
+		}
 
 #if USE_KHEAP
 		struct WorkingSetElement* wse = env_page_ws_list_create_element(e, iVA);
@@ -901,11 +1050,19 @@ static int program_segment_alloc_map_copy_workingset(struct Env *e, struct Progr
 	uint8 *dst_ptr = (uint8 *) seg->virtual_address;
 
 	//copy program segment page from (seg->ptr_start) to (seg->virtual_address)
+	//(skipping the pages mapped to the program image itself, they're read-only)
 
 	LOG_STATMENT(cprintf("copying data to allocated area VA %x from source %x",dst_ptr,src_ptr));
 	while((uint32)dst_ptr < (ROUNDDOWN((uint32)vaddr,PAGE_SIZE) + (*allocated_pages)*PAGE_SIZE) &&
 			((uint32)dst_ptr< ((uint32)vaddr+ seg->size_in_file)) )
 	{
+		if (program_segment_image_frame(seg, ROUNDDOWN((uint32)dst_ptr, PAGE_SIZE)) != NULL)
+		{
+			uint32 skip = ROUNDUP((uint32)dst_ptr + 1, PAGE_SIZE) - (uint32)dst_ptr;
+			dst_ptr += skip ;
+			src_ptr += skip ;
+			continue;
+		}
 		*dst_ptr = *src_ptr ;
 		dst_ptr++ ;
 		src_ptr++ ;
@@ -921,6 +1078,26 @@ static int program_segment_alloc_map_copy_workingset(struct Env *e, struct Progr
 	return 0;
 }
 
+//
+// Returns the frame of the program image (embedded in the kernel) that holds the given page of the
+// segment if the page can be mapped straight to it, i.e. the image is laid out like the segment in
+// pages & no part of the page should be zero instead (the segment's tail after its file content).
+// Returns NULL if the page must be copied instead.
+//
+static struct FrameInfo* program_segment_image_frame(struct ProgramSegment* seg, uint32 virtual_address)
+{
+	uint32 seg_va = (uint32) seg->virtual_address;
+
+	if (((uint32)seg->ptr_start - seg_va) % PAGE_SIZE != 0)
+		return NULL;
+	if (virtual_address >= seg_va + seg->size_in_file)
+		return NULL;
+	if (virtual_address + PAGE_SIZE > seg_va + seg->size_in_file && seg->size_in_file != seg->size_in_memory)
+		return NULL;
+
+	return to_frame_info(STATIC_KERNEL_PHYSICAL_ADDRESS((uint32)seg->ptr_start - seg_va + virtual_address));
+}
+
 
 //==================================================
 // 4) DYNAMICALLY ALLOCATE SPACE FOR USER DIRECTORY:
@@ -1031,6 +1208,7 @@ void initialize_uheap_dynamic_allocator(struct Env* e, uint32 daStart, uint32 da
 	e->uheap_start = daStart;
 	e->uheap_segment_break = daStart;
 	e->uheap_hard_limit = daLimit;
+	e->uheap_vmas = NULL;
 	e->uheap_pages_count = (1 << (31 - __builtin_clz(pages_count))) * (1 + (((pages_count) & (pages_count-1)) > 0));
 	e->shared_id_directory = kmalloc(NUM_OF_UHEAP_PAGES * sizeof(uint32)); //KFREE When env free
 
@@ -1106,6 +1284,9 @@ void initialize_environment(struct Env* e, uint32* ptr_user_page_directory, unsi
 #if USE_KHEAP == 1
 	{
 		LIST_INIT(&(e->page_WS_list));
+		e->page_last_WS_element = NULL;
+		if (env_page_ws_alloc_slots(e) != 0)
+			panic("initialize_environment: no space for the working set of the env");
 	}
 #else
 	{
@@ -1163,6 +1344,16 @@ void initialize_environment(struct Env* e, uint32* ptr_user_page_directory, unsi
 	e->nPageIn = 0;
 	e->nPageOut = 0;
 	e->nNewPageAdded = 0;
+	e->nPrefetchedPages = 0;
+	e->nPageOutRequests = 0;
+
+	e->readaheadNextVA = 0;
+	e->readaheadWindow = 1;
+	e->readaheadBuffer = NULL;
+
+	e->pffLastSampleClock = 0;
+	e->pffLastFaults = 0;
+	e->pffPendingWSSize = 0;
 
 	//e->shared_free_address = USER_SHARED_MEM_START;
 
@@ -1269,6 +1460,7 @@ struct ProgramSegment* PROGRAM_SEGMENT_NEXT(struct ProgramSegment* seg, uint8* p
 		(*seg).size_in_memory =  ph[index].p_memsz;
 		(*seg).size_in_file = ph[index].p_filesz;
 		(*seg).virtual_address = (uint8*)ph[index].p_va;
+		(*seg).flags = ph[index].p_flags;
 		return seg;
 	}
 	return 0;
@@ -1296,6 +1488,7 @@ struct ProgramSegment PROGRAM_SEGMENT_FIRST( uint8* ptr_program_start)
 		(seg).size_in_memory =  ph[index].p_memsz;
 		(seg).size_in_file = ph[index].p_filesz;
 		(seg).virtual_address = (uint8*)ph[index].p_va;
+		(seg).flags = ph[index].p_flags;
 		return seg;
 	}
 	seg.segment_id = -1;
@@ -1318,8 +1511,11 @@ void cleanup_buffers(struct Env* e)
 
 	acquire_spinlock(&MemFrameLists.mfllock);
 	{
-		LIST_FOREACH(ptr_fi, &MemFrameLists.modified_frame_list)
+		struct FrameInfo *ptr_next = NULL ;
+		for (ptr_fi = LIST_FIRST(&MemFrameLists.modified_frame_list); ptr_fi != NULL; ptr_fi = ptr_next)
 		{
+			//free_frame() moves it to the free frame list, so keep its next in the modified list first
+			ptr_next = LIST_NEXT(ptr_fi);
 			if(ptr_fi->proc == e)
 			{
 				pt_clear_page_table_entry(ptr_fi->proc->env_page_directory,ptr_fi->bufferedVA);
@@ -1334,6 +1530,20 @@ void cleanup_buffers(struct Env* e)
 				//cprintf("==================\n");
 			}
 		}
+
+		//the ones being written by a flush are freed by it
+		drop_writing_frames(e);
+
+		//clean buffered frames of this env stay in the free frame list, just forget their owner
+		LIST_FOREACH(ptr_fi, &MemFrameLists.free_frame_list)
+		{
+			if(ptr_fi->isBuffered && ptr_fi->proc == e)
+			{
+				ptr_fi->isBuffered = 0;
+				ptr_fi->proc = NULL;
+				ptr_fi->bufferedVA = 0;
+			}
+		}
 	}
 	release_spinlock(&MemFrameLists.mfllock);
 
@@ -25,8 +25,12 @@ int envid2env(int32  envid, struct Env **env_store, bool checkperm);
 void env_init(void);
 /*Create new environment, initialize it, load the EXE into its memory and adjust its address space*/
 struct Env* env_create(char* user_program_name, unsigned int page_WS_size, unsigned int LRU_second_list_size, unsigned int percent_WS_pages_to_remove);
+/*Create a copy-on-write child of the given environment (as NEW, to be run by sched_run_env)*/
+struct Env* env_fork(struct Env* parent);
 /*Free (delete) the environment by freeing its allocated memory and other resources (if any)*/
 void env_free(struct Env *e);
+/*Tell the user heaps of all environments that the free frames became scarce*/
+void signal_memory_pressure(void);
 
 ///===================================================================================
 /*2024*/
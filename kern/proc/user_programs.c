@@ -37,6 +37,13 @@ struct UserProgramInfo userPrograms[] = {
 		{ "tpr2", "tests page replacement (handling new stack and modified pages)", PTR_START_OF(tst_page_replacement_stack)},
 		{ "tnclock1", "Tests page replacement (nth clock algorithm - NORMAL version)", PTR_START_OF(tst_page_replacement_nthclock_1)},
 		{ "tnclock2", "Tests page replacement (nth clock algorithm - MODIFIED version)", PTR_START_OF(tst_page_replacement_nthclock_2)},
+		{ "tgclock1", "Tests page replacement (global clock: the idle pages of an env are taken for the faults of another)", PTR_START_OF(tst_page_replacement_global_1)},
+		{ "tgclock1_slave", "Slave program of tgclock1", PTR_START_OF(tst_page_replacement_global_1_slave)},
+		{ "tgclock2", "Tests page replacement (global clock: the idle pages of a shared object are evicted from all its sharers)", PTR_START_OF(tst_page_replacement_global_2)},
+		{ "tgclock2_slave", "Slave program of tgclock2", PTR_START_OF(tst_page_replacement_global_2_slave)},
+		{ "tbuff", "Tests page replacement (buffering: an evicted page takes its frame back on a fault)", PTR_START_OF(tst_page_replacement_buffering)},
+		{ "tpff", "Tests page replacement (page fault frequency: the WS grows while thrashing & shrinks while idle)", PTR_START_OF(tst_page_replacement_pff)},
+		{ "tbatch", "Tests page replacement (batch eviction: a full WS gives up a group of pages written back together)", PTR_START_OF(tst_page_replacement_batch)},
 
 		/*TESTING 2023*/
 		//[1] READY MADE TESTS
@@ -63,6 +70,9 @@ struct UserProgramInfo userPrograms[] = {
 		{ "tm1", "tests malloc (1): start address & allocated frames", PTR_START_OF(tst_malloc_1)},
 		{ "tm2", "tests malloc (2): writing & reading values in allocated spaces", PTR_START_OF(tst_malloc_2)},
 		{ "tm3", "tests malloc (3): check memory allocation and WS after accessing", PTR_START_OF(tst_malloc_3)},
+		{ "tr1", "tests realloc (1): in place & moved page allocations", PTR_START_OF(tst_realloc_1)},
+		{ "tht", "tests heap trace: records a workload & exports it for the replaytrace command", PTR_START_OF(tst_heap_trace)},
+		{ "tfork", "tests fork: the child gets a copy-on-write copy of the parent memory", PTR_START_OF(tst_fork)},
 		//USER DYNAMIC DEALLOCATION USING LARGE SIZES
 		{ "tf1", "tests free (1): freeing tables, WS and page file [placement case]", PTR_START_OF(tst_free_1)},
 		{ "tf1_slave1", "tests free (1) slave1: try accessing values in freed spaces", PTR_START_OF(tst_free_1_slave1)},
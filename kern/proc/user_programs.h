@@ -88,6 +88,9 @@ DECLARE_START_OF(tst_free_3);
 DECLARE_START_OF(tst_malloc_1);
 DECLARE_START_OF(tst_malloc_2);
 DECLARE_START_OF(tst_malloc_3);
+DECLARE_START_OF(tst_realloc_1);
+DECLARE_START_OF(tst_heap_trace);
+DECLARE_START_OF(tst_fork);
 DECLARE_START_OF(tst_first_fit_1);
 DECLARE_START_OF(tst_first_fit_2);
 DECLARE_START_OF(tst_first_fit_3);
@@ -138,5 +141,12 @@ DECLARE_START_OF(tst_page_replacement_alloc);
 DECLARE_START_OF(tst_page_replacement_nthclock_1);
 DECLARE_START_OF(tst_page_replacement_nthclock_2);
 DECLARE_START_OF(tst_page_replacement_stack);
+DECLARE_START_OF(tst_page_replacement_global_1);
+DECLARE_START_OF(tst_page_replacement_global_1_slave);
+DECLARE_START_OF(tst_page_replacement_global_2);
+DECLARE_START_OF(tst_page_replacement_global_2_slave);
+DECLARE_START_OF(tst_page_replacement_buffering);
+DECLARE_START_OF(tst_page_replacement_pff);
+DECLARE_START_OF(tst_page_replacement_batch);
 
 #endif /* KERN_USER_PROGRAMS_H_ */
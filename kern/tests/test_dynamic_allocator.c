@@ -1217,6 +1217,154 @@ void test_free_block_NF()
 	panic("not implemented");
 }
 
+int check_bins_size(uint32 expectedNumOfFreeBlks)
+{
+	uint32 actualNumOfFreeBlks = 0;
+	for (int i = 0; i < DA_NUM_BINS; ++i)
+	{
+		struct BlockElement* blk;
+		LIST_FOREACH(blk, &freeBlocksBins[i])
+		{
+			uint32 blkSize = get_block_size(blk);
+			if (!is_free_block(blk) || blkSize < (1 << i) || (i < DA_NUM_BINS - 1 && blkSize >= (1 << (i+1))))
+			{
+				cprintf("freeBlocksBins[%d]: block %x of size %d is in a wrong bin\n", i, blk, blkSize);
+				return 0;
+			}
+		}
+		if (((freeBinsBitmap >> i) & 1) != (LIST_SIZE(&freeBlocksBins[i]) > 0))
+		{
+			cprintf("freeBinsBitmap: wrong bit %d\n", i);
+			return 0;
+		}
+		actualNumOfFreeBlks += LIST_SIZE(&freeBlocksBins[i]);
+	}
+	if (actualNumOfFreeBlks != expectedNumOfFreeBlks)
+	{
+		cprintf("freeBlocksBins: wrong number of free blocks! expected %d, actual %d\n", expectedNumOfFreeBlks, actualNumOfFreeBlks);
+		return 0;
+	}
+	return 1;
+}
+
+void test_alloc_block_SF()
+{
+#if USE_KHEAP
+	panic("test_alloc_block_SF: the kernel heap should be disabled. make sure USE_KHEAP = 0");
+	return;
+#endif
+
+	int eval = 0;
+	bool is_correct = 1;
+	uint32 initAllocatedSpace = 3*Mega;
+	initialize_dynamic_allocator(KERNEL_HEAP_START, initAllocatedSpace);
+
+	//====================================================================//
+	/*SF ALLOC Scenario 1: Allocate set of blocks with different sizes [all should fit]*/
+	cprintf("	1: Try to allocate set of blocks with different sizes [all should fit]\n\n") ;
+	void* expectedVA = (void*)(KERNEL_HEAP_START + 2*sizeof(int));
+	int idx = 0;
+	for (int i = 0; i < numOfAllocs; ++i)
+	{
+		for (int j = 0; j < allocCntPerSize / 4; ++j, ++idx)
+		{
+			uint32 actualSize = allocSizes[i] - sizeOfMetaData;
+			startVAs[idx] = alloc_block(actualSize, DA_SF);
+			if (check_block(startVAs[idx], expectedVA, allocSizes[i], 1) == 0)
+			{
+				is_correct = 0;
+				cprintf("alloc_block_SF #1.%d: Failed\n", idx);
+				break;
+			}
+			*(startVAs[idx]) = idx ;
+			expectedVA += allocSizes[i];
+		}
+		if (!is_correct) break;
+	}
+	//all allocations are taken from the initial free block
+	if (is_correct && check_bins_size(1) == 0)
+	{
+		is_correct = 0;
+	}
+	if (is_correct)
+	{
+		eval += 20;
+	}
+
+	//====================================================================//
+	/*SF ALLOC Scenario 2: Free every other block [no coalescing]*/
+	cprintf("	2: Free every other block\n\n") ;
+	is_correct = 1;
+	for (int i = 0; i < idx; i += 2)
+	{
+		free_block(startVAs[i]);
+	}
+	if (check_bins_size(1 + (idx+1)/2) == 0)
+	{
+		is_correct = 0;
+	}
+	if (is_correct)
+	{
+		eval += 20;
+	}
+
+	//====================================================================//
+	/*SF ALLOC Scenario 3: Re-allocate blocks with the same sizes [should be served from the freed blocks]*/
+	cprintf("	3: Re-allocate blocks with the sizes of the freed ones\n\n") ;
+	is_correct = 1;
+	void* daLimit = (void*)(KERNEL_HEAP_START + initAllocatedSpace);
+	for (int i = 0; i < idx; i += 2)
+	{
+		uint32 blkSize = allocSizes[i / (allocCntPerSize / 4)];
+		startVAs[i] = alloc_block(blkSize - sizeOfMetaData, DA_SF);
+		if (startVAs[i] == NULL || (void*)startVAs[i] >= daLimit || is_free_block(startVAs[i]))
+		{
+			is_correct = 0;
+			cprintf("alloc_block_SF #3.%d: Failed\n", i);
+			break;
+		}
+		*(startVAs[i]) = i ;
+	}
+	for (int i = 1; i < idx && is_correct; i += 2)
+	{
+		if (*(startVAs[i]) != i)
+		{
+			is_correct = 0;
+			cprintf("alloc_block_SF #3: block %d is corrupted\n", i);
+		}
+	}
+	if (is_correct)
+	{
+		eval += 30;
+	}
+
+	//====================================================================//
+	/*SF ALLOC Scenario 4: Free all blocks [all should be coalesced into a single block]*/
+	cprintf("	4: Free all blocks\n\n") ;
+	is_correct = 1;
+	for (int i = 0; i < idx; ++i)
+	{
+		free_block(startVAs[i]);
+	}
+	if (check_bins_size(1) == 0)
+	{
+		is_correct = 0;
+	}
+	//switching back to an address-ordered strategy should rebuild the free list
+	void* va = alloc_block(kilo - sizeOfMetaData, DA_FF);
+	if (check_block(va, (void*)(KERNEL_HEAP_START + 2*sizeof(int)), kilo, 1) == 0 || check_list_size(1) == 0)
+	{
+		is_correct = 0;
+		cprintf("alloc_block_SF #4: Failed\n");
+	}
+	if (is_correct)
+	{
+		eval += 30;
+	}
+
+	cprintf("[AUTO_GR@DING_PARTIAL]%d\n", eval);
+}
+
 void test_realloc_block_FF()
 {
 #if USE_KHEAP
@@ -2058,4 +2206,169 @@ void test_realloc_block_FF_COMPLETE()
 }
 
 
+//checks a block in the layout without allocated footers (daAllocatedFooter = 0):
+//its header, the footer (if free) & the "previous block is free" bit in the header of the next block
+int check_block_no_footer(void* va, void* expectedVA, uint32 expectedSize, uint8 expectedFlag)
+{
+	if(va != expectedVA)
+	{
+		cprintf("wrong block address. Expected %x, Actual %x\n", expectedVA, va);
+		return 0;
+	}
+	uint32 header = *((uint32*)va-1) & ~DA_PREV_FREE_FLAG;
+	uint32 next_header = *((uint32*)(va + expectedSize) - 1);
+	if(header != (expectedSize | expectedFlag) || ((next_header & DA_PREV_FREE_FLAG) != 0) != (expectedFlag == 0))
+	{
+		cprintf("wrong header data. Expected %d, Actual H:%d (next H:%d)\n", expectedSize | expectedFlag, header, next_header);
+		return 0;
+	}
+	if(expectedFlag == 0 && *((uint32*)(va + expectedSize - 8)) != expectedSize)
+	{
+		cprintf("wrong footer data. Expected %d, Actual F:%d\n", expectedSize, *((uint32*)(va + expectedSize - 8)));
+		return 0;
+	}
+	return 1;
+}
+
+void test_alloc_free_no_footer()
+{
+#if USE_KHEAP
+	panic("test_alloc_free_no_footer: the kernel heap should be disabled. make sure USE_KHEAP = 0");
+	return;
+#endif
+
+	//requested sizes & the sizes of their blocks (4 bytes of meta data, multiple of 4, fits a free block)
+	uint32 reqSizes[] = {20, 8, 30, 1*kilo - 4, 2*kilo};
+	uint32 blkSizes[] = {24, 16, 36, 1*kilo, 2*kilo + 4};
+	int numOfSizes = sizeof(reqSizes) / sizeof(reqSizes[0]);
+
+	int eval = 0;
+	bool is_correct = 1;
+	uint32 initAllocatedSpace = 3*Mega;
+	set_da_allocated_footer(0);
+	initialize_dynamic_allocator(KERNEL_HEAP_START, initAllocatedSpace);
+
+	//====================================================================//
+	/*Scenario 1: Allocate set of blocks with different sizes [contiguous, 4 bytes of meta data each]*/
+	cprintf("	1: Try to allocate set of blocks with different sizes\n\n") ;
+	void* expectedVA = (void*)(KERNEL_HEAP_START + 2*sizeof(int));
+	int idx = 0;
+	for (int i = 0; i < numOfSizes && is_correct; ++i)
+	{
+		for (int j = 0; j < allocCntPerSize; ++j, ++idx)
+		{
+			startVAs[idx] = alloc_block_FF(reqSizes[i]);
+			if (check_block_no_footer(startVAs[idx], expectedVA, blkSizes[i], 1) == 0)
+			{
+				is_correct = 0;
+				cprintf("test_alloc_free_no_footer #1.%d: Failed\n", idx);
+				break;
+			}
+			*(startVAs[idx]) = idx ;
+			expectedVA += blkSizes[i];
+		}
+	}
+	//the rest of the space is a single free block just before the END block
+	uint32 remainingSize = KERNEL_HEAP_START + initAllocatedSpace - (uint32)expectedVA;
+	if (is_correct && (check_list_size(1) == 0 || check_block_no_footer(LIST_FIRST(&freeBlocksList), expectedVA, remainingSize, 0) == 0))
+	{
+		is_correct = 0;
+		cprintf("test_alloc_free_no_footer #1: wrong free block after the allocations\n");
+	}
+	if (is_correct)
+	{
+		eval += 25;
+	}
+
+	//====================================================================//
+	/*Scenario 2: Free every other block [no coalescing, the next blocks should know they follow a free block]*/
+	cprintf("	2: Free every other block\n\n") ;
+	is_correct = 1;
+	for (int i = 1; i < idx - 1; i += 2)
+	{
+		free_block(startVAs[i]);
+	}
+	for (int i = 0; i < idx && is_correct; ++i)
+	{
+		bool isAllocated = (i % 2 == 0 || i == idx - 1);
+		if (check_block_no_footer(startVAs[i], startVAs[i], blkSizes[i / allocCntPerSize], isAllocated) == 0 || (isAllocated && *(startVAs[i]) != i))
+		{
+			is_correct = 0;
+			cprintf("test_alloc_free_no_footer #2.%d: Failed\n", i);
+		}
+	}
+	if (is_correct && check_list_size(1 + (idx - 1) / 2) == 0)
+	{
+		is_correct = 0;
+	}
+	if (is_correct)
+	{
+		eval += 25;
+	}
+
+	//====================================================================//
+	/*Scenario 3: Free the rest [should be coalesced with both neighbours by the "previous block is free" bit]*/
+	cprintf("	3: Free the rest of the blocks\n\n") ;
+	is_correct = 1;
+	for (int i = 0; i < idx; ++i)
+	{
+		if (i % 2 == 0 || i == idx - 1)
+			free_block(startVAs[i]);
+	}
+	void* firstVA = (void*)(KERNEL_HEAP_START + 2*sizeof(int));
+	if (check_list_size(1) == 0 || check_block_no_footer(LIST_FIRST(&freeBlocksList), firstVA, initAllocatedSpace - 2*sizeof(int), 0) == 0)
+	{
+		is_correct = 0;
+		cprintf("test_alloc_free_no_footer #3: Failed\n");
+	}
+	if (is_correct)
+	{
+		eval += 25;
+	}
+
+	//====================================================================//
+	/*Scenario 4: Realloc [expand into the next free block, shrink in place, keep the contents]*/
+	cprintf("	4: Reallocate a block\n\n") ;
+	is_correct = 1;
+	short* va1 = alloc_block_FF(100);
+	short* va2 = alloc_block_FF(100);
+	for (int i = 0; i < 50; ++i) va1[i] = i;
+	free_block(va2);
+	short* va = realloc_block_FF(va1, 300);
+	if (check_block_no_footer(va, va1, 304, 1) == 0)
+	{
+		is_correct = 0;
+		cprintf("test_alloc_free_no_footer #4.1: expected to expand in place\n");
+	}
+	va = realloc_block_FF(va1, 40);
+	if (is_correct && check_block_no_footer(va, va1, 44, 1) == 0)
+	{
+		is_correct = 0;
+		cprintf("test_alloc_free_no_footer #4.2: expected to shrink in place\n");
+	}
+	for (int i = 0; i < 20 && is_correct; ++i)
+	{
+		if (va1[i] != i)
+		{
+			is_correct = 0;
+			cprintf("test_alloc_free_no_footer #4.3: wrong contents after realloc\n");
+		}
+	}
+	free_block(va1);
+	if (is_correct && (check_list_size(1) == 0 || check_block_no_footer(LIST_FIRST(&freeBlocksList), firstVA, initAllocatedSpace - 2*sizeof(int), 0) == 0))
+	{
+		is_correct = 0;
+		cprintf("test_alloc_free_no_footer #4.4: Failed\n");
+	}
+	if (is_correct)
+	{
+		eval += 25;
+	}
+
+	//the other tests check the default layout
+	set_da_allocated_footer(DA_ALLOCATED_FOOTER);
+
+	cprintf("[AUTO_GR@DING_PARTIAL]%d\n", eval);
+}
+
 /********************Helper Functions***************************/
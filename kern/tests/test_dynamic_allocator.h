@@ -16,11 +16,13 @@ int  test_initialize_dynamic_allocator();
 void test_alloc_block_FF();
 void test_alloc_block_BF();
 void test_alloc_block_NF();
+void test_alloc_block_SF();
 void test_free_block_FF();
 void test_free_block_BF();
 void test_free_block_NF();
 void test_realloc_block_FF_COMPLETE();
 void test_realloc_block_FF();
+void test_alloc_free_no_footer();
 
 
 #endif /* KERN_TESTS_TEST_DYNAMIC_ALLOCATOR_H_ */
@@ -3,6 +3,7 @@
 #include <inc/memlayout.h>
 #include <inc/queue.h>
 #include <inc/dynamic_allocator.h>
+#include <inc/medium_allocator.h>
 #include <kern/cpu/sched.h>
 #include <kern/disk/pagefile_manager.h>
 #include "../mem/kheap.h"
@@ -2374,4 +2375,127 @@ int test_krealloc_FF3()
 
 }
 
+//krealloc that can't get the frames to expand in place: it should fail & leave the heap as it was
+int test_krealloc_nomem()
+{
+	cprintf("==============================================\n");
+	cprintf("MAKE SURE to have a FRESH RUN for this test\n(i.e. don't run any program/test before it)\n");
+	cprintf("==============================================\n");
+
+	//[1] a page allocation followed by a free run
+	uint32 size = 128*kilo;		//above the medium objects, so it's served by the page allocator
+	char* ptr = kmalloc(size);
+	char* next = kmalloc(size);
+	if (ptr == NULL || next == NULL) panic("test_krealloc_nomem: kmalloc failed");
+	for (int i = 0; i < size; i += PAGE_SIZE)
+		ptr[i] = (char)(i / PAGE_SIZE);
+	kfree(next);
+
+	uint32 maxFreeRun = get_free_value(1);
+	uint32 nextFreeRun = get_free_value(TREE_get_node(address_to_page(ptr) + size / PAGE_SIZE));
+	if (nextFreeRun < size / PAGE_SIZE) panic("test_krealloc_nomem: expected a free run after the allocation");
+
+	//[2] take all the free frames, then try to expand in place into the free run
+	struct FrameInfo_List takenFrames;
+	LIST_INIT(&takenFrames);
+	acquire_spinlock(&MemFrameLists.mfllock);
+	while (LIST_SIZE(&MemFrameLists.free_frame_list) > 0)
+	{
+		struct FrameInfo* ptr_frame_info;
+		allocate_frame(&ptr_frame_info);
+		LIST_INSERT_HEAD(&takenFrames, ptr_frame_info);
+	}
+	release_spinlock(&MemFrameLists.mfllock);
+
+	char* ptr2 = krealloc(ptr, 2*size);
+
+	//[3] give the frames back before checking (panic may need them)
+	acquire_spinlock(&MemFrameLists.mfllock);
+	while (LIST_SIZE(&takenFrames) > 0)
+	{
+		struct FrameInfo* ptr_frame_info = LIST_FIRST(&takenFrames);
+		LIST_REMOVE(&takenFrames, ptr_frame_info);
+		free_frame(ptr_frame_info);
+	}
+	release_spinlock(&MemFrameLists.mfllock);
+
+	if (ptr2 != NULL) panic("test_krealloc_nomem: krealloc should fail when there are no free frames");
+	if (get_free_value(1) != maxFreeRun) panic("test_krealloc_nomem: the largest free run changed from %d to %d pages", maxFreeRun, get_free_value(1));
+	if (get_free_value(TREE_get_node(address_to_page(ptr) + size / PAGE_SIZE)) != nextFreeRun)
+		panic("test_krealloc_nomem: the free run after the allocation is lost");
+	for (int i = 0; i < size; i += PAGE_SIZE)
+		if (ptr[i] != (char)(i / PAGE_SIZE)) panic("test_krealloc_nomem: the allocation is corrupted");
+
+	//[4] with the frames back, the same krealloc expands in place
+	ptr2 = krealloc(ptr, 2*size);
+	if (ptr2 != ptr) panic("test_krealloc_nomem: expected to expand in place @ %x, found %x", ptr, ptr2);
+	kfree(ptr2);
+	if (get_free_value(1) != maxFreeRun) panic("test_krealloc_nomem: the free pages are not merged back");
+
+	cprintf("\nCongratulations!! test krealloc with no free frames completed successfully.\n");
+	return 1;
+}
+
+
+static int check_medium_contents(char* ptr, uint32 size, char val)
+{
+	for (int i = 0; i < size; i += 512)
+		if (ptr[i] != val) return 0;
+	return ptr[size-1] == val;
+}
+
+int test_kmedium()
+{
+	bool mediumWasOn = medium_objects_enabled();
+	set_medium_objects(1);
+
+	//[1] objects of one class are packed into spans, without overlapping
+	uint32 size = 3*kilo;
+	char* ptrs[8];
+	for (int i = 0; i < 8; i++)
+	{
+		ptrs[i] = kmalloc(size);
+		if (ptrs[i] == NULL) panic("test_kmedium: kmalloc failed");
+		if (!is_medium_object(ptrs[i])) panic("test_kmedium: %d KB should be a medium object", size/kilo);
+		if (medium_object_size(ptrs[i]) < size) panic("test_kmedium: object of %d bytes is smaller than %d", medium_object_size(ptrs[i]), size);
+		memset(ptrs[i], i+1, size);
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		for (int j = i+1; j < 8; j++)
+			if (ptrs[i] < ptrs[j] + size && ptrs[j] < ptrs[i] + size)
+				panic("test_kmedium: objects @ %x & %x overlap", ptrs[i], ptrs[j]);
+		if (!check_medium_contents(ptrs[i], size, i+1)) panic("test_kmedium: object %d is corrupted", i);
+	}
+
+	//[2] krealloc within the same class keeps the object in place
+	char* ptr = krealloc(ptrs[0], size - 100);
+	if (ptr != ptrs[0]) panic("test_kmedium: krealloc in the same class should stay @ %x, found %x", ptrs[0], ptr);
+
+	//[3] krealloc to a bigger class moves the object to another span
+	ptr = krealloc(ptrs[1], 18*kilo);
+	if (ptr == NULL || !is_medium_object(ptr)) panic("test_kmedium: krealloc to 18 KB should give a medium object");
+	if (!check_medium_contents(ptr, size, 2)) panic("test_kmedium: krealloc to 18 KB lost the contents");
+	ptrs[1] = ptr;
+
+	//[4] krealloc above the medium objects moves it to the page allocator, & back
+	ptr = krealloc(ptrs[2], 128*kilo);
+	if (ptr == NULL || is_medium_object(ptr) || (uint32)ptr % PAGE_SIZE != 0) panic("test_kmedium: krealloc to 128 KB should give whole pages");
+	if (!check_medium_contents(ptr, size, 3)) panic("test_kmedium: krealloc to 128 KB lost the contents");
+	ptr = krealloc(ptr, 5*kilo);
+	if (ptr == NULL || !is_medium_object(ptr)) panic("test_kmedium: krealloc back to 5 KB should give a medium object");
+	if (!check_medium_contents(ptr, size, 3)) panic("test_kmedium: krealloc back to 5 KB lost the contents");
+	ptrs[2] = ptr;
+
+	//[5] free them all: the freed slots are reused
+	for (int i = 0; i < 8; i++)
+		kfree(ptrs[i]);
+	ptr = kmalloc(size);
+	if (ptr == NULL || !is_medium_object(ptr)) panic("test_kmedium: kmalloc after kfree should give a medium object");
+	kfree(ptr);
+
+	set_medium_objects(mediumWasOn);
+	cprintf("\nCongratulations!! test kmalloc/kfree/krealloc of medium objects completed successfully.\n");
+	return 1;
+}
 
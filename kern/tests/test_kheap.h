@@ -35,6 +35,8 @@
  int test_krealloc_FF1();
  int test_krealloc_FF2();
  int test_krealloc_FF3();
+ int test_krealloc_nomem();
+ int test_kmedium();
  int check_block(void* va, void* expectedVA, uint32 expectedSize, uint8 expectedFlag);
 
  //2022
@@ -229,6 +229,11 @@ int tst_dyn_alloc(int number_of_arguments, char **arguments)
 	{
 		test_alloc_block_NF();
 	}
+	// Test 4.1 Example for alloc_block_SF: tstdynalloc allocSF
+	else if(strcmp(arguments[1], "allocsf") == 0)
+	{
+		test_alloc_block_SF();
+	}
 	// Test 5 Example for free_block: tstdynalloc freeFF
 	else if(strcmp(arguments[1], "freeff") == 0)
 	{
@@ -250,6 +255,11 @@ int tst_dyn_alloc(int number_of_arguments, char **arguments)
 		//test_realloc_block_FF();
 		test_realloc_block_FF_COMPLETE();
 	}
+	// Test 9 Example for the layout without allocated footers: tstdynalloc nofooter
+	else if(strcmp(arguments[1], "nofooter") == 0)
+	{
+		test_alloc_free_no_footer();
+	}
 	return 0;
 }
 
@@ -487,6 +497,16 @@ int tst_kheap(int number_of_arguments, char **arguments)
 	{
 		test_ksbrk();
 	}
+	// Test 7-kreallocnomem: tst kheap FF kreallocnomem
+	else if (strcmp(arguments[2], "kreallocnomem") == 0)
+	{
+		test_krealloc_nomem();
+	}
+	// Test 8-kmedium: tst kheap FF kmedium
+	else if (strcmp(arguments[2], "kmedium") == 0)
+	{
+		test_kmedium();
+	}
 	return 0;
 }
 
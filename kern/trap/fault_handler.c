@@ -11,6 +11,10 @@
 #include <kern/cpu/cpu.h>
 #include <kern/disk/pagefile_manager.h>
 #include <kern/mem/memory_manager.h>
+#include <kern/mem/kheap.h>
+#include <kern/mem/vma.h>
+#include <kern/mem/rmap.h>
+#include <kern/mem/shared_memory_manager.h>
 
 #define min(a, b) (a < b ? a : b)
 
@@ -32,6 +36,7 @@ void setPageReplacmentAlgorithmFIFO(){_PageRepAlgoType = PG_REP_FIFO;}
 void setPageReplacmentAlgorithmModifiedCLOCK(){_PageRepAlgoType = PG_REP_MODIFIEDCLOCK;}
 /*2018*/ void setPageReplacmentAlgorithmDynamicLocal(){_PageRepAlgoType = PG_REP_DYNAMIC_LOCAL;}
 /*2021*/ void setPageReplacmentAlgorithmNchanceCLOCK(int PageWSMaxSweeps){_PageRepAlgoType = PG_REP_NchanceCLOCK;  page_WS_max_sweeps = PageWSMaxSweeps;}
+void setPageReplacmentAlgorithmGlobalNchanceCLOCK(int PageWSMaxSweeps, uint32 maxWSSize, uint32 WSGrowthStep){_PageRepAlgoType = PG_REP_GLOBAL_NchanceCLOCK;  page_WS_max_sweeps = PageWSMaxSweeps;  global_WS_max_size = maxWSSize;  global_WS_growth_step = WSGrowthStep;}
 
 //2020
 uint32 isPageReplacmentAlgorithmLRU(int LRU_TYPE){return _PageRepAlgoType == LRU_TYPE ? 1 : 0;}
@@ -40,6 +45,7 @@ uint32 isPageReplacmentAlgorithmFIFO(){if(_PageRepAlgoType == PG_REP_FIFO) retur
 uint32 isPageReplacmentAlgorithmModifiedCLOCK(){if(_PageRepAlgoType == PG_REP_MODIFIEDCLOCK) return 1; return 0;}
 /*2018*/ uint32 isPageReplacmentAlgorithmDynamicLocal(){if(_PageRepAlgoType == PG_REP_DYNAMIC_LOCAL) return 1; return 0;}
 /*2021*/ uint32 isPageReplacmentAlgorithmNchanceCLOCK(){if(_PageRepAlgoType == PG_REP_NchanceCLOCK) return 1; return 0;}
+uint32 isPageReplacmentAlgorithmGlobalNchanceCLOCK(){if(_PageRepAlgoType == PG_REP_GLOBAL_NchanceCLOCK) return 1; return 0;}
 
 //===============================
 // PAGE BUFFERING
@@ -162,7 +168,6 @@ void fault_handler(struct Trapframe *tf)
 			}
 
 			uint32 present = perms & PERM_PRESENT;
-			uint32 marked  = perms & MARKING_BIT;
 			uint32 writable = perms & PERM_WRITEABLE;
 			uint32 user = perms & PERM_USER;
 
@@ -171,12 +176,12 @@ void fault_handler(struct Trapframe *tf)
 				env_exit();
 			}
 
-			if(!marked && fault_va >= USER_HEAP_START && fault_va < USER_HEAP_MAX){
-				cprintf("va=%x Accessing an unmarked page in userheap\n", fault_va);
+			if(fault_va >= USER_HEAP_START && fault_va < USER_HEAP_MAX && !(perms & PERM_SHARE_OUT) && vma_find(faulted_env, fault_va) == NULL){
+				cprintf("va=%x Accessing an unreserved page in userheap\n", fault_va);
 				env_exit();
 			}
 
-			if (present & !writable){
+			if (present && !writable && !(perms & PERM_COW)){
 				cprintf("va=%x Trying to write in a read-only page\n", fault_va);
 				env_exit();
 			}
@@ -184,8 +189,16 @@ void fault_handler(struct Trapframe *tf)
 			/*============================================================================================*/
 		}
 
-		/*2022: Check if fault due to Access Rights */
 		int perms = pt_get_page_permissions(faulted_env->env_page_directory, fault_va);
+		if ((perms & PERM_PRESENT) && (perms & PERM_COW))
+		{
+			//a write to a copy-on-write page: it's not a page fault, the page is already in the WS
+			cow_fault_handler(faulted_env, fault_va);
+			tlbflush();
+			return;
+		}
+
+		/*2022: Check if fault due to Access Rights */
 		if (perms & PERM_PRESENT)
 			panic("Page @va=%x is exist! page fault due to violation of ACCESS RIGHTS\n", fault_va) ;
 		/*============================================================================================*/
@@ -194,11 +207,25 @@ void fault_handler(struct Trapframe *tf)
 		// we have normal page fault =============================================================
 		faulted_env->pageFaultsCounter ++ ;
 
+		//resize the WS as picked by the PFF sampling of the clock interrupt (before placing the page),
+		//only on a fault from user mode [not in the middle of a kernel operation]
+		if (faulted_env->pffPendingWSSize != 0 && (tf->tf_cs & 3) == 3)
+			env_page_ws_pff_apply(faulted_env);
+
 		//		cprintf("[%08s] user PAGE fault va %08x\n", curenv->prog_name, fault_va);
 		//		cprintf("\nPage working set BEFORE fault handler...\n");
 		//		env_page_ws_print(curenv);
 
-		if(isBufferingEnabled())
+		if (perms & PERM_SHARE_OUT)
+		{
+			//a page of a shared object whose frame is evicted (it's not in the WS of any of its sharers)
+			if (share_page_fault(faulted_env, fault_va) != 0)
+			{
+				cprintf("va=%x is not in a shared object\n", fault_va);
+				env_exit();
+			}
+		}
+		else if(isBufferingEnabled())
 		{
 			__page_fault_handler_with_buffering(faulted_env, fault_va);
 		}
@@ -242,23 +269,33 @@ void table_fault_handler(struct Env * curenv, uint32 fault_va)
 // [3] PAGE FAULT HANDLER:
 //=========================
 
-void replacePage(struct Env* faulted_env, uint32 fault_va){
+//Bring the faulted page into a frame: its buffered frame if it still has one (no disk I/O),
+//otherwise a new frame filled from the page file, or from "src" if it was already read ahead
+static struct FrameInfo* place_page(struct Env* faulted_env, uint32 fault_va, void* src){
 
-	uint32 old_va = faulted_env->page_last_WS_element->virtual_address;
-	uint32* env_page_directory = faulted_env->env_page_directory;
-	uint32* ptr_page_table;
+	struct FrameInfo *frame_info = reclaim_buffered_page(faulted_env, fault_va);
+	if(frame_info != NULL)
+		return frame_info;
 
-	struct FrameInfo *frame_info = get_frame_info(env_page_directory, old_va, &ptr_page_table);
-	uint32 perms = pt_get_page_permissions(env_page_directory, old_va);
-
-	if((perms & PERM_MODIFIED) == PERM_MODIFIED){
-		 pf_update_env_page(faulted_env, old_va, frame_info);
+	//a program image page is mapped to the (shared) image frame itself, copy-on-write if it's writable
+	uint8 copyOnWrite;
+	frame_info = pf_get_env_image_page(faulted_env, fault_va, &copyOnWrite);
+	if(frame_info != NULL){
+		map_frame(faulted_env->env_page_directory, frame_info, fault_va, PERM_USER | (copyOnWrite ? PERM_COW : 0));
+		return frame_info;
 	}
 
-	unmap_frame(env_page_directory, old_va);
-
 	allocate_frame(&frame_info);
     map_frame(faulted_env->env_page_directory, frame_info, fault_va, PERM_WRITEABLE | PERM_USER);
+
+	if(src != NULL){
+		//(user frames have no kernel mapping when the kernel heap is used) the page is copied through its
+		//own mapping, then left unreferenced & unmodified as the read ahead pages are not accessed yet
+		memcpy((void*)ROUNDDOWN(fault_va, PAGE_SIZE), src, PAGE_SIZE);
+		pt_set_page_permissions(faulted_env->env_page_directory, fault_va, 0, PERM_USED | PERM_MODIFIED);
+		return frame_info;
+	}
+
 	int ret = pf_read_env_page(faulted_env, (void*)fault_va);
 
 	if(ret == E_PAGE_NOT_EXIST_IN_PF){
@@ -268,15 +305,112 @@ void replacePage(struct Env* faulted_env, uint32 fault_va){
 			cprintf("Accessing an address outside user heap and stack\n");
 			env_exit();
 		}
+		//a new heap/stack page is demand-zero: it gets a disk frame only when it's written back
+		memset((void*)ROUNDDOWN(fault_va, PAGE_SIZE), 0, PAGE_SIZE);
+		pt_set_page_permissions(faulted_env->env_page_directory, fault_va, 0, PERM_MODIFIED);
 	}
+	return frame_info;
+}
 
-    faulted_env->page_last_WS_element->virtual_address = fault_va;
+static void replacePage(struct Env* faulted_env, uint32 fault_va, void* src){
+
+	//with buffering, the victim's frame is parked on the free/modified list instead
+	env_page_ws_evict_page(faulted_env, faulted_env->page_last_WS_element->virtual_address);
+
+	struct FrameInfo *frame_info = place_page(faulted_env, fault_va, src);
+
+    env_page_ws_set_va(faulted_env, faulted_env->page_last_WS_element, fault_va);
     faulted_env->page_last_WS_element->sweeps_counter = 0;
     frame_info->ws_ptr = faulted_env->page_last_WS_element;
+    frame_info->proc = faulted_env;
 }
 
+//Hand of the global CLOCK: the next frame to check in frames_info
+static uint32 global_clock_hand = 0;
 
-void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
+//Global Nth chance CLOCK: sweep the frames of all the envs & evict the first page that's not used for
+//page_WS_max_sweeps sweeps [+1 if modified, in the MODIFIED ver.]. A frame leads to its page by its owner env
+//(proc) & WS element (ws_ptr), which also keeps its sweeps. Frames mapped by more than one env are skipped
+//Only the frames that may still be evicted count as candidates, so it stops after a full sweep in which
+//every frame is skipped or fails to be evicted
+//RETURNS: 1 if a page is evicted, 0 if no frame can be evicted
+static bool global_replace_page()
+{
+	uint32 candidates = 0;
+	for (uint32 steps = 1; ; steps++)
+	{
+		struct FrameInfo *frame_info = &frames_info[global_clock_hand];
+		global_clock_hand = (global_clock_hand + 1) % number_of_frames;
+
+		//a full sweep without any candidate
+		if (steps % number_of_frames == 0)
+		{
+			if (candidates == 0)
+				return 0;
+			candidates = 0;
+		}
+
+		//a frame of a shared object: its used & modified bits are those of all its sharers, found by
+		//its reverse map, and it's evicted from all of them at once
+		struct frame_rmap* rmap = frame_info->rmap;
+		if (rmap != NULL)
+		{
+			uint32 perms = rmap_get_permissions(frame_info);
+			if (perms & PERM_USED)
+			{
+				candidates++;
+				rmap->sweeps_counter = 0;
+				rmap_clear_permissions(frame_info, PERM_USED);
+				continue;
+			}
+			rmap->sweeps_counter++;
+			uint32 max_sweeps = (page_WS_max_sweeps >= 0 ? page_WS_max_sweeps : -page_WS_max_sweeps + ((perms & PERM_MODIFIED) == PERM_MODIFIED));
+			if (rmap->sweeps_counter < max_sweeps)
+			{
+				candidates++;
+				continue;
+			}
+			//it stays with its sharers if it can't be evicted (e.g. no disk frame), so it's not a candidate
+			if (share_evict_page(frame_info) != 0)
+				continue;
+			return 1;
+		}
+
+		struct Env* e = frame_info->proc;
+		struct WorkingSetElement* wse = frame_info->ws_ptr;
+		if (frame_info->references != 1 || frame_info->isBuffered || e == NULL || wse == NULL || e->env_status == ENV_FREE)
+			continue;
+		uint32 virtual_address = wse->virtual_address;
+		uint32* ptr_page_table;
+		if (get_frame_info(e->env_page_directory, virtual_address, &ptr_page_table) != frame_info)
+			continue;
+		candidates++;
+
+		uint32 perms = pt_get_page_permissions(e->env_page_directory, virtual_address);
+		if (perms & PERM_USED)
+		{
+			wse->sweeps_counter = 0;
+			pt_set_page_permissions(e->env_page_directory, virtual_address, 0, PERM_USED);
+			continue;
+		}
+		wse->sweeps_counter++;
+		uint32 max_sweeps = (page_WS_max_sweeps >= 0 ? page_WS_max_sweeps : -page_WS_max_sweeps + ((perms & PERM_MODIFIED) == PERM_MODIFIED));
+		if (wse->sweeps_counter < max_sweeps)
+			continue;
+
+		//evict it & take it out of the WS of its env
+		env_page_ws_evict_page(e, virtual_address);
+		if (e->page_last_WS_element == wse)
+			e->page_last_WS_element = LIST_NEXT(wse);
+		LIST_REMOVE(&(e->page_WS_list), wse);
+		env_page_ws_free_element(e, wse);
+		return 1;
+	}
+}
+
+
+//Place the page at fault_va in the WS of faulted_env, replacing a victim if the WS is full
+static void load_page(struct Env * faulted_env, uint32 fault_va, void* src)
 {
 #if USE_KHEAP
 		struct WorkingSetElement *victimWSElement = NULL;
@@ -286,7 +420,32 @@ void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
 		uint32 wsSize = env_page_ws_get_size(faulted_env);
 #endif
 
-	fault_va = ROUNDDOWN(fault_va, PAGE_SIZE);
+#if USE_KHEAP
+	//global replacement: once the free frames become scarce, a cold page of any env gives its frame to
+	//the faulting one (whose WS grows by a step if it's full, up to global_WS_max_size). If no frame can be
+	//taken, the local replacement is used
+	if(isPageReplacmentAlgorithmGlobalNchanceCLOCK())
+	{
+		uint32 scarce_frames = (memory_scarce_threshold_percentage * number_of_frames) / 100;
+		if (LIST_SIZE(&MemFrameLists.free_frame_list) > scarce_frames || global_replace_page())
+		{
+			if (LIST_SIZE(&(faulted_env->page_WS_list)) == faulted_env->page_WS_max_size && faulted_env->page_WS_max_size < global_WS_max_size)
+				env_page_ws_resize(faulted_env, min(faulted_env->page_WS_max_size + global_WS_growth_step, global_WS_max_size));
+			wsSize = LIST_SIZE(&(faulted_env->page_WS_list));
+		}
+	}
+#endif
+
+#if USE_KHEAP
+	//batch eviction: a full WS gives up a group of its pages at once (their modified ones are written back
+	//together), then the page is placed in one of the freed slots
+	if(isBatchEvictionEnabled() && !isBufferingEnabled() && wsSize >= faulted_env->page_WS_max_size)
+	{
+		uint32 percentage = faulted_env->percentage_of_WS_pages_to_be_removed;
+		env_page_ws_evict_batch(faulted_env, ROUNDUP(percentage * wsSize, 100) / 100);
+		wsSize = LIST_SIZE(&(faulted_env->page_WS_list));
+	}
+#endif
 
 	if(wsSize < (faulted_env->page_WS_max_size))
 	{
@@ -300,24 +459,9 @@ void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
 		//redesign this func
 		//normal allocation and mapping
 
-		struct FrameInfo *frame_info;
-
-		allocate_frame(&frame_info);
-        map_frame(faulted_env->env_page_directory, frame_info, fault_va, PERM_WRITEABLE | PERM_USER);
-
-		int ret = pf_read_env_page(faulted_env, (void*)fault_va);
-
-		if(ret == E_PAGE_NOT_EXIST_IN_PF){
-			if (!((fault_va >= USER_HEAP_START && fault_va < USER_HEAP_MAX) ||
-				(fault_va >= USTACKBOTTOM && fault_va < USTACKTOP))){
-				unmap_frame(faulted_env->env_page_directory, fault_va);
-				cprintf("Accessing an address outside user heap and stack\n");
-				env_exit();
-			}
-		}
+		struct FrameInfo *frame_info = place_page(faulted_env, fault_va, src);
 
         struct WorkingSetElement* WsElement = env_page_ws_list_create_element(faulted_env, fault_va);
-        frame_info->ws_ptr = WsElement;
 
         if(faulted_env->page_last_WS_element == NULL){
         	LIST_INSERT_TAIL(&(faulted_env->page_WS_list), WsElement);
@@ -365,7 +509,7 @@ void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
 				min_remaining = min(min_remaining, max_sweeps - faulted_env->page_last_WS_element->sweeps_counter);
 
 				if(faulted_env->page_last_WS_element->sweeps_counter >= max_sweeps){
-					replacePage(faulted_env, fault_va);
+					replacePage(faulted_env, fault_va, src);
 					replaced = 1;
 					new_last_WS_element = faulted_env->page_last_WS_element->prev_next_info.le_next;
 					increment--;
@@ -385,10 +529,102 @@ void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
 
 }
 
+//Number of pages to load for a fault at fault_va: 1, or the faulted page followed by the next pages
+//of a sequential stream that are neither in memory nor buffered & lie in consecutive disk frames
+static uint32 readahead_count(struct Env * faulted_env, uint32 fault_va)
+{
+	//a fault right after the last loaded pages continues the stream: 2, 4, 8, ... pages
+	if(fault_va == faulted_env->readaheadNextVA)
+		faulted_env->readaheadWindow = min(faulted_env->readaheadWindow * 2, READAHEAD_MAX_PAGES);
+	else
+		faulted_env->readaheadWindow = 1;
+
+	//never read more than half the WS ahead, so the stream doesn't replace itself
+	uint32 window = min(faulted_env->readaheadWindow, faulted_env->page_WS_max_size / 2);
+	int fault_perms = pt_get_page_permissions(faulted_env->env_page_directory, fault_va);
+	if(window <= 1 || (fault_perms != -1 && (fault_perms & PERM_BUFFERED)))
+		return 1;
+
+	uint32 count = pf_get_env_pages_run(faulted_env, fault_va, window);
+	for(uint32 i = 1; i < count; i++){
+		uint32 va = fault_va + i * PAGE_SIZE;
+		int perms = pt_get_page_permissions(faulted_env->env_page_directory, va);
+		if(va >= USER_TOP || (perms != -1 && (perms & (PERM_PRESENT | PERM_BUFFERED))))
+			return i;
+	}
+	return count > 1 ? count : 1;
+}
+
+void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
+{
+	fault_va = ROUNDDOWN(fault_va, PAGE_SIZE);
+
+	uint32 count = readahead_count(faulted_env, fault_va);
+	void* buffer = NULL;
+	if(count > 1){
+		//read the whole run in one disk request (into the readahead buffer of the env), then place its pages one by one
+		if(faulted_env->readaheadBuffer == NULL)
+			faulted_env->readaheadBuffer = kmalloc(READAHEAD_MAX_PAGES * PAGE_SIZE);
+		buffer = faulted_env->readaheadBuffer;
+		if(buffer != NULL && pf_read_env_pages(faulted_env, fault_va, count, buffer) != 0)
+			buffer = NULL;
+		if(buffer == NULL)
+			count = 1;
+	}
+
+	if(buffer == NULL)
+		load_page(faulted_env, fault_va, NULL);
+	else{
+		for(uint32 i = 0; i < count; i++)
+			load_page(faulted_env, fault_va + i * PAGE_SIZE, buffer + i * PAGE_SIZE);
+		faulted_env->nPrefetchedPages += count - 1;
+	}
+
+	faulted_env->readaheadNextVA = fault_va + count * PAGE_SIZE;
+}
+
+
+//=========================
+// [4] COPY-ON-WRITE HANDLER:
+//=========================
+//Give the written copy-on-write page at fault_va its own frame (or just make it writable if no one
+//else maps its frame any more)
+void cow_fault_handler(struct Env * faulted_env, uint32 fault_va)
+{
+	uint32* env_page_directory = faulted_env->env_page_directory;
+	uint32* ptr_page_table;
+
+	fault_va = ROUNDDOWN(fault_va, PAGE_SIZE);
+	struct FrameInfo *shared_frame_info = get_frame_info(env_page_directory, fault_va, &ptr_page_table);
+
+	if(shared_frame_info->references > 1){
+		struct FrameInfo *frame_info;
+		allocate_frame(&frame_info);
+		//the new frame is filled at PGFLTEMP from the shared one, still mapped (read-only) at fault_va
+		map_frame(env_page_directory, frame_info, (uint32)PGFLTEMP, PERM_WRITEABLE);
+		memcpy((void*)PGFLTEMP, (void*)fault_va, PAGE_SIZE);
+		frame_info->references += 1;
+		unmap_frame(env_page_directory, (uint32)PGFLTEMP);
+		frame_info->references -= 1;
+
+		//map_frame() drops the shared frame
+		map_frame(env_page_directory, frame_info, fault_va, PERM_USER | PERM_WRITEABLE);
+
+		frame_info->ws_ptr = env_page_ws_find(faulted_env, fault_va);
+		frame_info->proc = faulted_env;
+	}
+	else
+	{
+		shared_frame_info->ws_ptr = env_page_ws_find(faulted_env, fault_va);
+		shared_frame_info->proc = faulted_env;
+	}
+	pt_set_page_permissions(env_page_directory, fault_va, PERM_WRITEABLE, PERM_COW);
+}
 
 void __page_fault_handler_with_buffering(struct Env * curenv, uint32 fault_va)
 {
 	//[PROJECT] PAGE FAULT HANDLER WITH BUFFERING
-	// your code is here, remove the panic and write your code
-	panic("__page_fault_handler_with_buffering() is not implemented yet...!!");
+	//same placement & replacement: while buffering is enabled, victims keep their frames on the
+	//free/modified lists (replacePage) and a fault on such a page takes its frame back (place_page)
+	page_fault_handler(curenv, fault_va);
 }
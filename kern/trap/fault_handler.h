@@ -27,9 +27,19 @@ uint32 _PageRepAlgoType;
 #define PG_REP_MODIFIEDCLOCK  0x5
 #define PG_REP_NchanceCLOCK 0x6
 #define PG_REP_DYNAMIC_LOCAL 0x7
+#define PG_REP_GLOBAL_NchanceCLOCK 0x8	//Nth chance CLOCK over the frames of all the envs
 
 /*2021*/ int page_WS_max_sweeps;
 
+//GLOBAL Nth chance CLOCK: a full WS that gets a frame of another env grows by global_WS_growth_step pages,
+//up to global_WS_max_size pages (then it replaces its own pages)
+uint32 global_WS_max_size, global_WS_growth_step;
+#define DEFAULT_GLOBAL_WS_MAX_SIZE __PWS_MAX_SIZE
+#define DEFAULT_GLOBAL_WS_GROWTH_STEP 16
+
+//Max pages read by a single fault of a sequential stream (a disk request is at most 256 sectors)
+#define READAHEAD_MAX_PAGES 16
+
 extern uint8 bypassInstrLength ;
 
 /******************************/
@@ -44,6 +54,7 @@ void setPageReplacmentAlgorithmFIFO();
 void setPageReplacmentAlgorithmModifiedCLOCK();
 /*2018*/void setPageReplacmentAlgorithmDynamicLocal();
 /*2021*/void setPageReplacmentAlgorithmNchanceCLOCK();
+void setPageReplacmentAlgorithmGlobalNchanceCLOCK(int PageWSMaxSweeps, uint32 maxWSSize, uint32 WSGrowthStep);
 
 uint32 isPageReplacmentAlgorithmLRU(int LRU_TYPE);
 uint32 isPageReplacmentAlgorithmCLOCK();
@@ -51,6 +62,7 @@ uint32 isPageReplacmentAlgorithmFIFO();
 uint32 isPageReplacmentAlgorithmModifiedCLOCK();
 /*2018*/uint32 isPageReplacmentAlgorithmDynamicLocal();
 /*2021*/ uint32 isPageReplacmentAlgorithmNchanceCLOCK();
+uint32 isPageReplacmentAlgorithmGlobalNchanceCLOCK();
 
 //===============================
 // PAGE BUFFERING
@@ -70,5 +82,6 @@ void __page_fault_handler_with_buffering(struct Env * curenv, uint32 fault_va);
 void dyn_alloc_local_scope_method(struct Env * curenv, uint32 fault_va);
 void page_fault_handler(struct Env * curenv, uint32 fault_va);
 void table_fault_handler(struct Env * curenv, uint32 fault_va);
+void cow_fault_handler(struct Env * curenv, uint32 fault_va);
 
 #endif /* KERN_FAULT_HANDLER_H_ */
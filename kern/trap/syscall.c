@@ -5,6 +5,7 @@
 #include <inc/string.h>
 #include <inc/assert.h>
 #include <inc/semaphore.h>
+#include <inc/dynamic_allocator.h>
 
 #include <kern/proc/user_environment.h>
 #include "trap.h"
@@ -16,6 +17,7 @@
 #include <kern/disk/pagefile_manager.h>
 #include <kern/mem/memory_manager.h>
 #include <kern/mem/shared_memory_manager.h>
+#include <kern/mem/vma.h>
 #include <kern/tests/utilities.h>
 #include <kern/tests/test_working_set.h>
 
@@ -300,17 +302,16 @@ int sys_pf_calculate_allocated_pages(void)
 /* USER HEAP SYSTEM CALLS */
 /*******************************/
 
-void sys_free_user_mem(uint32 virtual_address, uint32 size)
+int sys_free_user_mem(uint32 virtual_address, uint32 size)
 {
 	if(isBufferingEnabled())
 	{
-		__free_user_mem_with_buffering(get_cpu_proc(), virtual_address, size);
+		return __free_user_mem_with_buffering(get_cpu_proc(), virtual_address, size);
 	}
 	else
 	{
-		free_user_mem(get_cpu_proc(), virtual_address, size);
+		return free_user_mem(get_cpu_proc(), virtual_address, size);
 	}
-	return;
 }
 
 void sys_allocate_user_mem(uint32 virtual_address, uint32 size)
@@ -338,7 +339,22 @@ void sys_allocate_chunk(uint32 virtual_address, uint32 size, uint32 perms)
 //2014
 void sys_move_user_mem(uint32 src_virtual_address, uint32 dst_virtual_address, uint32 size)
 {
-	move_user_mem(get_cpu_proc(), src_virtual_address, dst_virtual_address, size);
+	//the pages of [src, src+size) should be in one reserved area & move to a range that is not
+	//reserved at all (without overlapping or wrapping around)
+	struct Env* e = get_cpu_proc();
+	uint32 rounded_size = ROUNDUP(size, PAGE_SIZE);
+	uint32 src_end = src_virtual_address + rounded_size, dst_end = dst_virtual_address + rounded_size;
+	struct vm_area* area = vma_find(e, src_virtual_address);
+	if (rounded_size == 0 || src_virtual_address % PAGE_SIZE != 0 || dst_virtual_address % PAGE_SIZE != 0 ||
+			src_end < src_virtual_address || dst_end < dst_virtual_address ||
+			src_virtual_address < USER_HEAP_START || src_end > USER_HEAP_MAX ||
+			dst_virtual_address < USER_HEAP_START || dst_end > USER_HEAP_MAX ||
+			(src_virtual_address < dst_end && dst_virtual_address < src_end) ||
+			area == NULL || src_end > area->end || !vma_is_free(e, dst_virtual_address, dst_end)){
+		cprintf("ENV EXITED ON SYS MOVE USER MEM\n");
+		env_exit();
+	}
+	move_user_mem(e, src_virtual_address, dst_virtual_address, size);
 	return;
 }
 
@@ -352,6 +368,18 @@ void sys_set_uheap_strategy(uint32 heapStrategy)
 	_UHeapPlacementStrategy = heapStrategy;
 }
 
+//Keep a copy of the heap trace of the current env (ring buffer of DA_TRACE_SIZE records, count records
+//written so far) in the kernel's daTrace, to be replayed by the "replaytrace" command
+void sys_save_heap_trace(struct DATraceRecord* trace, uint32 count)
+{
+	if ((uint32)trace >= USER_TOP || (uint32)trace + sizeof(daTrace) > USER_TOP){
+		cprintf("ENV EXITED ON SYS SAVE HEAP TRACE\n");
+		env_exit();
+	}
+	memcpy(daTrace, trace, sizeof(daTrace));
+	daTraceCount = count;
+}
+
 /*******************************/
 /* Scheduler SYSTEM CALL */
 /*******************************/
@@ -520,6 +548,18 @@ int sys_create_env(char* programName, unsigned int page_WS_size,unsigned int LRU
 	return env->env_id;
 }
 
+//Create a copy-on-write child of the current env (as NEW, to be run by sys_run_env)
+int32 sys_fork()
+{
+	struct Env* env = env_fork(get_cpu_proc());
+	if(env == NULL)
+	{
+		return E_ENV_CREATION_ERROR;
+	}
+	sched_new_env(env);
+	return env->env_id;
+}
+
 //Place a new env into the READY queue
 void sys_run_env(int32 envId)
 {
@@ -571,8 +611,7 @@ uint32 syscall(uint32 syscallno, uint32 a1, uint32 a2, uint32 a3, uint32 a4, uin
 		return 0;
 		break;
 	case SYS_free_user_mem:
-		sys_free_user_mem(a1,a2);
-		return 0;
+		return sys_free_user_mem(a1,a2);
 		break;
 	case SYS_env_set_priority:
 		sys_env_set_priority(a1,a2);
@@ -685,6 +724,9 @@ uint32 syscall(uint32 syscallno, uint32 a1, uint32 a2, uint32 a3, uint32 a4, uin
 		sys_run_env((int32)a1);
 		return 0;
 		break;
+	case SYS_fork:
+		return sys_fork();
+		break;
 	case SYS_getenvindex:
 		return sys_getenvindex();
 		break;
@@ -764,6 +806,10 @@ uint32 syscall(uint32 syscallno, uint32 a1, uint32 a2, uint32 a3, uint32 a4, uin
 		sys_set_value(a1, a2, (uint32*)a3);
 		return 0;
 
+	case SYS_save_heap_trace:
+		sys_save_heap_trace((struct DATraceRecord*)a1, a2);
+		return 0;
+
 	case NSYSCALLS:
 		return 	-E_INVAL;
 		break;
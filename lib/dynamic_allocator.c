@@ -6,6 +6,7 @@
  */
 #include <inc/assert.h>
 #include <inc/string.h>
+#include <inc/x86.h>
 #include "../inc/dynamic_allocator.h"
 
 
@@ -19,7 +20,7 @@
 __inline__ uint32 get_block_size(void* va)
 {
 	uint32 *curBlkMetaData = ((uint32 *)va - 1) ;
-	return (*curBlkMetaData) & ~(0x1);
+	return (*curBlkMetaData) & ~(DA_BLOCK_FLAGS);
 }
 
 //===========================
@@ -52,6 +53,9 @@ void *alloc_block(uint32 size, int ALLOC_STRATEGY)
 	case DA_WF:
 		va = alloc_block_WF(size);
 		break;
+	case DA_SF:
+		va = alloc_block_SF(size);
+		break;
 	default:
 		cprintf("Invalid allocation strategy\n");
 		break;
@@ -83,13 +87,165 @@ void print_blocks_list(struct MemBlock_LIST list)
 //============================= HELPER FUNCTIONS ===================================//
 //==================================================================================//
 
+bool is_initialized = 0;
+bool is_segregated_mode = 0;	//1: free blocks are in freeBlocksBins, 0: in freeBlocksList
+uint32 da_first_block = 0;		//address of the first block (to walk all blocks by their sizes)
+struct BlockElement *NF_free_block = NULL;	//where the next NEXT FIT search starts
+uint32 replay_break = 0;		//break of the arena of the trace being replayed
+uint32 replay_limit = 0;		//end of that arena (0: not replaying)
+bool daAllocatedFooter = DA_ALLOCATED_FOOTER;	//layout of the allocated blocks (see DA_ALLOCATED_FOOTER)
+
+// sbrk(), or the same on the private arena while a trace is replayed (see da_trace_replay)
+static void* da_sbrk(int numOfPages)
+{
+	if(replay_limit == 0) return sbrk(numOfPages);
+
+	uint32 old_break = replay_break;
+	if(numOfPages <= 0) return (void*)old_break;
+	if(replay_break + numOfPages * PAGE_SIZE > replay_limit) return (void*)-1;
+
+	*((uint32*)old_break - 1) = 0;
+	replay_break += numOfPages * PAGE_SIZE;
+	*((uint32*)replay_break - 1) = 1;
+	return (void*)old_break;
+}
+
+// allocated blocks changed their total size by delta
+static inline void update_allocated_bytes(int32 delta)
+{
+	daAllocatedBytes += delta;
+	if(daAllocatedBytes > daPeakAllocatedBytes)
+		daPeakAllocatedBytes = daAllocatedBytes;
+}
+
+// number of blocks in the free list(s) of the current mode
+uint32 get_free_blocks_count()
+{
+	if(!is_segregated_mode)
+		return LIST_SIZE(&freeBlocksList);
+
+	uint32 count = 0;
+	for(int i = 0; i < DA_NUM_BINS; i++)
+		count += LIST_SIZE(&freeBlocksBins[i]);
+	return count;
+}
+
+// total size (incl. meta data) of the block that holds "size" bytes (already made even & >= DYN_ALLOC_MIN_BLOCK_SIZE)
+static inline uint32 get_required_size(uint32 size)
+{
+	if(daAllocatedFooter)
+		return size + META_DATA_SIZE;
+	// sizes are kept multiple of 4 (the 2 LSBs are flags), and should fit a free block once freed
+	return MAX(ROUNDUP(size, 4) + ALLOC_META_DATA_SIZE, DYN_ALLOC_MIN_BLOCK_SIZE + META_DATA_SIZE);
+}
+
+static inline uint32 get_bin_index(uint32 size)
+{
+	return 31 - __builtin_clz(size);
+}
+
+// inserts a free block into the free list of the current mode
+// (address-ordered freeBlocksList: O(n), segregated bins: O(1))
+void insert_free_block(struct BlockElement* blk)
+{
+	if(is_segregated_mode)
+	{
+		uint32 bin = get_bin_index(get_block_size(blk));
+		LIST_INSERT_HEAD(&freeBlocksBins[bin], blk);
+		freeBinsBitmap |= ((uint32)1 << bin);
+		return;
+	}
+
+	if(LIST_SIZE(&freeBlocksList) == 0 || (void*)LIST_LAST(&freeBlocksList) < (void*)blk)
+	{
+		LIST_INSERT_TAIL(&freeBlocksList, blk);
+	}
+	else
+	{
+		struct BlockElement* cur;
+		LIST_FOREACH (cur, &freeBlocksList) if(cur > blk) break;
+		LIST_INSERT_BEFORE(&freeBlocksList, cur, blk);
+	}
+}
+
+// removes a free block from the free list of the current mode
+// (MUST be called before changing the block size)
+void remove_free_block(struct BlockElement* blk)
+{
+	if(is_segregated_mode)
+	{
+		uint32 bin = get_bin_index(get_block_size(blk));
+		LIST_REMOVE(&freeBlocksBins[bin], blk);
+		if(LIST_EMPTY(&freeBlocksBins[bin]))
+			freeBinsBitmap &= ~((uint32)1 << bin);
+		return;
+	}
+	// the next NEXT FIT search should not start from a block that is no longer free (or merged)
+	if(blk == NF_free_block)
+		NF_free_block = LIST_NEXT(blk);
+	LIST_REMOVE(&freeBlocksList, blk);
+}
+
+// moves all free blocks from freeBlocksList into the segregated bins (once, on switching to DA_SF)
+static void use_segregated_bins()
+{
+	if(is_segregated_mode) return;
+
+	is_segregated_mode = 1;
+	freeBinsBitmap = 0;
+	for(int i = 0; i < DA_NUM_BINS; i++)
+		LIST_INIT(&freeBlocksBins[i]);
+
+	struct BlockElement* blk;
+	LIST_FOREACH(blk, &freeBlocksList)
+		insert_free_block(blk);
+	LIST_INIT(&freeBlocksList);
+}
+
+// rebuilds the address-ordered freeBlocksList from the bins (once, on switching back to FF/BF/WF/NF)
+// by walking all blocks in address order, so no sorting is needed
+static void use_address_ordered_list()
+{
+	if(!is_segregated_mode) return;
+
+	is_segregated_mode = 0;
+	NF_free_block = NULL;
+	freeBinsBitmap = 0;
+	for(int i = 0; i < DA_NUM_BINS; i++)
+		LIST_INIT(&freeBlocksBins[i]);
+
+	LIST_INIT(&freeBlocksList);
+	for(void* blk = (void*)da_first_block; get_block_size(blk) != 0; blk = (char*)blk + get_block_size(blk))
+	{
+		if(is_free_block(blk))
+			LIST_INSERT_TAIL(&freeBlocksList, (struct BlockElement*)blk);
+	}
+}
+
+// changes the size of a block that is already in the free list
+static inline void resize_free_block(void* va, uint32 new_size)
+{
+	if(is_segregated_mode)
+	{
+		remove_free_block((struct BlockElement*)va);
+		set_block_data(va, new_size, 0);
+		insert_free_block((struct BlockElement*)va);
+		return;
+	}
+	set_block_data(va, new_size, 0);
+}
+
 // adds a free block and merges it with adjacent free blocks if possible
 // (MAKE SURE PREVIOUS AND NEXT BLOCKS' DATA ARE SET CORRECTLY BEFORE CALLING)
 void* extend_mapped_region(uint32 size)
 {
 	uint32 no_of_pages = ROUNDUP(size,PAGE_SIZE)/PAGE_SIZE;
-	void* va = sbrk(no_of_pages);
+	// without allocated footers, the END block becomes the header of the new space, so keep its "previous block is free" bit
+	uint32 end_block = daAllocatedFooter ? 0 : *((uint32*)da_sbrk(0) - 1);
+	void* va = da_sbrk(no_of_pages);
 	if (va == (void*)-1) return NULL;
+	if(!daAllocatedFooter)
+		*((uint32*)va - 1) = end_block & DA_PREV_FREE_FLAG;
 
 	va = add_free_block(va, no_of_pages * PAGE_SIZE);
 	alloc(va, size);
@@ -99,40 +255,84 @@ void* extend_mapped_region(uint32 size)
 void* add_free_block(void* va, uint32 size){
 
 	void *next_block = (void*)(((char*)va) + size);
-	void *prev_block = (void*)((uint32*)va - 1);
-
 	uint32 next_size = get_block_size(next_block);
-	uint32 prev_size = get_block_size(prev_block);
 
-	prev_block = (void*)(((char*)prev_block) - prev_size + 4);
+	void *prev_block;
+	uint32 prev_size;
+	bool prev_is_free;
+	if(daAllocatedFooter)
+	{
+		prev_block = (void*)((uint32*)va - 1);
+		prev_size = get_block_size(prev_block);
 
-	if(is_free_block(next_block) && is_free_block(prev_block)){
-		LIST_REMOVE(&freeBlocksList,(struct BlockElement*)next_block);
-		set_block_data(prev_block, prev_size + size + next_size, 0);
+		prev_block = (void*)(((char*)prev_block) - prev_size + 4);
+		prev_is_free = is_free_block(prev_block);
+	}
+	else
+	{
+		// only free blocks have a footer, so check the flag in our header before reading the previous footer
+		prev_is_free = (*((uint32*)va - 1) & DA_PREV_FREE_FLAG) != 0;
+		prev_size = prev_is_free ? get_block_size((uint32*)va - 1) : 0;
+		prev_block = (void*)(((char*)va) - prev_size);
+	}
+
+	if(is_free_block(next_block) && prev_is_free){
+		remove_free_block((struct BlockElement*)next_block);
+		resize_free_block(prev_block, prev_size + size + next_size);
 		return prev_block;
 	}
-	else if(is_free_block(prev_block)){
-		set_block_data(prev_block, prev_size + size, 0);
+	else if(prev_is_free){
+		resize_free_block(prev_block, prev_size + size);
 		return prev_block;
 	}
 	else if(is_free_block(next_block)){
-		LIST_REMOVE(&freeBlocksList,(struct BlockElement*)next_block);
+		remove_free_block((struct BlockElement*)next_block);
 		size = size + next_size;
 	}
 
 	set_block_data(va, size, 0);
+	insert_free_block((struct BlockElement*)va);
+	return va;
+}
 
-	if(LIST_SIZE(&freeBlocksList) == 0 || (void*)LIST_LAST(&freeBlocksList) < va)
+// gives back the pages at the end of the heap that are covered by its last block if it's free
+// (sbrk with a negative number of pages); returns the number of released pages
+uint32 trim_mapped_region()
+{
+	if(!is_initialized) return 0;
+
+	uint32 brk = (uint32)sbrk(0);
+	// the last block is free if its footer says so (or, without allocated footers, if the END block says so)
+	if(daAllocatedFooter ? (*((uint32*)brk - 2) & DA_ALLOCATED_FLAG) : !(*((uint32*)brk - 1) & DA_PREV_FREE_FLAG))
+		return 0;
+	uint32 last_footer = *((uint32*)brk - 2);	// footer of the last block
+	uint32 size = last_footer & ~(DA_BLOCK_FLAGS);
+	void* last_block = (void*)(brk - size);
+	uint32 header = brk - sizeof(uint32) - size;
+
+	// keep the part of the block in the page of its header (if any) as a smaller free block
+	uint32 new_brk = ROUNDUP(header + sizeof(uint32), PAGE_SIZE);
+	uint32 remaining_size = new_brk - sizeof(uint32) - header;
+	if(remaining_size > 0 && remaining_size < DYN_ALLOC_MIN_BLOCK_SIZE + META_DATA_SIZE)
 	{
-		LIST_INSERT_TAIL(&freeBlocksList, (struct BlockElement*)va);
+		new_brk += PAGE_SIZE;
+		remaining_size += PAGE_SIZE;
 	}
-	else
+	if(new_brk >= brk) return 0;
+
+	remove_free_block((struct BlockElement*)last_block);
+	if(NF_free_block == last_block) NF_free_block = NULL;
+
+	*((uint32*)new_brk - 1) = 1;	// the new END block
+	if(remaining_size > 0)
 	{
-		struct BlockElement* cur;
-		LIST_FOREACH (cur, &freeBlocksList) if((void*)cur > va) break;
-		LIST_INSERT_BEFORE(&freeBlocksList, cur, (struct BlockElement*)va);
+		set_block_data(last_block, remaining_size, 0);
+		insert_free_block((struct BlockElement*)last_block);
 	}
-	return va;
+
+	uint32 pages = (brk - new_brk) / PAGE_SIZE;
+	sbrk(-(int)pages);
+	return pages;
 }
 
 bool alloc(struct BlockElement *current_free_block, uint32 required_size)
@@ -144,7 +344,7 @@ bool alloc(struct BlockElement *current_free_block, uint32 required_size)
     if(block_size >= required_size)
     {
         is_enough_space = 1;
-        LIST_REMOVE(&freeBlocksList, current_free_block);
+        remove_free_block(current_free_block);
 
         if(block_size - required_size >= DYN_ALLOC_MIN_BLOCK_SIZE + META_DATA_SIZE)
         {
@@ -156,7 +356,7 @@ bool alloc(struct BlockElement *current_free_block, uint32 required_size)
         {
         	set_block_data(start_of_block, block_size, 1);
         }
-
+        update_allocated_bytes(get_block_size(start_of_block));
     }
 
     return is_enough_space;
@@ -166,7 +366,6 @@ bool alloc(struct BlockElement *current_free_block, uint32 required_size)
 //============================ REQUIRED FUNCTIONS ==================================//
 //==================================================================================//
 
-bool is_initialized = 0;
 //==================================
 // [1] INITIALIZE DYNAMIC ALLOCATOR:
 //==================================
@@ -191,8 +390,12 @@ void initialize_dynamic_allocator(uint32 daStart, uint32 initSizeOfAllocatedSpac
 	//Setting the meta data for BEG_Block,END_Block blocks and Free_Block
 	*BEG_Block = 1;
 	*END_Block = 1;
+	*(Free_Block - 1) = 0;	//no previous free block
 	set_block_data((void*)(Free_Block), initSizeOfAllocatedSpace - META_DATA_SIZE, 0);
 	//Initializing the freeBlocksList
+	is_segregated_mode = 0;
+	da_first_block = (uint32)Free_Block;
+	daAllocatedBytes = daPeakAllocatedBytes = 0;
 	LIST_INIT(&freeBlocksList);
 	LIST_INSERT_TAIL(&freeBlocksList, (struct BlockElement*)Free_Block);
 
@@ -200,14 +403,40 @@ void initialize_dynamic_allocator(uint32 daStart, uint32 initSizeOfAllocatedSpac
 
 //==================================
 // [2] SET BLOCK HEADER & FOOTER:
+//     (no footer for allocated blocks if daAllocatedFooter is 0)
 //==================================
 void set_block_data(void* va, uint32 totalSize, bool isAllocated)
 {
 	if(totalSize & 1) panic("set_block_data called with odd Size");
 
-	uint32 meta_data = totalSize | (uint32)isAllocated;
-	*((uint32*)va - 1) = meta_data;
-	*((uint32*)((char*)va + (totalSize - 2 * sizeof(uint32)))) = meta_data;
+	if(daAllocatedFooter)
+	{
+		uint32 meta_data = totalSize | (uint32)isAllocated;
+		*((uint32*)va - 1) = meta_data;
+		*((uint32*)((char*)va + (totalSize - 2 * sizeof(uint32)))) = meta_data;
+		return;
+	}
+
+	if(totalSize & DA_PREV_FREE_FLAG) panic("set_block_data called with Size that is not multiple of 4");
+
+	uint32 *header = (uint32*)va - 1;
+	*header = totalSize | (uint32)isAllocated | (*header & DA_PREV_FREE_FLAG);
+	if(!isAllocated)
+		*((uint32*)((char*)va + (totalSize - 2 * sizeof(uint32)))) = totalSize;
+
+	// tell the next block (or the END block) whether this one is free
+	uint32 *next_header = (uint32*)((char*)va + totalSize) - 1;
+	if(isAllocated)
+		*next_header &= ~DA_PREV_FREE_FLAG;
+	else
+		*next_header |= DA_PREV_FREE_FLAG;
+}
+
+// selects the layout of the allocated blocks (see DA_ALLOCATED_FOOTER)
+// MUST be followed by initialize_dynamic_allocator: the blocks of the current heap keep their old layout
+void set_da_allocated_footer(bool enabled)
+{
+	daAllocatedFooter = enabled;
 }
 
 //=========================================
@@ -235,7 +464,9 @@ void *alloc_block_FF(uint32 size)
 	//==================================================================================
 	//==================================================================================
 
-	uint32 required_size = size + META_DATA_SIZE;
+	use_address_ordered_list();
+
+	uint32 required_size = get_required_size(size);
 	bool found_fitting_size = 0;
 
 	struct BlockElement *current_free_block;
@@ -280,7 +511,9 @@ void *alloc_block_BF(uint32 size)
 	//==================================================================================
 	//==================================================================================
 
-	uint32 required_size = size + META_DATA_SIZE;
+	use_address_ordered_list();
+
+	uint32 required_size = get_required_size(size);
 	uint32 min_diffrience = (1 << 30);
 	bool found_fitting_size = 0;
 	struct BlockElement *best_block;
@@ -316,6 +549,7 @@ void free_block(void *va)
 	if(va == NULL || is_free_block(va)) return;
 
     uint32 cur_size = get_block_size(va);
+    update_allocated_bytes(-(int32)cur_size);
     add_free_block(va, cur_size);
 }
 
@@ -336,7 +570,7 @@ void *realloc_block_FF(void* va, uint32 new_size)
 	if (new_size < DYN_ALLOC_MIN_BLOCK_SIZE)
 		new_size = DYN_ALLOC_MIN_BLOCK_SIZE ;
 
-	uint32 required_size = new_size + META_DATA_SIZE;
+	uint32 required_size = get_required_size(new_size);
 	uint32 prev_size = get_block_size(va);
 	void* next_block = (void*)((char*)va + prev_size);
 	uint32 next_block_size = get_block_size(next_block);
@@ -347,6 +581,7 @@ void *realloc_block_FF(void* va, uint32 new_size)
 		// if there is enough space for a free block after resizing -> add free block
 		// if next block is free -> add free space to the next block regardless of size to avoid fragmantation
 		if(prev_size - required_size >= DYN_ALLOC_MIN_BLOCK_SIZE + META_DATA_SIZE || is_free_block(next_block)){
+			update_allocated_bytes((int32)required_size - (int32)prev_size);
 			set_block_data(va, required_size, 1);
 			void* extra_space = (void*)((char*)va + required_size);
 			add_free_block(extra_space, prev_size - required_size);
@@ -357,27 +592,29 @@ void *realloc_block_FF(void* va, uint32 new_size)
 	// if there is a free block next that has enough space -> expand to next
 	if(is_free_block(next_block) && prev_size + next_block_size >= required_size)
 	{
-		LIST_REMOVE(&freeBlocksList,(struct BlockElement*)next_block);
+		remove_free_block((struct BlockElement*)next_block);
 
 		// if remaining size is enough to form a new free block -> insert it as a free block
 		if(prev_size + next_block_size - required_size >= DYN_ALLOC_MIN_BLOCK_SIZE + META_DATA_SIZE)
 		{
+			update_allocated_bytes(required_size - prev_size);
 			set_block_data(va, required_size, 1);
 			void* extra_space = (void*)((char*)va + required_size);
 			add_free_block(extra_space, prev_size + next_block_size - required_size);
 		}
 		else
 		{
+			update_allocated_bytes(next_block_size);
 			set_block_data(va, prev_size + next_block_size, 1);
 		}
 
 		return va;
 	}
 
-	void* new_block = alloc_block_FF(new_size);
+	void* new_block = is_segregated_mode ? alloc_block_SF(new_size) : alloc_block_FF(new_size);
 
 	if(new_block != NULL){
-		memcpy(new_block, va, prev_size - META_DATA_SIZE);
+		memcpy(new_block, va, prev_size - ALLOC_META_DATA_SIZE);
 		free_block(va);
 		return new_block;
 	}
@@ -413,7 +650,9 @@ void *alloc_block_WF(uint32 size)
 	//==================================================================================
 	//==================================================================================
 
-	uint32 required_size = size + META_DATA_SIZE;
+	use_address_ordered_list();
+
+	uint32 required_size = get_required_size(size);
 	uint32 max_diffrience = 0;
 	bool found_fitting_size = 0;
 	struct BlockElement *worst_block;
@@ -466,9 +705,9 @@ void *alloc_block_NF(uint32 size)
 	//==================================================================================
 	//==================================================================================
 
-	uint32 required_size = size + META_DATA_SIZE;
+	use_address_ordered_list();
 
-	static struct BlockElement *NF_free_block = NULL; //static pointer to keep last order
+	uint32 required_size = get_required_size(size);
 
 	// for the worst case, the pointer will reach the end then cycle to the begining in the second iteration
 	for(int i = 0; i < 2; i++){
@@ -491,12 +730,237 @@ void *alloc_block_NF(uint32 size)
 	}
 
 	// if no fit is matched after the loop, then there is no possible matches, call sbrk
-	NF_free_block = extend_mapped_region(required_size);
+	void* va = extend_mapped_region(required_size);
+
+	// continue from the free space left after the new block (if any)
+	NF_free_block = NULL;
+	if (va != NULL)
+	{
+		void* next_block = (void*)((char*)va + get_block_size(va));
+		if(is_free_block(next_block))
+			NF_free_block = next_block;
+	}
+
+	return va;
+}
+
+//=========================================
+// [9] ALLOCATE BLOCK BY SEGREGATED FIT:
+//=========================================
+// Takes the first block of the smallest non-empty bin whose blocks are all big enough,
+// so both the search and the free (see insert_free_block) are O(1)
+void *alloc_block_SF(uint32 size)
+{
+	if(size == 0) return NULL;
+
+	//==================================================================================
+	//DON'T CHANGE THESE LINES==========================================================
+	//==================================================================================
+	{
+		if (size % 2 != 0) size++;	//ensure that the size is even (to use LSB as allocation flag)
+		if (size < DYN_ALLOC_MIN_BLOCK_SIZE)
+			size = DYN_ALLOC_MIN_BLOCK_SIZE ;
+		if (!is_initialized)
+		{
+			uint32 required_size = size + 2*sizeof(int) /*header & footer*/ + 2*sizeof(int) /*da begin & end*/ ;
+			uint32 da_start = (uint32)sbrk(ROUNDUP(required_size, PAGE_SIZE)/PAGE_SIZE);
+			uint32 da_break = (uint32)sbrk(0);
+			initialize_dynamic_allocator(da_start, da_break - da_start);
+		}
+	}
+	//==================================================================================
+	//==================================================================================
+
+	use_segregated_bins();
+
+	uint32 required_size = get_required_size(size);
+
+	// blocks of bin i are >= 2^i, so start from the bin of the required size rounded up to a power of 2
+	uint32 bin = get_bin_index(required_size);
+	if(required_size & (required_size - 1)) bin++;
+
+	uint32 candidate_bins = (bin < DA_NUM_BINS) ? (freeBinsBitmap & ~(((uint32)1 << bin) - 1)) : 0;
+	if(candidate_bins == 0)
+	{
+		return extend_mapped_region(required_size);
+	}
+
+	struct BlockElement *blk = LIST_FIRST(&freeBlocksBins[__builtin_ctz(candidate_bins)]);
+	alloc(blk, required_size);
+
+	return (void*)blk;
+}
+
+//==================================================================================//
+//=============================== TRACE & REPLAY ===================================//
+//==================================================================================//
+
+//===========================
+// [1] RECORD AN OPERATION:
+//===========================
+void da_trace_record(uint8 op, uint32 size, void* addr, void* result)
+{
+	if(!daTraceEnabled) return;
+
+	struct DATraceRecord* rec = &daTrace[daTraceCount++ % DA_TRACE_SIZE];
+	rec->op = op;
+	rec->size = size;
+	rec->addr = (uint32)addr;
+	rec->result = (uint32)result;
+	rec->timestamp = (uint32)read_tsc();
+}
+
+//===========================
+// [2] PRINT A TRACE:
+//===========================
+//count is the number of records written to the ring buffer "trace" (only its last DA_TRACE_SIZE are there)
+void da_trace_print(struct DATraceRecord* trace, uint32 count)
+{
+	static char* op_names[] = { "", "alloc", "free", "realloc" };
+	uint32 first = (count > DA_TRACE_SIZE) ? count - DA_TRACE_SIZE : 0;
+
+	cprintf("DATRACE BEGIN %d\n", count - first);
+	for(uint32 k = first; k < count; k++)
+	{
+		struct DATraceRecord* rec = &trace[k % DA_TRACE_SIZE];
+		cprintf("DATRACE %s %d %x %x %u\n", op_names[rec->op], rec->size, rec->addr, rec->result, rec->timestamp);
+	}
+	cprintf("DATRACE END\n");
+}
+
+//===========================
+// [3] REPLAY A TRACE:
+//===========================
+//Size of the arena to replay the trace: twice the total size it allocates, so only a strategy
+//that fragments badly runs out of it (counted as failed allocations)
+uint32 da_trace_replay_size(struct DATraceRecord* trace, uint32 count)
+{
+	uint32 first = (count > DA_TRACE_SIZE) ? count - DA_TRACE_SIZE : 0;
+	uint32 size = 2 * PAGE_SIZE;
+	for(uint32 k = first; k < count; k++)
+	{
+		struct DATraceRecord* rec = &trace[k % DA_TRACE_SIZE];
+		if(rec->op != DA_TRACE_FREE && rec->size <= DYN_ALLOC_MAX_BLOCK_SIZE)
+			size += 2 * (rec->size + 2 * META_DATA_SIZE);
+	}
+	return MIN(ROUNDUP(size, PAGE_SIZE), DYN_ALLOC_MAX_SIZE);
+}
+
+//State of the allocator, put aside while a trace is replayed
+struct DAState
+{
+	struct MemBlock_LIST free_list;
+	struct MemBlock_LIST bins[DA_NUM_BINS];
+	uint32 bins_bitmap;
+	uint32 allocated_bytes, peak_allocated_bytes;
+	uint32 first_block;
+	bool initialized, segregated;
+	struct BlockElement* nf_block;
+};
+struct DAState replay_saved_state;
+
+static void save_state(struct DAState* state)
+{
+	state->free_list = freeBlocksList;
+	for(int i = 0; i < DA_NUM_BINS; i++)
+		state->bins[i] = freeBlocksBins[i];
+	state->bins_bitmap = freeBinsBitmap;
+	state->allocated_bytes = daAllocatedBytes;
+	state->peak_allocated_bytes = daPeakAllocatedBytes;
+	state->first_block = da_first_block;
+	state->initialized = is_initialized;
+	state->segregated = is_segregated_mode;
+	state->nf_block = NF_free_block;
+}
+
+static void restore_state(struct DAState* state)
+{
+	freeBlocksList = state->free_list;
+	for(int i = 0; i < DA_NUM_BINS; i++)
+		freeBlocksBins[i] = state->bins[i];
+	freeBinsBitmap = state->bins_bitmap;
+	daAllocatedBytes = state->allocated_bytes;
+	daPeakAllocatedBytes = state->peak_allocated_bytes;
+	da_first_block = state->first_block;
+	is_initialized = state->initialized;
+	is_segregated_mode = state->segregated;
+	NF_free_block = state->nf_block;
+}
+
+//Replay the trace with the given strategy (DA_FF .. DA_SF) on a fresh allocator in the page aligned
+//arena, which grows from one page like a heap. blocks has a slot per record (the replayed block of
+//each allocation). The allocator in use is left untouched, but nothing else should use it meanwhile.
+//Frees/reallocs are matched to the live allocation that returned their address in the trace; those
+//of allocations that were not replayed (e.g. page allocations) are skipped, or replayed as allocations
+void da_trace_replay(struct DATraceRecord* trace, uint32 count, int strategy, void* arena, uint32 arena_size,
+		void** blocks, struct DAReplayStats* stats)
+{
+	uint32 first = (count > DA_TRACE_SIZE) ? count - DA_TRACE_SIZE : 0;
+	memset(stats, 0, sizeof(*stats));
+
+	save_state(&replay_saved_state);
+	replay_break = (uint32)arena + PAGE_SIZE;
+	replay_limit = (uint32)arena + arena_size;
+	initialize_dynamic_allocator((uint32)arena, PAGE_SIZE);
+	NF_free_block = NULL;
+
+	for(uint32 k = first; k < count; k++)
+	{
+		struct DATraceRecord* rec = &trace[k % DA_TRACE_SIZE];
+		void** block = &blocks[k - first];
+		void** old_block = NULL;
+		*block = NULL;
+
+		if(rec->op != DA_TRACE_ALLOC && rec->addr != 0)
+		{
+			for(uint32 j = k; j-- > first; )
+			{
+				if(blocks[j - first] != NULL && trace[j % DA_TRACE_SIZE].result == rec->addr)
+				{
+					old_block = &blocks[j - first];
+					break;
+				}
+			}
+		}
+
+		uint8 op = rec->op;
+		if(op == DA_TRACE_REALLOC && old_block == NULL)
+			op = DA_TRACE_ALLOC;
+		else if(op == DA_TRACE_REALLOC && (rec->size == 0 || rec->size > DYN_ALLOC_MAX_BLOCK_SIZE))
+			op = DA_TRACE_FREE;
+
+		if((op == DA_TRACE_ALLOC && (rec->size == 0 || rec->size > DYN_ALLOC_MAX_BLOCK_SIZE)) ||
+				(op == DA_TRACE_FREE && old_block == NULL))
+		{
+			stats->skipped++;
+			continue;
+		}
+
+		uint64 start = read_tsc();
+		if(op == DA_TRACE_ALLOC)
+			*block = alloc_block(rec->size, strategy);
+		else if(op == DA_TRACE_FREE)
+			free_block(*old_block);
+		else
+			*block = realloc_block_FF(*old_block, rec->size);
+		stats->cycles += read_tsc() - start;
+		stats->ops++;
+
+		if(op != DA_TRACE_FREE && *block == NULL)
+			stats->failed++;
+		else if(op != DA_TRACE_ALLOC)
+			*old_block = NULL;
+	}
 
-	if (NF_free_block != NULL)
+	stats->peak_footprint = replay_break - (uint32)arena;
+	stats->peak_allocated = daPeakAllocatedBytes;
+	for(void* blk = (void*)da_first_block; get_block_size(blk) != 0; blk = (char*)blk + get_block_size(blk))
 	{
-		NF_free_block += required_size;
+		if(!is_free_block(blk)) continue;
+		stats->free_bytes += get_block_size(blk);
+		stats->largest_free = MAX(stats->largest_free, get_block_size(blk));
 	}
 
-	return NF_free_block;
+	replay_limit = 0;
+	restore_state(&replay_saved_state);
 }
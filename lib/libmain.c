@@ -39,6 +39,7 @@ libmain(int argc, char **argv)
 			cprintf("Num of PAGE faults = %d, modif = %d\n", myEnv->pageFaultsCounter, myEnv->nModifiedPages);
 			cprintf("# PAGE IN (from disk) = %d, # PAGE OUT (on disk) = %d, # NEW PAGE ADDED (on disk) = %d\n", myEnv->nPageIn, myEnv->nPageOut,myEnv->nNewPageAdded);
 			//cprintf("Num of freeing scarce memory = %d, freeing full working set = %d\n", myEnv->freeingScarceMemCounter, myEnv->freeingFullWSCounter);
+			cprintf("# PREFETCHED (read ahead) = %d\n", myEnv->nPrefetchedPages);
 			cprintf("Num of clocks = %d\n", myEnv->nClocks);
 			cprintf("**************************************\n");
 		}
@@ -0,0 +1,140 @@
+/*
+ * medium_allocator.c
+ *
+ *  Size classes for the objects between the block allocator & whole pages
+ */
+#include <inc/assert.h>
+#include <inc/string.h>
+#include <inc/mmu.h>
+#include "../inc/medium_allocator.h"
+
+#define MEDIUM_SPAN_HEADER_SIZE	ROUNDUP(sizeof(struct MediumSpan), 8)
+#define MEDIUM_SLOT_SIZE(cls)	(medium_class_size(cls) + sizeof(struct MediumSlotHeader))
+
+bool medium_objects_on = 0;		//opt in by set_medium_objects(1) (khmedium command in the kernel)
+
+void set_medium_objects(bool enabled)
+{
+	medium_objects_on = enabled;
+}
+
+bool medium_objects_enabled()
+{
+	return medium_objects_on;
+}
+
+//==================================
+// [1] SIZE CLASSES:
+//==================================
+uint32 medium_class_size(int cls)
+{
+	uint32 band = MEDIUM_MIN_SIZE << (cls / MEDIUM_STEPS_PER_BAND);
+	return band + (cls % MEDIUM_STEPS_PER_BAND + 1) * (band / MEDIUM_STEPS_PER_BAND);
+}
+
+//class of the given size, or -1 if it should be served by whole pages
+int medium_class(uint32 size)
+{
+	if(size <= MEDIUM_MIN_SIZE || size > MEDIUM_MAX_SIZE) return -1;
+
+	int k = 31 - __builtin_clz(size - 1);
+	uint32 band = 1 << k, step = band / MEDIUM_STEPS_PER_BAND;
+	int cls = (k - 11) * MEDIUM_STEPS_PER_BAND + (size - band + step - 1) / step - 1;
+
+	if(MEDIUM_SLOT_SIZE(cls) >= ROUNDUP(size, PAGE_SIZE)) return -1;
+	return cls;
+}
+
+//smallest span that wastes at most 1/16 of its size (or the least wasteful one)
+static uint32 span_pages(int cls)
+{
+	uint32 slot = MEDIUM_SLOT_SIZE(cls);
+	uint32 best_pages = 0, best_waste = 0;
+	for(uint32 pages = ROUNDUP(MEDIUM_SPAN_HEADER_SIZE + slot, PAGE_SIZE) / PAGE_SIZE; pages <= MEDIUM_MAX_SPAN_PAGES; pages++)
+	{
+		uint32 space = pages * PAGE_SIZE - MEDIUM_SPAN_HEADER_SIZE;
+		uint32 waste = space % slot;
+		if(waste * 16 <= pages * PAGE_SIZE) return pages;
+		if(best_pages == 0 || waste * best_pages < best_waste * pages)
+			best_pages = pages, best_waste = waste;
+	}
+	return best_pages;
+}
+
+//==================================
+// [2] ALLOCATE OBJECT:
+//==================================
+void* medium_alloc(uint32 size)
+{
+	int cls = medium_class(size);
+	if(cls < 0) return NULL;
+
+	struct MediumSpan* span = LIST_FIRST(&mediumSpans[cls]);
+	if(span == NULL)
+	{
+		uint32 pages = span_pages(cls);
+		span = medium_span_alloc(pages);
+		if(span == NULL) return NULL;
+
+		span->class = cls;
+		span->pages = pages;
+		span->inuse = 0;
+		span->free_objs = NULL;
+
+		uint32 slot = MEDIUM_SLOT_SIZE(cls);
+		uint32 count = (pages * PAGE_SIZE - MEDIUM_SPAN_HEADER_SIZE) / slot;
+		char* first_slot = (char*)span + MEDIUM_SPAN_HEADER_SIZE;
+		for(int i = count - 1; i >= 0; i--)
+		{
+			struct MediumSlotHeader* hdr = (struct MediumSlotHeader*)(first_slot + i * slot);
+			hdr->span = span;
+			hdr->magic = MEDIUM_MAGIC_FREE;
+			*(void**)(hdr + 1) = span->free_objs;
+			span->free_objs = hdr + 1;
+		}
+		LIST_INSERT_HEAD(&mediumSpans[cls], span);
+	}
+
+	void* obj = span->free_objs;
+	span->free_objs = *(void**)obj;
+	span->inuse++;
+	((struct MediumSlotHeader*)obj - 1)->magic = MEDIUM_MAGIC_ALLOCATED;
+
+	if(span->free_objs == NULL)
+		LIST_REMOVE(&mediumSpans[cls], span);
+
+	return obj;
+}
+
+//==================================
+// [3] FREE OBJECT:
+//==================================
+void medium_free(void* va)
+{
+	struct MediumSlotHeader* hdr = (struct MediumSlotHeader*)va - 1;
+	if(hdr->magic != MEDIUM_MAGIC_ALLOCATED)
+		panic("medium_free: %x is not an allocated medium object", va);
+
+	struct MediumSpan* span = hdr->span;
+	hdr->magic = MEDIUM_MAGIC_FREE;
+
+	if(span->free_objs == NULL)
+		LIST_INSERT_HEAD(&mediumSpans[span->class], span);
+	*(void**)va = span->free_objs;
+	span->free_objs = va;
+	span->inuse--;
+
+	//give the span back unless it is the last one of its class (to avoid re-creating it on the next alloc)
+	if(span->inuse == 0 && LIST_SIZE(&mediumSpans[span->class]) > 1)
+	{
+		LIST_REMOVE(&mediumSpans[span->class], span);
+		medium_span_free(span);
+	}
+}
+
+//usable size of an allocated medium object
+uint32 medium_object_size(void* va)
+{
+	struct MediumSlotHeader* hdr = (struct MediumSlotHeader*)va - 1;
+	return medium_class_size(hdr->span->class);
+}
@@ -150,6 +150,15 @@ void sys_run_env(int32 envId)
 	syscall(SYS_run_env, (int32)envId, 0, 0, 0, 0);
 }
 
+int32 sys_fork(void)
+{
+	int32 id = syscall(SYS_fork, 0, 0, 0, 0, 0);
+	//the child inherits the parent's copy of "myEnv"
+	if (id == 0)
+		myEnv = &(envs[sys_getenvindex()]);
+	return id;
+}
+
 int sys_destroy_env(int32  envid)
 {
 	return syscall(SYS_destroy_env, envid, 0, 0, 0, 0);
@@ -268,6 +277,12 @@ void sys_set_uheap_strategy(uint32 heapStrategy)
 	return ;
 }
 
+void sys_save_heap_trace(struct DATraceRecord* trace, uint32 count)
+{
+	syscall(SYS_save_heap_trace, (uint32)trace, count, 0, 0, 0);
+	return ;
+}
+
 //2020
 int sys_check_LRU_lists(uint32* active_list_content, uint32* second_list_content, int actual_active_list_size, int actual_second_list_size)
 {
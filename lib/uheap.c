@@ -53,6 +53,19 @@ uint32 TREE_first_fit(uint32 count){
 	return cur;
 }
 
+// marks count pages at the free run that starts at the given leaf as allocated (tree only)
+void TREE_set_allocated(uint32 cur, uint32 count){
+	uint32 free_pages = get_free_value(cur);
+
+	update_node(cur, count, 1);
+
+	for(int i = 1; i < count; i++)
+		set_info(cur + i, 0, 1);
+
+	if(free_pages > count)
+		update_node(cur + count, free_pages - count, 0);
+}
+
 void* TREE_alloc_FF(uint32 count){
 
 	if(get_value(1) < count) return NULL;
@@ -60,19 +73,11 @@ void* TREE_alloc_FF(uint32 count){
 	uint32 cur = TREE_first_fit(count);
 	uint32 page_idx = cur - PAGES_COUNT;
 
-	uint32 free_pages = get_free_value(cur);
-
 	uint32 va = (PAGE_ALLOCATOR_START + page_idx * PAGE_SIZE);
 
 	sys_allocate_user_mem(va, count * PAGE_SIZE);
 
-	update_node(cur, count, 1);
-
-	for(int i = 1; i < count; i++)
-		set_info(cur + i, 0, 1);
-
-	if(free_pages > count)
-		update_node(cur + count, free_pages - count, 0);
+	TREE_set_allocated(cur, count);
 
 	return (void*)va;
 }
@@ -84,21 +89,15 @@ void* TREE_salloc_FF(uint32 count){
 	uint32 cur = TREE_first_fit(count);
 	uint32 page_idx = cur - PAGES_COUNT;
 
-	uint32 free_pages = get_free_value(cur);
-
 	uint32 va = (PAGE_ALLOCATOR_START + page_idx * PAGE_SIZE);
 
-	update_node(cur, count, 1);
-
-	for(int i = 1; i < count; i++)
-		set_info(cur + i, 0, 1);
-
-	if(free_pages > count)
-		update_node(cur + count, free_pages - count, 0);
+	TREE_set_allocated(cur, count);
 
 	return (void*)va;
 }
 
+void TREE_set_free(uint32 cur, uint32 count);
+
 bool TREE_free(uint32 page_idx){
 
 	uint32 cur = TREE_get_node(page_idx);
@@ -113,6 +112,15 @@ bool TREE_free(uint32 page_idx){
 
 	sys_free_user_mem(va, count * PAGE_SIZE);
 
+	TREE_set_free(cur, count);
+
+	return 1;
+}
+
+// marks the count pages allocated at the given leaf as free & merges them with the adjacent free runs (tree only)
+void TREE_set_free(uint32 cur, uint32 count){
+	uint32 page_idx = cur - PAGES_COUNT;
+
 	for(int i = 0; i < count; i++)
 		set_info(cur + i, 0, 0);
 
@@ -140,10 +148,234 @@ bool TREE_free(uint32 page_idx){
 
 		update_node(cur_node, count + get_free_value(cur_node), 0);
 	}
+}
+
+static void page_run_cache_flush();
+
+// resizes the page allocation at the given page: in place if the free run after it is big enough,
+// otherwise its pages are moved by the kernel (remapped, not copied) to a new place of the new size
+void* TREE_realloc(uint32 page_idx, uint32 new_size){
+
+	uint32 new_count = ROUNDUP(new_size, PAGE_SIZE) / PAGE_SIZE;
+	uint32 cur = TREE_get_node(page_idx);
+	uint32 old_count = get_value(cur);
+	uint32 va = PAGE_ALLOCATOR_START + page_idx * PAGE_SIZE;
+
+	if(!is_allocated(cur) || old_count == 0)
+		return NULL;
+
+	uint32 nxt = cur + old_count;
+	uint32 next_count = get_free_value(nxt);
+
+	if(old_count + next_count < new_count && get_value(1) < new_count){ // no room: give back the cached runs first
+		page_run_cache_flush();
+		next_count = get_free_value(nxt);
+	}
+
+	if(old_count + next_count < new_count){ // relocate
+		if(get_value(1) < new_count) return NULL;
+
+		uint32 new_cur = TREE_first_fit(new_count);
+		uint32 new_va = PAGE_ALLOCATOR_START + (new_cur - PAGES_COUNT) * PAGE_SIZE;
+
+		TREE_set_allocated(new_cur, new_count);
+		sys_move_user_mem(va, new_va, old_count * PAGE_SIZE);
+		sys_allocate_user_mem(new_va + old_count * PAGE_SIZE, (new_count - old_count) * PAGE_SIZE);
+		TREE_set_free(cur, old_count);
+
+		return (void*)new_va;
+	}
 
+	if(new_count < old_count){ // shrink
+		sys_free_user_mem(va + new_count * PAGE_SIZE, (old_count - new_count) * PAGE_SIZE);
+		for(int i = new_count; i < old_count; i++)
+			set_info(cur + i, 0, 0);
+	}
+	else if(new_count > old_count){ // expand into the next free run
+		sys_allocate_user_mem(va + old_count * PAGE_SIZE, (new_count - old_count) * PAGE_SIZE);
+		for(int i = old_count; i < new_count; i++)
+			set_info(cur + i, 0, 1);
+	}
+	else
+		return (void*)va;
+
+	if(next_count > 0)
+		update_node(nxt, 0, 0);
+	set_info(cur, new_count, 1);
+	if(old_count + next_count > new_count)
+		update_node(cur + new_count, old_count + next_count - new_count, 0);
+
+	return (void*)va;
+}
+
+// moves an allocation to the block/medium/page allocator that serves its new size
+static void* relocate(void* old_va, uint32 copy_size, uint32 new_size){
+	void* new_va = malloc(new_size);
+	if(new_va == NULL) return NULL;
+	memcpy(new_va, old_va, copy_size);
+	free(old_va);
+	return new_va;
+}
+
+//spans of the medium objects allocator are page allocations
+void* medium_span_alloc(uint32 pages){
+	return TREE_alloc_FF(pages);
+}
+
+void medium_span_free(void* va){
+	TREE_free(address_to_page(va));
+}
+
+//medium objects live inside the spans: any address in an allocated page that is not the start of a page allocation
+bool is_medium_object(void* virtual_address){
+	uint32 va = (uint32)virtual_address;
+	if(va < PAGE_ALLOCATOR_START || va >= USER_HEAP_MAX) return 0;
+
+	uint32 cur = TREE_get_node(address_to_page(virtual_address));
+	return is_allocated(cur) && (va % PAGE_SIZE != 0 || get_value(cur) == 0);
+}
+
+//==================================
+// PAGE RUNS CACHE:
+//==================================
+//freed runs stay allocated in the tree (& reserved & mapped in the kernel) while they are cached
+struct PageRun
+{
+	uint32 page_idx;
+	uint32 count;
+	uint32 stamp;		//page_run_clock when it was freed
+};
+
+struct PageRun page_run_cache[PAGE_RUN_CACHE_SIZE];
+uint32 page_run_cache_count = 0;
+uint32 page_run_clock = 0;		//number of page allocations/frees so far
+bool page_run_cache_enabled = 0;		//opt-in (see set_page_run_cache)
+
+static void page_run_cache_release(int i){
+	uint32 page_idx = page_run_cache[i].page_idx;
+	page_run_cache[i] = page_run_cache[--page_run_cache_count];
+	TREE_free(page_idx);
+}
+
+static void page_run_cache_flush(){
+	while(page_run_cache_count > 0)
+		page_run_cache_release(page_run_cache_count - 1);
+}
+
+//release the runs that were not reused for PAGE_RUN_CACHE_DECAY page allocations/frees
+static void page_run_cache_decay(){
+	page_run_clock++;
+	for(int i = page_run_cache_count - 1; i >= 0; i--)
+		if(page_run_clock - page_run_cache[i].stamp > PAGE_RUN_CACHE_DECAY)
+			page_run_cache_release(i);
+}
+
+//return a cached run of exactly count pages (or NULL)
+static void* page_run_cache_get(uint32 count){
+	page_run_cache_decay();
+	for(int i = 0; i < page_run_cache_count; i++){
+		if(page_run_cache[i].count == count){
+			uint32 page_idx = page_run_cache[i].page_idx;
+			page_run_cache[i] = page_run_cache[--page_run_cache_count];
+			return (void*)(PAGE_ALLOCATOR_START + page_idx * PAGE_SIZE);
+		}
+	}
+	return NULL;
+}
+
+//keep the freed page allocation at the given page in the cache (evicting the oldest run if it's full)
+//return 0 if it should be freed now instead
+static bool page_run_cache_put(uint32 page_idx){
+	uint32 cur = TREE_get_node(page_idx);
+	uint32 count = get_value(cur);
+	if(!page_run_cache_enabled || !is_allocated(cur) || count == 0 || count > PAGE_RUN_CACHE_MAX_PAGES)
+		return 0;
+
+	for(int i = 0; i < page_run_cache_count; i++)
+		if(page_run_cache[i].page_idx == page_idx) return 1; // already freed
+
+	page_run_cache_decay();
+	if(page_run_cache_count == PAGE_RUN_CACHE_SIZE){
+		int oldest = 0;
+		for(int i = 1; i < page_run_cache_count; i++)
+			if(page_run_cache[i].stamp < page_run_cache[oldest].stamp) oldest = i;
+		page_run_cache_release(oldest);
+	}
+
+	page_run_cache[page_run_cache_count].page_idx = page_idx;
+	page_run_cache[page_run_cache_count].count = count;
+	page_run_cache[page_run_cache_count].stamp = page_run_clock;
+	page_run_cache_count++;
 	return 1;
 }
 
+//freed page allocations are given back right away unless the cache is enabled
+void set_page_run_cache(bool enabled){
+	page_run_cache_enabled = enabled;
+	if(!enabled)
+		page_run_cache_flush();
+}
+
+//==================================
+// MEMORY PRESSURE:
+//==================================
+uint32 seen_mem_pressure = 0;
+
+//once the kernel signals that free frames are scarce, give back the cached page runs
+//& the free pages at the top of the block allocator
+static void check_memory_pressure(){
+	if(myEnv->mem_pressure == seen_mem_pressure) return;
+	seen_mem_pressure = myEnv->mem_pressure;
+
+	page_run_cache_flush();
+	trim_mapped_region();
+}
+
+//==================================
+// TRACE:
+//==================================
+//starts a new trace of malloc/free/realloc (see DATraceRecord), or stops it
+void set_heap_trace(bool enabled){
+	if(enabled && !daTraceEnabled)
+		daTraceCount = 0;
+	daTraceEnabled = enabled;
+}
+
+//prints the trace over the console & gives a copy of it to the kernel (for its "replaytrace" command)
+void export_heap_trace(){
+	da_trace_print(daTrace, daTraceCount);
+	sys_save_heap_trace(daTrace, daTraceCount);
+}
+
+//serves malloc() by the allocator of the given size
+static void* alloc_heap_space(uint32 size){
+	if(size <= DYN_ALLOC_MAX_BLOCK_SIZE)
+		return alloc_block_FF(size);
+	if(medium_objects_enabled() && medium_class(size) >= 0)
+		return medium_alloc(size);
+	uint32 pages_count = ROUNDUP(size, PAGE_SIZE) / PAGE_SIZE;
+
+	if(sys_isUHeapPlacementStrategyFIRSTFIT()){
+		void* va = page_run_cache_get(pages_count);
+		if(va != NULL) return va;
+		if(get_value(1) < pages_count)
+			page_run_cache_flush();
+		return TREE_alloc_FF(pages_count);
+	}
+
+	return NULL;
+}
+
+//gives the space back to the allocator that owns the address
+static void free_heap_space(void* virtual_address){
+	if((uint32)virtual_address <= myEnv->uheap_segment_break-(DYN_ALLOC_MIN_BLOCK_SIZE+META_DATA_SIZE/2))
+		free_block(virtual_address);
+	else if(is_medium_object(virtual_address))
+		medium_free(virtual_address);
+	else if(!page_run_cache_put(address_to_page(virtual_address)) && !TREE_free(address_to_page(virtual_address)))
+		panic("Address given is not the start of the allocated space\n");
+}
+
 //==================================================================================//
 //============================ REQUIRED FUNCTIONS ==================================//
 //==================================================================================//
@@ -174,15 +406,11 @@ void* malloc(uint32 size)
 		init = 1;
 		update_node(TREE_get_node(0), (USER_HEAP_MAX - (myEnv->uheap_hard_limit + PAGE_SIZE)) / PAGE_SIZE, 0);
 	}
+	check_memory_pressure();
 
-	if(size <= DYN_ALLOC_MAX_BLOCK_SIZE)
-		return alloc_block_FF(size);
-	uint32 pages_count = ROUNDUP(size, PAGE_SIZE) / PAGE_SIZE;
-
-	if(sys_isUHeapPlacementStrategyFIRSTFIT())
-		return TREE_alloc_FF(pages_count);
-
-	return NULL;
+	void* va = alloc_heap_space(size);
+	da_trace_record(DA_TRACE_ALLOC, size, NULL, va);
+	return va;
 	//Use sys_isUHeapPlacementStrategyFIRSTFIT() and	sys_isUHeapPlacementStrategyBESTFIT()
 	//to check the current strategy
 
@@ -201,11 +429,10 @@ void free(void* virtual_address)
 		init = 1;
 		update_node(TREE_get_node(0), (USER_HEAP_MAX - (myEnv->uheap_hard_limit + PAGE_SIZE)) / PAGE_SIZE, 0);
 	}
+	check_memory_pressure();
 
-	if((uint32)virtual_address <= myEnv->uheap_segment_break-(DYN_ALLOC_MIN_BLOCK_SIZE+META_DATA_SIZE/2))
-		free_block(virtual_address);
-	else if(!TREE_free(address_to_page(virtual_address)))
-		panic("Address given is not the start of the allocated space\n");
+	da_trace_record(DA_TRACE_FREE, 0, virtual_address, NULL);
+	free_heap_space(virtual_address);
 }
 
 //=================================
@@ -321,13 +548,54 @@ void sfree(void* virtual_address)
 //		which switches to the kernel mode, calls move_user_mem(...)
 //		in "kern/mem/chunk_operations.c", then switch back to the user mode here
 //	the move_user_mem() function is empty, make sure to implement it.
+static void* realloc_heap_space(void* virtual_address, uint32 new_size);
+
 void *realloc(void *virtual_address, uint32 new_size)
 {
 	//[PROJECT]
-	// Write your code here, remove the panic and write your code
-	panic("realloc() is not implemented yet...!!");
-	return NULL;
+	//the malloc/free it may do are part of this operation in the trace
+	bool tracing = daTraceEnabled;
+	daTraceEnabled = 0;
+	void* va = realloc_heap_space(virtual_address, new_size);
+	daTraceEnabled = tracing;
+
+	da_trace_record(DA_TRACE_REALLOC, new_size, virtual_address, va);
+	return va;
+}
+
+static void* realloc_heap_space(void* virtual_address, uint32 new_size)
+{
+	if(virtual_address == NULL)
+		return malloc(new_size);
+	if(new_size == 0){
+		free(virtual_address);
+		return NULL;
+	}
+
+	if(!init){
+		init = 1;
+		update_node(TREE_get_node(0), (USER_HEAP_MAX - (myEnv->uheap_hard_limit + PAGE_SIZE)) / PAGE_SIZE, 0);
+	}
+
+	if((uint32)virtual_address <= myEnv->uheap_segment_break-(DYN_ALLOC_MIN_BLOCK_SIZE+META_DATA_SIZE/2)){
+		if(new_size <= DYN_ALLOC_MAX_BLOCK_SIZE)
+			return realloc_block_FF(virtual_address, new_size);
+		return relocate(virtual_address, get_block_size(virtual_address) - ALLOC_META_DATA_SIZE, new_size);
+	}
+
+	if(is_medium_object(virtual_address)){ // keep it if the new size has the same class, else move it
+		uint32 old_size = medium_object_size(virtual_address);
+		int cls = medium_class(new_size);
+		if(cls >= 0 && medium_class_size(cls) == old_size)
+			return virtual_address;
+		return relocate(virtual_address, MIN(old_size, new_size), new_size);
+	}
+
+	uint32 old_count = get_value(TREE_get_node(address_to_page(virtual_address)));
+	if(new_size <= DYN_ALLOC_MAX_BLOCK_SIZE || (medium_objects_enabled() && medium_class(new_size) >= 0))
+		return relocate(virtual_address, MIN(old_count * PAGE_SIZE, new_size), new_size);
 
+	return TREE_realloc(address_to_page(virtual_address), new_size);
 }
 
 
@@ -0,0 +1,60 @@
+#include <inc/lib.h>
+
+#define NUM_OF_PAGES 4
+
+char data[NUM_OF_PAGES * PAGE_SIZE] = {1};
+
+void _main(void)
+{
+	//the child reports back through a shared object (stays shared after the fork)
+	volatile int* result = smalloc("forkResult", sizeof(int), 1);
+	*result = 0;
+	char* heap = malloc(NUM_OF_PAGES * PAGE_SIZE);
+	for (int i = 0; i < NUM_OF_PAGES * PAGE_SIZE; i += PAGE_SIZE/4)
+	{
+		data[i] = 'p';
+		heap[i] = 'P';
+	}
+
+	//[1] the child starts with the same memory & sees its own writes only
+	int32 id = sys_fork();
+	if (id == 0)
+	{
+		bool is_correct = 1;
+		for (int i = 0; i < NUM_OF_PAGES * PAGE_SIZE; i += PAGE_SIZE/4)
+		{
+			if (data[i] != 'p' || heap[i] != 'P')
+				is_correct = 0;
+			data[i] = 'c';
+			heap[i] = 'C';
+		}
+		for (int i = 0; i < NUM_OF_PAGES * PAGE_SIZE; i += PAGE_SIZE/4)
+			if (data[i] != 'c' || heap[i] != 'C')
+				is_correct = 0;
+		*result = is_correct ? 1 : 2;
+		return;
+	}
+	if (id < 0)
+		panic("tst_fork: sys_fork failed");
+
+	int eval = 0;
+	sys_run_env(id);
+	while (*result == 0) ;
+	if (*result != 1)
+		cprintf("tst_fork #1: the child doesn't see its own copy of the parent memory\n");
+	else
+		eval += 50;
+
+	//[2] the parent still sees its own values
+	bool is_correct = 1;
+	for (int i = 0; i < NUM_OF_PAGES * PAGE_SIZE; i += PAGE_SIZE/4)
+		if (data[i] != 'p' || heap[i] != 'P')
+			is_correct = 0;
+	if (!is_correct)
+		cprintf("tst_fork #2: the child writes are seen by the parent\n");
+	else
+		eval += 50;
+
+	free(heap);
+	cprintf("%~test fork completed. Evaluation = %d%\n", eval);
+}
@@ -0,0 +1,54 @@
+#include <inc/lib.h>
+
+#define NUM_OF_OBJS 64
+
+void _main(void)
+{
+	//[1] record a workload of blocks, a page allocation & reallocs, in addition to what fits the ring
+	set_heap_trace(1);
+	char* objs[NUM_OF_OBJS] = {0};
+	uint32 seed = 7;
+	uint32 ops = 0;
+	for (int i = 0; i < 3 * DA_TRACE_SIZE; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		int idx = (seed >> 16) % NUM_OF_OBJS;
+		if (objs[idx] == NULL)
+			objs[idx] = malloc(16 + (seed >> 8) % 1000);
+		else if (seed & 0x100)
+			objs[idx] = realloc(objs[idx], 16 + (seed >> 4) % 1500);
+		else
+		{
+			free(objs[idx]);
+			objs[idx] = NULL;
+		}
+		ops++;
+	}
+	char* pages = malloc(3*PAGE_SIZE);
+	free(pages);
+	ops += 2;
+	set_heap_trace(0);
+
+	int eval = 0;
+	if (daTraceCount != ops)
+		cprintf("tst_heap_trace #1: expected %d records, found %d\n", ops, daTraceCount);
+	else if (daTrace[(ops - 1) % DA_TRACE_SIZE].op != DA_TRACE_FREE || daTrace[(ops - 1) % DA_TRACE_SIZE].addr != (uint32)pages)
+		cprintf("tst_heap_trace #1: wrong last record\n");
+	else
+		eval += 50;
+
+	//[2] nothing is recorded once the trace is stopped
+	free(malloc(100));
+	if (daTraceCount != ops)
+		cprintf("tst_heap_trace #2: records are added after stopping the trace\n");
+	else
+		eval += 50;
+
+	//export it (then replay it by the "replaytrace" command)
+	export_heap_trace();
+
+	for (int i = 0; i < NUM_OF_OBJS; i++)
+		free(objs[i]);
+
+	cprintf("%~test heap trace completed. Evaluation = %d%\n", eval);
+}
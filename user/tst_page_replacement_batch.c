@@ -0,0 +1,74 @@
+/* *********************************************************** */
+/* MAKE SURE to enable the batch eviction with the buffering disabled: batchevict */
+/* & to run it with a WS of 20 to 60 pages: run tbatch 40 */
+/* *********************************************************** */
+// Batch eviction: a full WS should give up a group of its pages at once, & the modified ones
+// among them should be written back together in fewer disk requests than pages
+#include <inc/lib.h>
+
+#define NUM_OF_PAGES 180
+#define MAX_BATCH_SIZE 32 //PF_MAX_CLUSTER_PAGES
+
+void _main(void)
+{
+#if USE_KHEAP
+	if (myEnv->page_WS_max_size < 20 || myEnv->page_WS_max_size > NUM_OF_PAGES / 3)
+		panic("Please run it with a WS of 20 to 60 pages");
+#else
+	panic("make sure to enable the kernel heap: USE_KHEAP=1");
+#endif
+
+	uint32 WSSize = myEnv->page_WS_max_size;
+	uint32 batchSize = ROUNDUP(myEnv->percentage_of_WS_pages_to_be_removed * WSSize, 100) / 100;
+	if (batchSize > MAX_BATCH_SIZE)
+		batchSize = MAX_BATCH_SIZE;
+	if (batchSize < 2)
+		panic("Please increase the WS size");
+
+	char* arr = malloc(NUM_OF_PAGES * PAGE_SIZE);
+	uint32 pageOutsBefore = myEnv->nPageOut;
+	uint32 requestsBefore = myEnv->nPageOutRequests;
+
+	//[1] modify all the pages, tracking the smallest WS seen once it's full: each fault on a full WS
+	//evicts a batch then places one page
+	uint32 minWSSize = WSSize;
+	bool wasFull = 0;
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+	{
+		arr[i * PAGE_SIZE] = 'a' + i % 26;
+		arr[(i+1) * PAGE_SIZE - 1] = 'A' + i % 26;
+		uint32 size = LIST_SIZE(&(myEnv->page_WS_list));
+		if (size >= WSSize)
+			wasFull = 1;
+		else if (wasFull && size < minWSSize)
+			minWSSize = size;
+	}
+	uint32 numOfPageOuts = myEnv->nPageOut - pageOutsBefore;
+	uint32 numOfRequests = myEnv->nPageOutRequests - requestsBefore;
+
+	int eval = 0;
+	if (minWSSize != WSSize - batchSize + 1)
+		cprintf("tbatch #1: a full WS should give up %d pages at once [WS shrunk to %d of %d]\n", batchSize, minWSSize, WSSize);
+	else
+		eval += 30;
+
+	if (numOfPageOuts == 0 || numOfRequests >= numOfPageOuts)
+		cprintf("tbatch #2: the evicted modified pages are not written back together [%d pages in %d requests]\n", numOfPageOuts, numOfRequests);
+	else
+		eval += 30;
+
+	//[2] the pages written back together are read back correctly
+	bool is_correct = 1;
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+	{
+		if (arr[i * PAGE_SIZE] != 'a' + i % 26 || arr[(i+1) * PAGE_SIZE - 1] != 'A' + i % 26)
+			is_correct = 0;
+	}
+	if (!is_correct)
+		cprintf("tbatch #3: the pages evicted in batches are not read back correctly\n");
+	else
+		eval += 40;
+
+	free(arr);
+	cprintf("%~test batch eviction completed. Evaluation = %d%\n", eval);
+}
@@ -0,0 +1,59 @@
+/* *********************************************************** */
+/* MAKE SURE to enable the buffering: buff */
+/* & to run it with a WS of less than 40 pages: run tbuff 20 */
+/* *********************************************************** */
+// The evicted pages are buffered: each keeps its frame till it's reused, so faulting on it again
+// should take the frame back without reading the page file
+#include <inc/lib.h>
+
+#define NUM_OF_PAGES 40
+
+void _main(void)
+{
+#if USE_KHEAP
+	if (myEnv->page_WS_max_size >= NUM_OF_PAGES)
+		panic("Please decrease the WS size");
+#else
+	panic("make sure to enable the kernel heap: USE_KHEAP=1");
+#endif
+
+	char* arr = malloc(NUM_OF_PAGES * PAGE_SIZE);
+
+	//[1] modify all the pages: the first ones are evicted (& buffered) to make room for the last ones
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+	{
+		arr[i * PAGE_SIZE] = 'a' + i % 26;
+		arr[(i+1) * PAGE_SIZE - 1] = 'A' + i % 26;
+	}
+
+	//[2] read them all again: each evicted page is found in its buffered frame
+	uint32 faultsBefore = myEnv->pageFaultsCounter;
+	uint32 pageInsBefore = myEnv->nPageIn;
+	bool is_correct = 1;
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+	{
+		if (arr[i * PAGE_SIZE] != 'a' + i % 26 || arr[(i+1) * PAGE_SIZE - 1] != 'A' + i % 26)
+			is_correct = 0;
+	}
+	uint32 numOfFaults = myEnv->pageFaultsCounter - faultsBefore;
+	uint32 numOfPageIns = myEnv->nPageIn - pageInsBefore;
+
+	int eval = 0;
+	if (numOfFaults < NUM_OF_PAGES - myEnv->page_WS_max_size)
+		cprintf("tbuff #1: the evicted pages are not faulted back [%d faults]\n", numOfFaults);
+	else
+		eval += 20;
+
+	if (numOfPageIns != 0)
+		cprintf("tbuff #2: %d of the buffered pages are read from the page file instead of taking their frames back\n", numOfPageIns);
+	else
+		eval += 50;
+
+	if (!is_correct)
+		cprintf("tbuff #3: the buffered pages are not faulted back correctly\n");
+	else
+		eval += 30;
+
+	free(arr);
+	cprintf("%~test page buffering completed. Evaluation = %d%\n", eval);
+}
@@ -0,0 +1,69 @@
+/* *********************************************************** */
+/* MAKE SURE to select the global clock: gclock 1 1 */
+/* & to run it with a WS of at least 250 pages: run tgclock1 250 */
+/* *********************************************************** */
+// Two envs competing for the frames under the GLOBAL Nth chance clock: the faults of a busy env should
+// take the frames of the idle pages of another env, never those of the pages it keeps using
+// Master program: keeps using its pages while loading new ones
+#include <inc/lib.h>
+
+#define MAX_NUM_OF_PAGES 200
+
+uint32 expectedVAs[MAX_NUM_OF_PAGES];
+
+void _main(void)
+{
+#if USE_KHEAP
+	if (myEnv->page_WS_max_size < MAX_NUM_OF_PAGES + 50)
+		panic("Please increase the WS size");
+#else
+	panic("make sure to enable the kernel heap: USE_KHEAP=1");
+#endif
+
+	//the slave reports its state through a shared object
+	volatile int* phase = smalloc("gclockPhase", sizeof(int), 1);
+	*phase = 0;
+	char* arr = malloc(MAX_NUM_OF_PAGES * PAGE_SIZE);
+
+	int32 slaveID = sys_create_env("tgclock1_slave", (myEnv->page_WS_max_size), (myEnv->SecondListSize), (myEnv->percentage_of_WS_pages_to_be_removed));
+	sys_run_env(slaveID);
+
+	//[1] wait for the slave to load its pages, then make the memory scarce so that each
+	//fault from now on takes the frame of a page of one of the envs
+	while (*phase == 0) ;
+	sys_scarce_memory();
+
+	//[2] load a new page then use all the loaded ones, till the slave finds its (idle) pages evicted
+	int numOfPages = 0;
+	char sum = 0;
+	while (*phase == 1 && numOfPages < MAX_NUM_OF_PAGES)
+	{
+		arr[numOfPages * PAGE_SIZE] = (char)numOfPages;
+		expectedVAs[numOfPages] = (uint32)&arr[numOfPages * PAGE_SIZE];
+		numOfPages++;
+		for (int i = 0; i < numOfPages; i++)
+			sum += arr[i * PAGE_SIZE];
+	}
+
+	int eval = 0;
+	if (*phase != 2)
+		cprintf("tgclock1 #1: the idle pages of the other env are not evicted after %d faults\n", numOfPages);
+	else
+		eval += 40;
+
+	if (sys_check_WS_list(expectedVAs, numOfPages, 0, 2) != 1)
+		cprintf("tgclock1 #2: a page in use is evicted while the other env has idle pages\n");
+	else
+		eval += 30;
+
+	//[3] let the slave fault its pages back & check them
+	*phase = 3;
+	while (*phase == 3) ;
+	if (*phase != 4)
+		cprintf("tgclock1 #3: the evicted pages of the other env are not read back correctly\n");
+	else
+		eval += 30;
+
+	free(arr);
+	cprintf("%~test global clock [1] completed. Evaluation = %d%\n", eval);
+}
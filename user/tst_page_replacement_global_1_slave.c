@@ -0,0 +1,42 @@
+// Slave program of tst_page_replacement_global_1: loads & modifies its pages, stays idle till they're
+// evicted by the faults of the master, then faults them back & checks them
+#include <inc/lib.h>
+
+#define NUM_OF_PAGES 10
+
+uint32 arrVAs[NUM_OF_PAGES];
+
+void _main(void)
+{
+	volatile int* phase = sget(sys_getparentenvid(), "gclockPhase");
+	char* arr = malloc(NUM_OF_PAGES * PAGE_SIZE);
+
+	//[1] load & modify the pages
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+	{
+		arr[i * PAGE_SIZE] = 'a' + i;
+		arr[(i+1) * PAGE_SIZE - 1] = 'A' + i;
+		arrVAs[i] = (uint32)&arr[i * PAGE_SIZE];
+	}
+	if (sys_check_WS_list(arrVAs, NUM_OF_PAGES, 0, 2) != 1)
+		panic("tgclock1_slave: the pages should be in the WS... please increase the WS size");
+	*phase = 1;
+
+	//[2] stay idle (only this loop & the shared object are in use) till none of the pages is in the WS
+	while (*phase == 1)
+	{
+		if (sys_check_WS_list(arrVAs, NUM_OF_PAGES, 0, 3) == 1)
+			*phase = 2;
+	}
+
+	//[3] read them back from the page file
+	while (*phase == 2) ;
+	bool is_correct = 1;
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+	{
+		if (arr[i * PAGE_SIZE] != 'a' + i || arr[(i+1) * PAGE_SIZE - 1] != 'A' + i)
+			is_correct = 0;
+	}
+	free(arr);
+	*phase = is_correct ? 4 : 5;
+}
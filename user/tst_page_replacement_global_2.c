@@ -0,0 +1,94 @@
+/* *********************************************************** */
+/* MAKE SURE to select the global clock: gclock 1 1 */
+/* & to run it with a WS of at least 250 pages: run tgclock2 250 */
+/* *********************************************************** */
+// The idle pages of a shared object under the GLOBAL Nth chance clock: a page should be evicted
+// from all its sharers at once, then faulted back by each of them with its contents
+// Master program: creates the object, then takes its frames by faulting on private pages
+#include <inc/lib.h>
+
+#define NUM_OF_SHARED_PAGES 5
+#define MAX_NUM_OF_PAGES 200
+
+//the entry of a page in the page tables of this env
+#define PTE_OF(va) (((volatile uint32*)UVPT)[VPN((uint32)(va))])
+
+static bool are_shared_out(char* shared)
+{
+	for (int i = 0; i < NUM_OF_SHARED_PAGES; i++)
+	{
+		if ((PTE_OF(&shared[i * PAGE_SIZE]) & (PERM_PRESENT | PERM_SHARE_OUT)) != PERM_SHARE_OUT)
+			return 0;
+	}
+	return 1;
+}
+
+void _main(void)
+{
+#if USE_KHEAP
+	if (myEnv->page_WS_max_size < MAX_NUM_OF_PAGES + 50)
+		panic("Please increase the WS size");
+#else
+	panic("make sure to enable the kernel heap: USE_KHEAP=1");
+#endif
+
+	//the slave reports its state through a shared object
+	volatile int* phase = smalloc("gclockPhase2", sizeof(int), 1);
+	*phase = 0;
+	char* shared = smalloc("gclockShared", NUM_OF_SHARED_PAGES * PAGE_SIZE, 1);
+	for (int i = 0; i < NUM_OF_SHARED_PAGES; i++)
+		shared[i * PAGE_SIZE] = 'a' + i;
+	char* arr = malloc(MAX_NUM_OF_PAGES * PAGE_SIZE);
+
+	int32 slaveID = sys_create_env("tgclock2_slave", (myEnv->page_WS_max_size), (myEnv->SecondListSize), (myEnv->percentage_of_WS_pages_to_be_removed));
+	sys_run_env(slaveID);
+
+	//[1] wait for the slave to modify the shared pages, then make the memory scarce so that each
+	//fault from now on takes the frame of a page in use by the envs
+	while (*phase == 0) ;
+	if (*phase != 1)
+		panic("tgclock2: the shared pages are not seen correctly by the slave");
+	sys_scarce_memory();
+
+	//[2] load a new page then use all the loaded ones, till the (idle) shared pages are evicted
+	int numOfPages = 0;
+	char sum = 0;
+	while (!are_shared_out(shared) && numOfPages < MAX_NUM_OF_PAGES)
+	{
+		arr[numOfPages * PAGE_SIZE] = (char)numOfPages;
+		numOfPages++;
+		for (int i = 0; i < numOfPages; i++)
+			sum += arr[i * PAGE_SIZE];
+	}
+
+	int eval = 0;
+	if (!are_shared_out(shared))
+		cprintf("tgclock2 #1: the idle shared pages are not evicted after %d faults\n", numOfPages);
+	else
+		eval += 30;
+
+	//[3] the slave finds them evicted too, faults them back first (from the page file) & checks them
+	*phase = 2;
+	while (*phase == 2) ;
+	if (*phase != 3)
+		cprintf("tgclock2 #2: the slave doesn't read the evicted shared pages back correctly\n");
+	else
+		eval += 35;
+
+	//[4] then this env faults them back (on the frames read by the slave) & checks them
+	bool is_correct = 1;
+	for (int i = 0; i < NUM_OF_SHARED_PAGES; i++)
+	{
+		if (shared[i * PAGE_SIZE] != 'a' + i || shared[i * PAGE_SIZE + 1] != 'A' + i)
+			is_correct = 0;
+		if (!(PTE_OF(&shared[i * PAGE_SIZE]) & PERM_PRESENT))
+			is_correct = 0;
+	}
+	if (!is_correct)
+		cprintf("tgclock2 #3: the evicted shared pages are not faulted back correctly by the master\n");
+	else
+		eval += 35;
+
+	free(arr);
+	cprintf("%~test global clock [2] completed. Evaluation = %d%\n", eval);
+}
@@ -0,0 +1,47 @@
+// Slave program of tst_page_replacement_global_2: modifies the pages of the shared object, stays idle
+// till the master evicts them, then checks they're evicted from its page tables & faults them back
+#include <inc/lib.h>
+
+#define NUM_OF_SHARED_PAGES 5
+
+//the entry of a page in the page tables of this env
+#define PTE_OF(va) (((volatile uint32*)UVPT)[VPN((uint32)(va))])
+
+void _main(void)
+{
+	volatile int* phase = sget(sys_getparentenvid(), "gclockPhase2");
+	char* shared = sget(sys_getparentenvid(), "gclockShared");
+
+	//[1] check the values of the master & add a mark of this env on each page
+	bool is_correct = 1;
+	for (int i = 0; i < NUM_OF_SHARED_PAGES; i++)
+	{
+		if (shared[i * PAGE_SIZE] != 'a' + i)
+			is_correct = 0;
+		shared[i * PAGE_SIZE + 1] = 'A' + i;
+	}
+	if (!is_correct)
+	{
+		*phase = 4;
+		return;
+	}
+	*phase = 1;
+
+	//[2] stay idle till the master takes the frames of the shared pages
+	while (*phase == 1) ;
+
+	//[3] the pages are evicted from all the sharers: fault them back & check them
+	for (int i = 0; i < NUM_OF_SHARED_PAGES; i++)
+	{
+		if ((PTE_OF(&shared[i * PAGE_SIZE]) & (PERM_PRESENT | PERM_SHARE_OUT)) != PERM_SHARE_OUT)
+			is_correct = 0;
+	}
+	for (int i = 0; i < NUM_OF_SHARED_PAGES; i++)
+	{
+		if (shared[i * PAGE_SIZE] != 'a' + i || shared[i * PAGE_SIZE + 1] != 'A' + i)
+			is_correct = 0;
+		if (!(PTE_OF(&shared[i * PAGE_SIZE]) & PERM_PRESENT))
+			is_correct = 0;
+	}
+	*phase = is_correct ? 3 : 4;
+}
@@ -0,0 +1,70 @@
+/* *********************************************************** */
+/* MAKE SURE to size the WS by page fault frequency: pff 5 100 */
+/* & to run it with a WS between the min & max of pff, & of less than 60 pages: run tpff 20 */
+/* *********************************************************** */
+// The WS max size follows the page fault frequency: it should grow while the env thrashes,
+// then shrink (at the next fault) once the env stops faulting
+#include <inc/lib.h>
+
+#define NUM_OF_PAGES 60
+#define MAX_NUM_OF_ROUNDS 1000
+#define MAX_NUM_OF_IDLE_CLOCKS 1000
+
+void _main(void)
+{
+#if USE_KHEAP
+	if (myEnv->page_WS_max_size >= NUM_OF_PAGES)
+		panic("Please decrease the WS size");
+#else
+	panic("make sure to enable the kernel heap: USE_KHEAP=1");
+#endif
+
+	uint32 initialWSSize = myEnv->page_WS_max_size;
+	char* arr = malloc(NUM_OF_PAGES * PAGE_SIZE);
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+		arr[i * PAGE_SIZE] = 'a' + i % 26;
+
+	//[1] thrash: keep cycling over more pages than the WS holds, till its size is increased
+	char sum = 0;
+	for (int round = 0; round < MAX_NUM_OF_ROUNDS && myEnv->page_WS_max_size <= initialWSSize; round++)
+	{
+		for (int i = 0; i < NUM_OF_PAGES; i++)
+			sum += arr[i * PAGE_SIZE];
+	}
+	uint32 grownWSSize = myEnv->page_WS_max_size;
+
+	int eval = 0;
+	if (grownWSSize <= initialWSSize)
+		cprintf("tpff #1: the WS size is not increased while thrashing [%d pages]\n", grownWSSize);
+	else
+		eval += 40;
+
+	//[2] stay idle (no faults) till a smaller size is picked, then fault on a new page to apply it
+	uint32 startClock = myEnv->nClocks;
+	while (!(myEnv->pffPendingWSSize != 0 && myEnv->pffPendingWSSize < myEnv->page_WS_max_size)
+			&& myEnv->nClocks - startClock < MAX_NUM_OF_IDLE_CLOCKS) ;
+	char* newPage = malloc(PAGE_SIZE);
+	newPage[0] = 1;
+
+	uint32 shrunkWSSize = myEnv->page_WS_max_size;
+	if (shrunkWSSize >= grownWSSize || LIST_SIZE(&(myEnv->page_WS_list)) > shrunkWSSize)
+		cprintf("tpff #2: the WS is not shrunk after staying idle [size %d, max %d]\n", LIST_SIZE(&(myEnv->page_WS_list)), shrunkWSSize);
+	else
+		eval += 30;
+
+	//[3] the pages evicted by the resizes are read back correctly
+	bool is_correct = 1;
+	for (int i = 0; i < NUM_OF_PAGES; i++)
+	{
+		if (arr[i * PAGE_SIZE] != 'a' + i % 26)
+			is_correct = 0;
+	}
+	if (!is_correct)
+		cprintf("tpff #3: the pages are not read back correctly after resizing the WS\n");
+	else
+		eval += 30;
+
+	free(newPage);
+	free(arr);
+	cprintf("%~test page fault frequency completed. Evaluation = %d%\n", eval);
+}
@@ -0,0 +1,95 @@
+/* *********************************************************** */
+/* MAKE SURE PAGE_WS_MAX_SIZE = 1000 */
+/* *********************************************************** */
+#include <inc/lib.h>
+
+#define Mega  (1024*1024)
+#define kilo (1024)
+
+static bool check_values(char* ptr, uint32 size, char base)
+{
+	for (uint32 i = 0; i < size; i += PAGE_SIZE / 2)
+		if (ptr[i] != (char)(base + i / PAGE_SIZE))
+			return 0;
+	return 1;
+}
+
+static void fill_values(char* ptr, uint32 size, char base)
+{
+	for (uint32 i = 0; i < size; i += PAGE_SIZE / 2)
+		ptr[i] = (char)(base + i / PAGE_SIZE);
+}
+
+void _main(void)
+{
+	sys_set_uheap_strategy(UHP_PLACE_FIRSTFIT);
+
+	int eval = 0;
+
+	//[1] block allocator: grow & shrink keep the contents
+	cprintf("1: realloc of small blocks\n\n");
+	{
+		int* arr = malloc(10 * sizeof(int));
+		for (int i = 0; i < 10; i++) arr[i] = i;
+		arr = realloc(arr, 300 * sizeof(int));
+		bool is_correct = (arr != NULL);
+		for (int i = 0; is_correct && i < 10; i++)
+			if (arr[i] != i) is_correct = 0;
+		arr = realloc(arr, 5 * sizeof(int));
+		for (int i = 0; is_correct && i < 5; i++)
+			if (arr[i] != i) is_correct = 0;
+		free(arr);
+		if (is_correct) eval += 20;
+		else cprintf("tst_realloc_1 #1: wrong contents after realloc of a small block\n");
+	}
+
+	//[2] page allocator: expand in place into the free pages after the allocation
+	cprintf("2: expand in place\n\n");
+	char* ptr1 = malloc(2*Mega);
+	fill_values(ptr1, 2*Mega, 'a');
+	{
+		char* ptr = realloc(ptr1, 3*Mega);
+		if (ptr != ptr1 || !check_values(ptr, 2*Mega, 'a'))
+			cprintf("tst_realloc_1 #2: expected to expand in place @ %x, found %x\n", ptr1, ptr);
+		else
+			eval += 20;
+		ptr1 = ptr;
+	}
+
+	//[3] page allocator: move to a bigger place without copying
+	cprintf("3: move to a new place\n\n");
+	char* ptr2 = malloc(1*Mega);
+	{
+		int freeFrames = sys_calculate_free_frames();
+		char* ptr = realloc(ptr1, 4*Mega);
+		if (ptr == ptr1 || ptr < ptr2 + 1*Mega)
+			cprintf("tst_realloc_1 #3: expected to move after %x, found %x\n", ptr2 + 1*Mega, ptr);
+		else if (sys_calculate_free_frames() < freeFrames - 4 /*tables*/)
+			cprintf("tst_realloc_1 #3: moving should not allocate frames for the moved pages\n");
+		else if (!check_values(ptr, 2*Mega, 'a'))
+			cprintf("tst_realloc_1 #3: wrong contents after moving\n");
+		else
+			eval += 30;
+		ptr1 = ptr;
+	}
+
+	//[4] page allocator: shrink in place then reuse the freed tail (the 3 MB freed by [3] are not enough)
+	cprintf("4: shrink in place\n\n");
+	{
+		char* ptr = realloc(ptr1, 1*Mega);
+		char* ptr3 = malloc(4*Mega);
+		if (ptr != ptr1 || !check_values(ptr, 1*Mega, 'a'))
+			cprintf("tst_realloc_1 #4: expected to shrink in place @ %x, found %x\n", ptr1, ptr);
+		else if (ptr3 != ptr + 1*Mega)
+			cprintf("tst_realloc_1 #4: expected the next allocation @ %x, found %x\n", ptr + 1*Mega, ptr3);
+		else
+			eval += 30;
+		free(ptr);
+		free(ptr2);
+		free(ptr3);
+	}
+
+	cprintf("%~test realloc() completed. Evaluation = %d%\n", eval);
+
+	return;
+}